@@ -1,4 +1,5 @@
 #include <JeeLib.h>
+#include <TallyFrame.h>
 
 // PROGRAM LED pin
 int PROGRAM_PIN = A0;
@@ -27,6 +28,9 @@ unsigned long last_radio_recv = 0;
 // default Node # 200 (alias to 0) will blink constantly if signal exists
 int this_node = 200;
 
+// picks the tally of this node's input out of the radio frames
+TallyFrameDecoder tally_frame;
+
 void setup() {
 	// initialize all the defined pins
 	pinMode(PROGRAM_PIN, OUTPUT);
@@ -73,10 +77,19 @@ void setup() {
 void loop() {
 	if (rf12_recvDone() && rf12_crc == 0 && rf12_len >= 1) {
 		// a radio signal was received
-		
-		// get the program and preview pins
-		int program = rf12_data[0];
-		int preview = rf12_data[2];
+		unsigned long receive_time = micros();
+		byte tally;
+
+		if (tally_frame.decode(rf12_data, rf12_len)) {
+			// a tally frame: this node's program and preview bits
+			tally = tally_frame.tally();
+		} else {
+			// older transmitters send the program and preview numbers as two ints
+			int program = rf12_data[0];
+			int preview = rf12_data[2];
+
+			tally = program == this_node ? TALLY_PROGRAM : (preview == this_node ? TALLY_PREVIEW : 0);
+		}
 
 		// turn off all LEDs
 		digitalWrite(PREVIEW_PIN, 1023);
@@ -91,15 +104,21 @@ void loop() {
 			delay(1000);
 		} else {
 			// if the Node # is a set number, trigger an LED accordingly
-			if (program == this_node) {
+			if (tally & TALLY_PROGRAM) {
 				digitalWrite(PREVIEW_PIN, 1023);
 				analogWrite(PROGRAM_PIN, 0);
-			} else if (preview == this_node) {
+			} else if (tally & TALLY_PREVIEW) {
 				analogWrite(PROGRAM_PIN, 1023);
 				digitalWrite(PREVIEW_PIN, 0);
 			}
 		}
 		
+		// if the transmitter asks for it, echo the frame so it can measure the latency up to here
+		byte echo[TALLY_ECHO_LENGTH];
+		if (tally_frame.buildEcho(echo, micros() - receive_time) && rf12_canSend()) {
+			rf12_sendStart(RF12_HDR_DST | TALLY_TRANSMITTER_NODE, echo, sizeof echo);
+		}
+
 		// keep track of last radio signal time
 		last_radio_recv = millis();
 	}
@@ -127,6 +146,9 @@ byte setNodeID(int* dipPins, int numPins) {
 	// if the DIP switches are all OFF, assign 200 (alias to 0) to the Node #
   	this_node = this_node == 0 ? 200 : this_node;
 
+	// the node # is the input number to show the tally of
+	tally_frame.begin(this_node);
+
 	// initialize the radio
   	rf12_initialize(this_node, RF12_915MHZ, 4);
 }
\ No newline at end of file
@@ -1,11 +1,12 @@
 #include <SPI.h>
 #include <Ethernet.h>
-#include <TextFinder.h>
 #include <EEPROM.h>
 #include <avr/pgmspace.h>
 #include <ATEM.h>
+#include <StageTimer.h>
 #include <ATEMTally.h>
 #include <JeeLibMod.h>
+#include <TallyFrame.h>
 
 // set the default MAC address
 byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED};
@@ -22,23 +23,110 @@ int switcher_port = 49910;
 // initialize the ethernet server (for settings page)
 EthernetServer server(80);
 
-// set to false initially; set to true when ATEM switcher initializes
-boolean ranOnce = false;
-
 // create a new AtemSwitcher and ATEMTally object
 ATEM AtemSwitcher;
 ATEMTally ATEMTally;
 
-// define a structure for sending over the radio
-struct {
-  	int program;
-  	int preview;
-} payload;
+// builds the radio frames with the tally of all inputs
+TallyFrameEncoder tally_frame;
+
+// number of times a new state is sent as a full frame after the delta frame, in case a receiver misses one
+#define RADIO_REPEATS 3
+
+// set when the delta frame of a new state is waiting for the radio
+boolean radio_delta_pending = false;
+
+// interval (ms) the unchanged state is sent at; receivers turn off their LEDs after 1 second without a signal
+#define RADIO_HEARTBEAT 300
+
+// sends left of the current state before falling back to the heartbeat
+byte radio_repeats_left = 0;
+
+// last time (millis) the state was sent
+unsigned long radio_last_send = 0;
+
+// radio statistics: frames sent in total, and in the last full second
+unsigned long radio_frames_sent = 0;
+unsigned int radio_frames_per_second = 0;
+unsigned long radio_frames_second_count = 0;
+
+// switcher statistics: packets received and answered in the last full second
+unsigned int atem_packets_per_second = 0;
+unsigned long atem_packets_second_count = 0;
+unsigned int atem_answers_per_second = 0;
+unsigned long atem_answers_second_count = 0;
+
+// receiver (node #) asked to echo each new state, to measure the latency from the switcher to its LED; 0 = none.
+// Off by default: while a probe waits for its echo, repeats and heartbeats hold back
+#define LATENCY_PROBE_NODE 0
+
+// how long (ms) repeats wait for the echo, so it doesn't collide with them
+#define LATENCY_PROBE_WAIT 15
+
+// the state waiting for its echo: sequence number, send time (micros) and age (us) when sent
+boolean latency_probe_waiting = false;
+byte latency_probe_sequence;
+unsigned long latency_probe_sent;
+unsigned long latency_probe_age;
+MilliTimer latency_probe_timer;
+
+// latency probes without an echo
+unsigned int latency_probes_lost = 0;
 
+// time (micros) the switcher packet with the current state arrived
+unsigned long tally_change_time = 0;
+
+// set once the radio is out of its power-up reset and configured, see setup()
+boolean radio_ready = false;
+
+// boot milestones (millis since reset): Ethernet set up, radio ready, switcher state
+// received and the first radio frame with it sent; 0 = not yet
+unsigned long boot_ethernet_time = 0;
+unsigned long boot_radio_time = 0;
+unsigned long boot_switcher_time = 0;
+unsigned long boot_tally_time = 0;
+
+// how long (ms) the LED shows a radio frame was sent
+#define LED_BLINK_TIME 10
+
+// turns the LED back after a radio frame was sent
+MilliTimer led_blink_timer;
+
+// tasks run by loop() after the switcher is served; a period of 0 runs the task on every pass
+struct task {
+	void (*run)();
+	word period;			// ms
+	unsigned int budget;	// us the task should be done in
+	MilliTimer timer;
+	unsigned int max_time;	// us the task took at most
+	unsigned int overruns;	// times the task took longer than its budget
+};
+
+void task_radio();
+void task_led();
+void task_http();
+void task_network();
+void task_reset();
+void task_stats();
+void task_serial();
+
+task tasks[] = {
+	{ task_radio,		0,		500 },
+	{ task_led,			0,		100 },
+	{ task_http,		20,		2000 },
+	{ task_network,		20,		2000 },
+	{ task_reset,		100,	100 },
+	{ task_stats,		1000,	100 },
+	{ task_serial,		100,	5000 },
+};
+#define TASKS (sizeof tasks / sizeof tasks[0])
+
+// the radio, Ethernet and the switcher connection start up side by side: the radio takes a while
+// to get out of its power-up reset, loop() finishes it while the switcher sends its state
 void setup()
 {
-	// initialize the RF12 radio; set the Node # to 20
-	RF12Mod_initialize(20, RF12Mod_915MHZ, 4);
+	// start the RF12 radio; set the Node # to 20
+	RF12Mod_initStart(TALLY_TRANSMITTER_NODE, RF12Mod_915MHZ, 4);
 
 	// initialize the ATEMTally object
 	ATEMTally.initialize();
@@ -48,57 +136,297 @@ void setup()
 	
 	// setup the Ethernet
 	ATEMTally.setup_ethernet(mac, ip, switcher_ip, switcher_port);
+	boot_ethernet_time = millis();
+	
+	// initialize the AtemSwitcher
+	AtemSwitcher.begin(IPAddress(switcher_ip[0], switcher_ip[1], switcher_ip[2], switcher_ip[3]), switcher_port);    
 	
+	// acknowledge every packet of the initial state dump, so nothing of it gets lost; this opens the
+	// switcher socket with 4 KB of receive memory, so it comes before the server (and DHCP) sockets
+	AtemSwitcher.bootDumpMode(true);
+
 	// start the server
 	server.begin();
 
-	delay(1000);
+	// the serial port reports the loop timing, see task_serial()
+	Serial.begin(115200);
+
+	// answer a burst of packets with a single ACK
+	AtemSwitcher.ackCoalescing(true);
+
+	// only read from the Ethernet chip when a packet has arrived, sleep otherwise
+	AtemSwitcher.eventDriven(true);
+
+	// attempt to connect to the switcher right away, without waiting for the radio
+	AtemSwitcher.connect();
 }
 
 void loop()
 {
-	// run this code only once
-	if (!ranOnce) {
-		// initialize the AtemSwitcher
-		AtemSwitcher.begin(IPAddress(switcher_ip[0], switcher_ip[1], switcher_ip[2], switcher_ip[3]), switcher_port);    
-		
-		// attempt to connect to the switcher
-		AtemSwitcher.connect();
-
-		// change LED to RED
-		ATEMTally.change_LED_state(2);
-		
-		ranOnce = true;
-	}
-    
-	// display the setup page if requested
-  	EthernetClient client = server.available();
-  	ATEMTally.print_html(client, mac, ip, switcher_ip, switcher_port);
-  
-	// AtemSwitcher function for retrieving the program and preview camera numbers
+	// serve the switcher first: a packet read now goes out on the radio in the same pass
+	STAGE_BEGIN(STAGE_RUNLOOP);
   	AtemSwitcher.runLoop();
-  
+	STAGE_END(STAGE_RUNLOOP);
+
+	// finish setting up the radio once it is out of its power-up reset, even during the state dump
+	if (!radio_ready && RF12Mod_initDone()) {
+		radio_ready = true;
+		boot_radio_time = millis();
+	}
+
+	// while the switcher sends its initial state, do nothing but read it
+	if (AtemSwitcher.isReceivingBootDump())  {
+		return;
+	}
+
   	// if connection is gone anyway, try to reconnect
   	if (AtemSwitcher.isConnectionTimedOut())  {
     	AtemSwitcher.connect();
-  	} else {
-		// assign the program and preview numbers to the payload structure
-	    payload.program = AtemSwitcher.getProgramInput();
-	    payload.preview = AtemSwitcher.getPreviewInput();
-        
-		// when radio is available, transmit the structure with program and preview numbers
-	    RF12Mod_recvDone();
-	    if (RF12Mod_canSend()) {
-	    	RF12Mod_sendStart(0, &payload, sizeof payload);
-	      	ATEMTally.change_LED_state(3);      
-	    }    
   	}
-    
-	// a delay is needed due to some weird issue
-  	delay(10);
 
-  	ATEMTally.change_LED_state(1);
+	// run the tasks which are due, measuring them against their budget
+	for (byte i = 0; i < TASKS; i++) {
+		if (tasks[i].period == 0 || tasks[i].timer.poll(tasks[i].period)) {
+			unsigned long task_start = micros();
+			tasks[i].run();
+			unsigned long task_time = micros() - task_start;
+			if (task_time > tasks[i].max_time) {
+				tasks[i].max_time = task_time > 0xFFFF ? 0xFFFF : task_time;
+			}
+			if (task_time > tasks[i].budget) {
+				tasks[i].overruns++;
+			}
+		}
+	}
+
+	// sleep until the next interrupt if nothing arrived from the switcher
+	AtemSwitcher.idle();
+}
+
+// sends the tally frame on a change, its repeats and the heartbeat
+void task_radio()
+{
+	if (!radio_ready) {
+		return;
+	}
+
+	// the radio driver needs polling to get ready for sending; it also brings the echoes
+	if (RF12Mod_recvDone() && RF12Mod_crc == 0) {
+		receive_echo();
+	}
+
+	// only loop() asks isConnectionTimedOut(): it reports a timeout once, and loop() reconnects on it
+	if (!AtemSwitcher.isConnected()) {
+		return;
+	}
+
+	if (boot_switcher_time == 0 && AtemSwitcher.hasInitialized()) {
+		boot_switcher_time = millis();
+	}
+
+	// collect the tally of all inputs (keyers and DSKs included); the preview
+	// source counts as on air as soon as a transition starts
+	for (uint8_t i = 1; i <= TALLY_FRAME_INPUTS; i++) {
+		tally_frame.setTally(i,
+			(AtemSwitcher.getProgramTally(i) || AtemSwitcher.isOnAir(i) ? TALLY_PROGRAM : 0) |
+			(AtemSwitcher.getPreviewTally(i) ? TALLY_PREVIEW : 0));
+	}
+
+	// a changed state goes out right away as a delta frame and is repeated a few times
+	if (tally_frame.update()) {
+		radio_delta_pending = true;
+		radio_repeats_left = RADIO_REPEATS;
+		tally_change_time = AtemSwitcher.getLastChangeTime();
+	}
+
+	// repeats and heartbeats hold back while the echo of a new state is due
+	latency_probe_timer.poll();
+
+	// when radio is available, transmit the tally frame;
+	// an unchanged state is only sent as a heartbeat
+	if ((radio_delta_pending || (latency_probe_timer.idle() && (radio_repeats_left > 0 || millis() - radio_last_send >= RADIO_HEARTBEAT))) && RF12Mod_canSend()) {
+		unsigned long age = micros() - tally_change_time;
+		if (radio_delta_pending) {
+			radio_delta_pending = false;
+			tally_frame.stamp(age, LATENCY_PROBE_NODE);
+			if (LATENCY_PROBE_NODE != 0) {
+				if (latency_probe_waiting) {
+					latency_probes_lost++;
+				}
+				latency_probe_waiting = true;
+				latency_probe_sequence = tally_frame.sequence();
+				latency_probe_sent = micros();
+				latency_probe_age = age;
+				latency_probe_timer.set(LATENCY_PROBE_WAIT);
+			}
+		} else {
+			tally_frame.buildFull();
+			tally_frame.stamp(age, 0);
+			if (radio_repeats_left > 0) {
+				radio_repeats_left--;
+			}
+		}
+		STAGE_BEGIN(STAGE_RADIO_SEND);
+		RF12Mod_sendStart(0, tally_frame.frame, tally_frame.length);
+		STAGE_END(STAGE_RADIO_SEND);
+		radio_last_send = millis();
+		radio_frames_sent++;
+
+		// the first frame with the switcher's state completes the boot
+		if (boot_tally_time == 0 && AtemSwitcher.hasInitialized()) {
+			boot_tally_time = radio_last_send;
+			print_boot(Serial);
+		}
+
+		// blink the LED
+		ATEMTally.change_LED_state(3);
+		led_blink_timer.set(LED_BLINK_TIME);
+	}
+}
+
+// takes the echo of the latency probe: the switcher to LED latency is the age of the
+// frame when sent, plus half the round trip over the radio, plus the receiver's own time
+void receive_echo()
+{
+	if (!latency_probe_waiting || !TallyFrameEncoder::isEcho(RF12Mod_data, RF12Mod_len, latency_probe_sequence)) {
+		return;
+	}
 
-	// monitors for the reset button press
+	unsigned long round_trip = micros() - latency_probe_sent;
+	latency_probe_waiting = false;
+	latency_probe_timer.set(0);
+#if STAGE_TIMER
+	StageTimers.record(STAGE_TALLY_LATENCY, TallyFrameEncoder::echoLatency(RF12Mod_data, latency_probe_age, round_trip));
+#endif
+}
+
+// turns the LED back when the blink for a radio frame is over
+void task_led()
+{
+	if (led_blink_timer.poll()) {
+		ATEMTally.change_LED_state(1);
+	}
+}
+
+// displays the setup page if requested, a piece at a time
+void task_http()
+{
+	STAGE_BEGIN(STAGE_HTTP);
+	if (ATEMTally.serve_http(server, mac, ip, switcher_ip, switcher_port, print_status)) {
+		STAGE_END(STAGE_HTTP);
+	}
+}
+
+// keeps the DHCP lease (if the IP is set to 0.0.0.0), a step at a time
+void task_network()
+{
+	ATEMTally.maintain_ethernet();
+}
+
+// monitors for the reset button press
+void task_reset()
+{
+	STAGE_BEGIN(STAGE_RESET);
   	ATEMTally.monitor_reset();
-}
\ No newline at end of file
+	STAGE_END(STAGE_RESET);
+}
+
+// counts the radio frames and switcher packets per second
+void task_stats()
+{
+	radio_frames_per_second = radio_frames_sent - radio_frames_second_count;
+	radio_frames_second_count = radio_frames_sent;
+
+	atem_packets_per_second = AtemSwitcher.getPacketsReceived() - atem_packets_second_count;
+	atem_packets_second_count = AtemSwitcher.getPacketsReceived();
+	atem_answers_per_second = AtemSwitcher.getAnswerPacketsSent() - atem_answers_second_count;
+	atem_answers_second_count = AtemSwitcher.getAnswerPacketsSent();
+}
+
+// answers the serial port: 't' prints the loop timing, 'r' resets it
+void task_serial()
+{
+	while (Serial.available()) {
+		char c = Serial.read();
+		if (c == 't') {
+			print_status(Serial);
+		}
+#if STAGE_TIMER
+		if (c == 'r') {
+			StageTimers.reset();
+		}
+#endif
+	}
+}
+
+// prints the status: the switcher connection, the radio and the loop timing; one record
+// per line, a name and key=value pairs, so monitoring can scrape it from /status. At most
+// 1518 bytes, which HTTP_STATUS_SPACE (ATEMTally.cpp) leaves room for: keep it in step
+void print_status(Print& out)
+{
+	out.print(F("switcher connected="));
+	out.print(AtemSwitcher.isConnected());
+	out.print(F(" initialized="));
+	out.print(AtemSwitcher.hasInitialized());
+	out.print(F(" session="));
+	out.print(AtemSwitcher.getSessionID());
+	out.print(F(" last_packet="));
+	out.print(AtemSwitcher.getATEM_lastRemotePacketId());
+	out.print(F(" packets/s="));
+	out.print(atem_packets_per_second);
+	out.print(F(" acks/s="));
+	out.print(atem_answers_per_second);
+	out.print(F(" acks_saved="));
+	out.print(AtemSwitcher.getAnswerPacketsSaved());
+	out.print(F(" errors="));
+	out.println(AtemSwitcher.getPacketErrors());
+
+	out.print(F("network ip="));
+	out.print(Ethernet.localIP());
+	out.print(F(" gateway="));
+	out.print(Ethernet.gatewayIP());
+	out.print(F(" dhcp="));
+	out.println(!(ip[0] | ip[1] | ip[2] | ip[3]));
+
+	out.print(F("radio frames="));
+	out.print(radio_frames_sent);
+	out.print(F(" frames/s="));
+	out.print(radio_frames_per_second);
+	out.print(F(" busy="));
+	out.print(RF12Mod_busyCount);
+	out.print(F(" backoff="));
+	out.print(RF12Mod_backoffCount);
+	out.print(F(" probes_lost="));
+	out.println(latency_probes_lost);
+
+	print_boot(out);
+
+	out.print(F("loop runs="));
+	out.print(AtemSwitcher.getRunLoops());
+	out.print(F(" idle="));
+	out.println(AtemSwitcher.getIdleRunLoops());
+#if STAGE_TIMER
+	StageTimers.print(out);
+#endif
+	for (byte i = 0; i < TASKS; i++) {
+		out.print(F("task id="));
+		out.print(i);
+		out.print(F(" max="));
+		out.print(tasks[i].max_time);
+		out.print(F(" overruns="));
+		out.println(tasks[i].overruns);
+	}
+}
+
+// prints the boot milestones, in ms since reset; the time the bootloader takes before is not counted
+void print_boot(Print& out)
+{
+	out.print(F("boot ethernet="));
+	out.print(boot_ethernet_time);
+	out.print(F(" radio="));
+	out.print(boot_radio_time);
+	out.print(F(" switcher="));
+	out.print(boot_switcher_time);
+	out.print(F(" first_tally="));
+	out.println(boot_tally_time);
+}
@@ -25,6 +25,11 @@ with the ATEM library. If not, see http://www.gnu.org/licenses/.
 #endif
 
 #include "ATEM.h"
+#include "StageTimer.h"
+#include <utility/w5100.h>
+#ifndef __arm__
+	#include <avr/sleep.h>
+#endif
 
 //#include <MemoryFree.h>
 
@@ -50,9 +55,35 @@ void ATEM::begin(const IPAddress ip, const uint16_t localPort){
 	_localPort = localPort;	// Set local port (just a random number I picked)
 	
 	_serialOutput = false;
+	_bootDumpMode = false;
+	_ackCoalescing = false;
+	_answerPacketsSaved = 0;
+	_packetsReceived = 0;
+	_answerPacketsSent = 0;
+	_packetErrors = 0;
+	_eventDriven = false;
+	_runLoops = 0;
+	_idleRunLoops = 0;
+	_runLoopIdle = false;
+	_idleTime = 0;
 	_isConnectingTime = 0;
+	_changes = 0;
+	_packetTime = 0;
+	_lastChangeTime = 0;
+	_callbackChanges = 0;
+	_changeCallback = NULL;
+	_commandQueueLength = 0;
+	_commandSRTT = 0;
+	_commandRTTSampled = false;
+	_commandRTTVar = 0;
+	_commandRTO = ATEM_initialRTO;
+	_commandRetransmissions = 0;
+	_commandPacketsLost = 0;
 	
 	_ATEM_AMLv_channel=0;
+	_ATEM_ver_m = 0;
+	_ATEM_ver_l = 0;
+	_setProtocolVersion();
 }
 
 /**
@@ -61,9 +92,21 @@ void ATEM::begin(const IPAddress ip, const uint16_t localPort){
 void ATEM::connect() {
 	_isConnectingTime = millis();
 	_localPacketIdCounter = 1;	// Init localPacketIDCounter to 1;
+	_commandQueueLength = 0;	// Commands for the previous session are dropped
+	for (uint8_t i=0; i<ATEM_maxOutstandingPackets; i++)	{
+		_outstanding[i].length = 0;
+	}
 	_hasInitialized = false;
+	_isReceivingBootDump = false;
+	_bootDumpReceived = 0;
+	_bootDumpEndPacketID = 0;
+	_bootDumpMissingPackets = 0;
+	_lastAnsweredPacketID = 0;
+	_answerPending = false;
+	_firstCoalescedTime = 0;
+	_exactAnswers = false;
 	_lastContact = 0;
-	_Udp.begin(_localPort);
+	_Udp.begin(_localPort);	// Keeps the socket (and its RX memory) of an earlier connect() or bootDumpMode()
 
 		// Setting this, because even though we haven't had contact, it constitutes an attempt that should be responded to at least:
 	_lastContact = millis();
@@ -80,6 +123,113 @@ void ATEM::connect() {
 	_Udp.endPacket();   
 }
 
+/**
+ * Sends the commands queued since the last call as a single packet, so the switcher applies them together.
+ * runLoop() does this, so it is only needed if commands must go out before the next runLoop() call.
+ * The packet is kept until the switcher acknowledges it, see _retransmitCommandPackets()
+ * If ATEM_maxOutstandingPackets packets are still waiting for an acknowledge, the commands stay queued and go out
+ * with a later call, once a slot is free. Returns true if the queue was sent (or is empty).
+ */
+bool ATEM::flushCommands()	{
+	if (_commandQueueLength == 0)	{
+		return true;
+	}
+
+	// Find a free slot; packets in flight are never given up to make room:
+	uint8_t slot = ATEM_maxOutstandingPackets;
+	for (uint8_t i=0; i<ATEM_maxOutstandingPackets; i++)	{
+		if (_outstanding[i].length == 0)	{
+			slot = i;
+			break;
+		}
+	}
+	if (slot == ATEM_maxOutstandingPackets)	{
+		return false;
+	}
+
+	_outstanding[slot].packetID = _localPacketIdCounter;
+	_outstanding[slot].retransmissions = 0;
+	_outstanding[slot].length = _commandQueueLength;
+	memcpy(_outstanding[slot].data, _commandQueue, _commandQueueLength);
+	_sendCommandPacketSlot(slot);
+
+	_localPacketIdCounter++;
+	_commandQueueLength = 0;
+	return true;
+}
+
+/**
+ * Sends (or resends) an outstanding command packet
+ */
+void ATEM::_sendCommandPacketSlot(uint8_t slot)	{
+	uint8_t headerBuffer[12];
+	memset(headerBuffer, 0, 12);
+	headerBuffer[2] = 0x80;  // ??? API
+	headerBuffer[3] = _sessionID;  // Session ID
+	headerBuffer[10] = _outstanding[slot].packetID/256;  // Remote Packet ID, MSB
+	headerBuffer[11] = _outstanding[slot].packetID%256;  // Remote Packet ID, LSB
+
+	// Create header:
+	uint16_t returnPacketLength = 12+_outstanding[slot].length;
+	headerBuffer[0] = returnPacketLength/256;
+	headerBuffer[1] = returnPacketLength%256;
+	headerBuffer[0] |= B00001000;
+	if (_outstanding[slot].retransmissions > 0)	{
+		headerBuffer[0] |= B00100000;	// "This is a retransmission"
+	}
+
+	_Udp.beginPacket(_switcherIP,  9910);
+	_Udp.write(headerBuffer,12);
+	_Udp.write(_outstanding[slot].data,_outstanding[slot].length);
+	_Udp.endPacket();  
+
+	_outstanding[slot].sentTime = millis();
+}
+
+/**
+ * Clears the outstanding command packets acknowledged by the switcher (the ACK covers all packets up to the ID).
+ * The round trip time of packets sent only once updates the retransmission timeout (Karn's algorithm, RFC 6298 smoothing)
+ */
+void ATEM::_ackCommandPackets(uint16_t localPacketID)	{
+	for (uint8_t i=0; i<ATEM_maxOutstandingPackets; i++)	{
+		if (_outstanding[i].length != 0 && (int16_t)(localPacketID - _outstanding[i].packetID) >= 0)	{
+			if (_outstanding[i].packetID == localPacketID && _outstanding[i].retransmissions == 0)	{
+				uint16_t rtt = min((unsigned long)millis() - _outstanding[i].sentTime, (unsigned long)ATEM_maxRTO);
+				if (!_commandRTTSampled)	{
+					_commandSRTT = rtt;
+					_commandRTTVar = rtt/2;
+					_commandRTTSampled = true;
+				} else {
+					_commandRTTVar = (3*_commandRTTVar + abs((int)_commandSRTT - (int)rtt))/4;
+					_commandSRTT = (7*_commandSRTT + rtt)/8;
+				}
+				_commandRTO = constrain(_commandSRTT + max(1, 4*_commandRTTVar), ATEM_minRTO, ATEM_maxRTO);
+			}
+			_outstanding[i].length = 0;
+		}
+	}
+}
+
+/**
+ * Resends command packets which were not acknowledged within the retransmission timeout, doubling it for every retry.
+ * After ATEM_maxRetransmissions they are given up.
+ */
+void ATEM::_retransmitCommandPackets()	{
+	for (uint8_t i=0; i<ATEM_maxOutstandingPackets; i++)	{
+		if (_outstanding[i].length != 0 && (unsigned long)millis() - _outstanding[i].sentTime >= ((unsigned long)_commandRTO << _outstanding[i].retransmissions))	{
+			if (_outstanding[i].retransmissions >= ATEM_maxRetransmissions)	{
+				_outstanding[i].length = 0;
+				_commandPacketsLost++;
+				if (_serialOutput) Serial.println(F("Command packet lost"));
+			} else {
+				_outstanding[i].retransmissions++;
+				_commandRetransmissions++;
+				_sendCommandPacketSlot(i);
+			}
+		}
+	}
+}
+
 /**
  * Keeps connection to the switcher alive - basically, this means answering back to ping packages.
  * Therefore: Call this in the Arduino loop() function and make sure it gets call at least 2 times a second
@@ -104,6 +254,8 @@ void ATEM::runLoop() {
 
 	uint16_t packetSize = 0;
 
+	_runLoops++;
+	flushCommands();
 
 	if (_isConnectingTime > 0)	{
 
@@ -121,6 +273,7 @@ void ATEM::runLoop() {
 				// the ethernet interface on Arduino actually misses the first two for some reason!
 			_Udp.read(_packetBuffer,20);
 			_sessionID = _packetBuffer[15];
+			_prepareAnswerPacket();
 
 			// Send connectAnswerString to ATEM:
 			_Udp.beginPacket(_switcherIP,  9910);
@@ -132,6 +285,7 @@ void ATEM::runLoop() {
 			_Udp.endPacket();
 
 			_isConnectingTime = 0;	// End connecting
+			_isReceivingBootDump = true;
 		} else {
 			if (_isConnectingTime+2000 < (unsigned long)millis())	{
 				if (_serialOutput) 	{
@@ -146,8 +300,15 @@ void ATEM::runLoop() {
 
 
 	  // If there's data available, read a packet, empty up:
+	  // In event driven mode a single interrupt register read tells if anything has arrived since the buffer was emptied last.
 	 // Serial.println("ATEM runLoop():");
-	  while(true) {	// Iterate until buffer is empty:
+	  boolean hasData = !_eventDriven || _Udp.received();
+	  _runLoopIdle = !hasData;
+	  if (!hasData)	{
+	  	_idleRunLoops++;
+	  }
+	  while(hasData) {	// Iterate until buffer is empty:
+	  	  unsigned long spiTransactionsStart = W5100.spiTransactions;
 	  	  packetSize = _Udp.parsePacket();
 		  if (_Udp.available() && packetSize !=0)   {  
 		//	Serial.print("New Packet");
@@ -173,17 +334,40 @@ void ATEM::runLoop() {
 
 		    if (packetSize==packetLength) {  // Just to make sure these are equal, they should be!
 			  _lastContact = millis();
+			  _packetTime = micros();
+			  _packetsReceived++;
+			  boolean alreadyReceived = false;
+
+			  if (command & B10000000)	{	// A response: Acknowledges our command packets up to the local packet ID in byte 4-5
+			  	_ackCommandPackets(word(_packetBuffer[4], _packetBuffer[5]));
+			  }
 		
 		      // If a packet is 12 bytes long it indicates that all the initial information 
 		      // has been delivered from the ATEM and we can begin to answer back on every request
 			  // Currently we don't know any other way to decide if an answer should be sent back...
-		      if(!_hasInitialized && packetSize == 12) {
-		        _hasInitialized = true;
-				if (_serialOutput) Serial.println(F("_hasInitialized=TRUE"));
-		      } 
+		      if (!_hasInitialized)	{
+		      	if (!_bootDumpMode)	{
+		      		_hasInitialized = packetSize == 12;
+		      	} else {
+		      		alreadyReceived = _trackBootDumpPacket(_lastRemotePacketID);
+		      		if (packetSize == 12 && _bootDumpEndPacketID == 0)	{
+		      			_bootDumpEndPacketID = _lastRemotePacketID;
+		      			_bootDumpEndTime = _lastContact;
+		      		}
+		      		_hasInitialized = _bootDumpEndPacketID > 0 && _isBootDumpComplete();
+		      	}
+		      	if (_hasInitialized)	{
+		      		_isReceivingBootDump = false;
+					if (_serialOutput) Serial.println(F("_hasInitialized=TRUE"));
+		      	}
+		      } else if (_bootDumpMode && (command & B00100000) && _bootDumpGaps())	{
+		      	alreadyReceived = _trackBootDumpPacket(_lastRemotePacketID);	// A late retransmission closing a gap left by the timeout
+		      }
 	
-				if (packetLength > 12 && !command_INIT)	{	// !command_INIT is because there seems to be no commands in these packets and that will generate an error.
+				if (packetLength > 12 && !command_INIT && !alreadyReceived)	{	// !command_INIT is because there seems to be no commands in these packets and that will generate an error.
+					STAGE_BEGIN(STAGE_PARSE_PACKET);
 					_parsePacket(packetLength);
+					STAGE_END(STAGE_PARSE_PACKET);
 				}
 
 		      // If we are initialized, lets answer back no matter what:
@@ -194,15 +378,37 @@ void ATEM::runLoop() {
 				// the UDP library so that we might never get initialized - and thus never get connected
 				// So... for now this is how we do it:
 				// CHANGED with arduino 1.0.1..... put back in.
-		      if (_hasInitialized && command_ACK) {
+				// In boot dump mode the initial state packets are acknowledged one by one as well: The switcher
+				// retransmits the ones we never acknowledged, which fills the gaps left by a full RX buffer.
+		      if ((_hasInitialized || _bootDumpMode) && command_ACK) {
 		        if (_serialOutput) {
 					Serial.print(F("ACK, rpID: "));
 		        	Serial.println(_lastRemotePacketID, DEC);
 				}
 
-		        _sendAnswerPacket(_lastRemotePacketID);
+				// A retransmission of a packet we only answered through a coalesced answer means that the switcher
+				// wants an answer for every packet ID: Coalescing is then off for the rest of the session.
+				// Until the first coalesced answer has gone a second without that, only one answer is coalesced away.
+		        if (_firstCoalescedTime>0 && (command & B00100000) && ((_lastAnsweredPacketID - _lastRemotePacketID) & 0x7FFF) < 0x4000)	{
+		        	_exactAnswers = true;
+		        }
+		        boolean coalescingTested = _firstCoalescedTime==0 || (unsigned long)millis() - _firstCoalescedTime > 1000;
+
+				// Not while the initial state dump is coming in or has gaps: Each of those packets is answered by
+				// itself, so the switcher retransmits exactly the ones which are missing.
+		        if (_ackCoalescing && !_exactAnswers && coalescingTested && !_isReceivingBootDump && !(_bootDumpMode && _bootDumpGaps()))	{
+		        	_coalesceAnswerPacket(_lastRemotePacketID);
+		        } else {
+		        	_flushAnswerPacket();
+		        	_sendAnswerPacket(_lastRemotePacketID);
+		        }
 		      }
 
+				// Tell about changes after the ACK is out:
+			  if (!_answerPending)	{
+			  	_notifyChanges();
+			  }
+
 		    } else {
 				if (_serialOutput) 	{
 		  /*    		Serial.print(("ERROR: Packet size mismatch: "));
@@ -210,17 +416,93 @@ void ATEM::runLoop() {
 				    Serial.print(" != ");
 				    Serial.println(packetLength, DEC);
 			*/	}
-				// Flushing the buffer:
-				// TODO: Other way? _Udp.flush() ??
-		          while(_Udp.available()) {
-		              _Udp.read(_packetBuffer, 96);
-		          }
+				// Flushing the buffer (steps over the rest of the packet in the W5100 RX memory):
+		        _Udp.flush();
+		        _packetErrors++;
 		    }
+		    _spiTransactionsPerPacket = W5100.spiTransactions - spiTransactionsStart;
 		  } else {
 			break;	// Exit while(true) loop because there is no more packets in buffer.
 		}
 	  }
+
+	  _flushAnswerPacket();
+	  _notifyChanges();
+
+	  _retransmitCommandPackets();
+	}
+}
+
+/**
+ * Passes the changes not yet reported to the onChange() callback.
+ * Changes during the boot dump are handed over together once it is done.
+ */
+void ATEM::_notifyChanges()	{
+	if (_hasInitialized && _callbackChanges && _changeCallback != NULL)	{
+		uint16_t changes = _callbackChanges;
+		_callbackChanges = 0;
+		_changeCallback(changes);
+	}
+}
+
+/**
+ * Marks state values as changed by the switcher, see getChanges()
+ */
+void ATEM::_changed(uint16_t changes)	{
+	_changes |= changes;
+	_callbackChanges |= changes;
+	_lastChangeTime = _packetTime;
+}
+
+/**
+ * Boot dump mode: Registers a remote packet ID of the initial state dump.
+ * Returns true if the packet was received before (a retransmission of something we already have)
+ */
+bool ATEM::_trackBootDumpPacket(uint16_t remotePacketID)	{
+	if (remotePacketID>=1 && remotePacketID<=32)	{	// The dump is 10-20 kbytes, so it fits in the first 32 packets
+		uint32_t packetBit = 1UL << (remotePacketID-1);
+		if (_bootDumpReceived & packetBit)	{
+			return true;
+		}
+		_bootDumpReceived |= packetBit;
+	}
+	return false;
+}
+
+/**
+ * Boot dump mode: Returns true when every packet before the one that ended the initial state dump has arrived.
+ * Gives up waiting for retransmissions after 2 seconds.
+ */
+bool ATEM::_isBootDumpComplete()	{
+	uint32_t missing = _bootDumpGaps();
+
+	if (missing)	{
+		if (_bootDumpMissingPackets==0)	{	// Count the gaps once, for statistics
+			while (missing)	{
+				_bootDumpMissingPackets += missing & 1;
+				missing >>= 1;
+			}
+			if (_serialOutput)	{
+				Serial.print(F("Boot dump gaps: "));
+				Serial.println(_bootDumpMissingPackets, DEC);
+			}
+		}
+		return (unsigned long)millis() - _bootDumpEndTime > 2000;
+	}
+	return true;
+}
+
+/**
+ * Boot dump mode: Returns a bit for each packet before the end of the initial state dump which has not arrived (bit n
+ * for remote packet ID n+1). Once the session is half way to the packet IDs wrapping around, the switcher has long
+ * given up on them, and 0 is returned, so that IDs 1-32 of the next round are not taken for boot dump packets.
+ */
+uint32_t ATEM::_bootDumpGaps()	{
+	if (_bootDumpEndPacketID==0 || _lastAnsweredPacketID >= 0x4000)	{
+		return 0;
 	}
+	uint32_t expected = _bootDumpEndPacketID>32 ? 0xFFFFFFFF : (1UL << (_bootDumpEndPacketID-1)) - 1;
+	return expected & ~_bootDumpReceived;
 }
 
 bool ATEM::isConnectionTimedOut()	{
@@ -232,13 +514,41 @@ bool ATEM::isConnectionTimedOut()	{
 	return false;
 }
 
+/**
+ * Returns true if the switcher has been heard from within the timeout of isConnectionTimedOut(), or a connect() is
+ * under way. Unlike isConnectionTimedOut(), which reports a timeout only once so the caller can connect() again,
+ * it changes nothing and can be asked anywhere.
+ */
+bool ATEM::isConnected() const	{
+	return _lastContact>0 && (unsigned long)millis() - _lastContact <= 10000;
+}
+
 void ATEM::delay(const unsigned int delayTimeMillis)	{	// Responsible delay function which keeps the ATEM run loop up! DO NOT USE INSIDE THIS CLASS! Recursion could happen...
-	unsigned long timeout = millis();
-	timeout+=delayTimeMillis;
+	unsigned long start = millis();
 
-	while(timeout > millis())	{
+	while((unsigned long)millis() - start < delayTimeMillis)	{
 		runLoop();
+		idle();
+	}
+}
+
+/**
+ * In event driven mode: If the last runLoop() found nothing to read, puts the MCU in idle sleep until the next interrupt.
+ * The timer 0 interrupt (millis) fires every 1.024 ms, so a packet waits at most that long.
+ * Timers, SPI, UART and the radio keep running in idle sleep. Does nothing on non-AVR targets.
+ */
+void ATEM::idle()	{
+	if (!_runLoopIdle)	{
+		return;
 	}
+	_runLoopIdle = false;
+
+#ifndef __arm__
+	unsigned long idleStart = micros();
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_mode();
+	_idleTime += micros() - idleStart;
+#endif
 }
 
 /**
@@ -284,49 +594,70 @@ void ATEM::_parsePacket(uint16_t packetLength)	{
         _cmdLength = word(_packetBuffer[0], _packetBuffer[1]);
 		_cmdPointer = 0;
         
-			// Get the "command string", basically this is the 4 char variable name in the ATEM memory holding the various state values of the system:
-        char cmdStr[] = { 
-          _packetBuffer[4], _packetBuffer[5], _packetBuffer[6], _packetBuffer[7], '\0'};
+			// Get the "command string", basically this is the 4 char variable name in the ATEM memory holding the various state values of the system.
+			// It is packed into a 32 bit "fourcc" so the switch() below compiles into a sorted compare tree instead of a strcmp() chain:
+        uint32_t cmd = ATEM_FOURCC(_packetBuffer[4], _packetBuffer[5], _packetBuffer[6], _packetBuffer[7]);
 
 			// If length of segment larger than 8 (should always be...!)
         if (_cmdLength>8)  {
-			if(strcmp(cmdStr, "AMLv"))	{
+			if(cmd != ATEM_FOURCC('A','M','L','v'))	{
 			  _readToPacketBuffer();	// Fill packet buffer unless it's AMLv (AudioMonitorLevels)
 			}
 
           // Extract the specific state information we like to know about:
-          if(strcmp(cmdStr, "PrgI") == 0) {  // Program Bus status
-			if (!ver42())	{
-				_ATEM_PrgI = _packetBuffer[1];
-			} else {
-				_ATEM_PrgI = (uint16_t)(_packetBuffer[2]<<8) | _packetBuffer[3];
+          switch (cmd) {
+          case ATEM_FOURCC('P','r','g','I'): {  // Program Bus status
+			idx = _packetBuffer[0];	// M/E
+			if (idx < ATEM_maxME)	{
+				uint16_t prgI = _readInputField();
+				if (_ATEM_PrgI[idx] != prgI)	{
+					_ATEM_PrgI[idx] = prgI;
+					_changed(ATEM_CHANGED_PROGRAM);
+				}
+	            if (_serialOutput) Serial.print(F("Program Bus: "));
+	            if (_serialOutput) Serial.println(_ATEM_PrgI[idx], DEC);
 			}
-            if (_serialOutput) Serial.print(F("Program Bus: "));
-            if (_serialOutput) Serial.println(_ATEM_PrgI, DEC);
-          } else
-          if(strcmp(cmdStr, "PrvI") == 0) {  // Preview Bus status
-			if (!ver42())	{
-				_ATEM_PrvI = _packetBuffer[1];
-			} else {
-				_ATEM_PrvI = (uint16_t)(_packetBuffer[2]<<8) | _packetBuffer[3];
+          } break;
+          case ATEM_FOURCC('P','r','v','I'): {  // Preview Bus status
+			idx = _packetBuffer[0];	// M/E
+			if (idx < ATEM_maxME)	{
+				uint16_t prvI = _readInputField();
+				if (_ATEM_PrvI[idx] != prvI)	{
+					_ATEM_PrvI[idx] = prvI;
+					_changed(ATEM_CHANGED_PREVIEW);
+				}
+	            if (_serialOutput) Serial.print(F("Preview Bus: "));
+	            if (_serialOutput) Serial.println(_ATEM_PrvI[idx], DEC);
 			}
-            if (_serialOutput) Serial.print(F("Preview Bus: "));
-            if (_serialOutput) Serial.println(_ATEM_PrvI, DEC);
-          } else
-          if(strcmp(cmdStr, "TlIn") == 0) {  // Tally status for inputs 1-8
-            uint8_t count = _packetBuffer[1]; // Number of inputs
-              // 16 inputs supported so make sure to read max 16.
-            if(count > 16) {
-              count = 16;
+          } break;
+          case ATEM_FOURCC('T','l','I','n'): {  // Tally status for inputs
+            uint16_t count = word(_packetBuffer[0], _packetBuffer[1]); // Number of inputs
+              // ATEM_maxInputs supported so make sure to read max ATEM_maxInputs.
+            if(count > ATEM_maxInputs) {
+              count = ATEM_maxInputs;
             }
-            	// Inputs 1-16, bit 0 = Prg tally, bit 1 = Prv tally. Both can be set simultaneously.
+            	// One byte per input, bit 0 = Prg tally, bit 1 = Prv tally. Both can be set simultaneously.
+            	// Packed into the program and preview bit planes 8 inputs at a time, so changes are found by comparing whole bytes:
             if (_serialOutput) Serial.println(F("Tally updated: "));
-            for(uint8_t i = 0; i < count; ++i) {
-              _ATEM_TlIn[i] = _packetBuffer[2+i];
+            for(uint8_t b = 0; b < ATEM_tallyBytes; ++b) {
+              uint8_t program = 0;
+              uint8_t preview = 0;
+              for(uint8_t bit = 0; bit < 8 && b*8+bit < count; ++bit) {
+                uint8_t tally = _packetBuffer[2+b*8+bit];
+                program |= (tally & 1) << bit;
+                preview |= ((tally >> 1) & 1) << bit;
+              }
+              uint8_t changed = (program ^ _ATEM_TlIn_program[b]) | (preview ^ _ATEM_TlIn_preview[b]);
+              if (changed)	{
+                _ATEM_TlIn_program[b] = program;
+                _ATEM_TlIn_preview[b] = preview;
+                _ATEM_TlIn_changed[b] |= changed;
+                _changed(ATEM_CHANGED_TALLY);
+              }
             }
 
-          } else 
-          if(strcmp(cmdStr, "Time") == 0) {  // Time. What is this anyway?
+          } break;
+          case ATEM_FOURCC('T','i','m','e'): {  // Time. What is this anyway?
 		/*	Serial.print(_packetBuffer[0]);
 			Serial.print(':');
 			Serial.print(_packetBuffer[1]);
@@ -335,87 +666,126 @@ void ATEM::_parsePacket(uint16_t packetLength)	{
 			Serial.print(':');
 			Serial.print(_packetBuffer[3]);
 			Serial.println();
-	      */} else 
-	      if(strcmp(cmdStr, "TrPr") == 0) {  // Transition Preview
-			_ATEM_TrPr = _packetBuffer[1] > 0 ? true : false;
-            if (_serialOutput) Serial.print(F("Transition Preview: "));
-            if (_serialOutput) Serial.println(_ATEM_TrPr, BIN);
-          } else
-	      if(strcmp(cmdStr, "TrPs") == 0) {  // Transition Position
-			_ATEM_TrPs_frameCount = _packetBuffer[2];	// Frames count down
-			_ATEM_TrPs_position = _packetBuffer[4]*256 + _packetBuffer[5];	// Position 0-1000 - maybe more in later firmwares?
-          } else
-	      if(strcmp(cmdStr, "TrSS") == 0) {  // Transition Style and Keyer on next transition
-			_ATEM_TrSS_KeyersOnNextTransition = _packetBuffer[2] & B11111;	// Bit 0: Background; Bit 1-4: Key 1-4
-            if (_serialOutput) Serial.print(F("Keyers on Next Transition: "));
-            if (_serialOutput) Serial.println(_ATEM_TrSS_KeyersOnNextTransition, BIN);
-
-			_ATEM_TrSS_TransitionStyle = _packetBuffer[1];
-            if (_serialOutput) Serial.print(F("Transition Style: "));	// 0=MIX, 1=DIP, 2=WIPE, 3=DVE, 4=STING
-            if (_serialOutput) Serial.println(_ATEM_TrSS_TransitionStyle, DEC);
-          } else
-	      if(strcmp(cmdStr, "FtbS") == 0) {  // Fade To Black State
+	      */} break;
+	      case ATEM_FOURCC('T','r','P','r'): {  // Transition Preview
+			idx = _packetBuffer[0];	// M/E
+			if (idx < ATEM_maxME)	{
+				boolean trPr = _packetBuffer[1] > 0 ? true : false;
+				if (_ATEM_TrPr[idx] != trPr)	{
+					_ATEM_TrPr[idx] = trPr;
+					_changed(ATEM_CHANGED_TRANSITION);
+				}
+	            if (_serialOutput) Serial.print(F("Transition Preview: "));
+	            if (_serialOutput) Serial.println(_ATEM_TrPr[idx], BIN);
+			}
+          } break;
+	      case ATEM_FOURCC('T','r','P','s'): {  // Transition Position
+			idx = _packetBuffer[0];	// M/E
+			if (idx < ATEM_maxME)	{
+				uint16_t position = _packetBuffer[4]*256 + _packetBuffer[5];
+				bool inTransition = _packetBuffer[1] & 0x01;
+				if (_ATEM_TrPs_inTransition[idx] != inTransition || _ATEM_TrPs_frameCount[idx] != _packetBuffer[2] || _ATEM_TrPs_position[idx] != position)	{
+					_ATEM_TrPs_inTransition[idx] = inTransition;
+					_ATEM_TrPs_frameCount[idx] = _packetBuffer[2];	// Frames count down
+					_ATEM_TrPs_position[idx] = position;	// Position 0-10000, the scale changeTransitionPosition() sends in
+					_ATEM_TrPs_endTime[idx] = millis() + (unsigned long)_ATEM_TrPs_frameCount[idx] * _frameDuration() / 1000;
+					_changed(ATEM_CHANGED_TRANSITION);
+				}
+			}
+          } break;
+	      case ATEM_FOURCC('T','r','S','S'): {  // Transition Style and Keyer on next transition
+			idx = _packetBuffer[0];	// M/E
+			if (idx < ATEM_maxME)	{
+				if (_ATEM_TrSS_KeyersOnNextTransition[idx] != (_packetBuffer[2] & B11111) || _ATEM_TrSS_TransitionStyle[idx] != _packetBuffer[1])	{
+					_changed(ATEM_CHANGED_TRANSITION);
+				}
+				_ATEM_TrSS_KeyersOnNextTransition[idx] = _packetBuffer[2] & B11111;	// Bit 0: Background; Bit 1-4: Key 1-4
+	            if (_serialOutput) Serial.print(F("Keyers on Next Transition: "));
+	            if (_serialOutput) Serial.println(_ATEM_TrSS_KeyersOnNextTransition[idx], BIN);
+
+				_ATEM_TrSS_TransitionStyle[idx] = _packetBuffer[1];
+	            if (_serialOutput) Serial.print(F("Transition Style: "));	// 0=MIX, 1=DIP, 2=WIPE, 3=DVE, 4=STING
+	            if (_serialOutput) Serial.println(_ATEM_TrSS_TransitionStyle[idx], DEC);
+			}
+          } break;
+	      case ATEM_FOURCC('F','t','b','S'): {  // Fade To Black State
+			if (_ATEM_FtbS_state != (_packetBuffer[2] > 0) || _ATEM_FtbS_frameCount != _packetBuffer[3])	{
+				_changed(ATEM_CHANGED_FADE_TO_BLACK);
+			}
 			_ATEM_FtbS_state = _packetBuffer[2]; // State of Fade To Black, 0 = off and 1 = activated
 			_ATEM_FtbS_frameCount = _packetBuffer[3];	// Frames count down
             if (_serialOutput) Serial.print(F("FTB:"));
             if (_serialOutput) Serial.print(_ATEM_FtbS_state);
             if (_serialOutput) Serial.print(F("/"));
             if (_serialOutput) Serial.println(_ATEM_FtbS_frameCount);
-          } else
-	      if(strcmp(cmdStr, "FtbP") == 0) {  // Fade To Black - Positions(?) (Transition Time in frames for FTB): 0x01-0xFA
+          } break;
+	      case ATEM_FOURCC('F','t','b','P'): {  // Fade To Black - Positions(?) (Transition Time in frames for FTB): 0x01-0xFA
 			_ATEM_FtbP_time = _packetBuffer[1];
-          } else
-	      if(strcmp(cmdStr, "TMxP") == 0) {  // Mix Transition Position(?) (Transition Time in frames for Mix transitions.): 0x01-0xFA
+          } break;
+	      case ATEM_FOURCC('T','M','x','P'): {  // Mix Transition Position(?) (Transition Time in frames for Mix transitions.): 0x01-0xFA
 			_ATEM_TMxP_time = _packetBuffer[1];
-          } else
-	      if(strcmp(cmdStr, "DskS") == 0) {  // Downstream Keyer state. Also contains information about the frame count in case of "Auto"
+          } break;
+	      case ATEM_FOURCC('D','s','k','S'): {  // Downstream Keyer state. Also contains information about the frame count in case of "Auto"
 			idx = _packetBuffer[0];
-			if (idx >=0 && idx <=1)	{
-				_ATEM_DskOn[idx] = _packetBuffer[1] > 0 ? true : false;
+			if (idx <=1)	{
+				if (_ATEM_DskOn[idx] != (_packetBuffer[1] > 0))	{
+					_ATEM_DskOn[idx] = _packetBuffer[1] > 0 ? true : false;
+					_changed(ATEM_CHANGED_DOWNSTREAM_KEYER);
+				}
 	            if (_serialOutput) Serial.print(F("Dsk Keyer "));
 	            if (_serialOutput) Serial.print(idx+1);
 	            if (_serialOutput) Serial.print(F(": "));
 	            if (_serialOutput) Serial.println(_ATEM_DskOn[idx], BIN);
 			}
-          } else
-	      if(strcmp(cmdStr, "DskP") == 0) {  // Downstream Keyer Tie
+          } break;
+	      case ATEM_FOURCC('D','s','k','P'): {  // Downstream Keyer Tie
 			idx = _packetBuffer[0];
-			if (idx >=0 && idx <=1)	{
-				_ATEM_DskTie[idx] = _packetBuffer[1] > 0 ? true : false;
+			if (idx <=1)	{
+				if (_ATEM_DskTie[idx] != (_packetBuffer[1] > 0))	{
+					_ATEM_DskTie[idx] = _packetBuffer[1] > 0 ? true : false;
+					_changed(ATEM_CHANGED_DOWNSTREAM_KEYER);
+				}
 	            if (_serialOutput) Serial.print(F("Dsk Keyer"));
 	            if (_serialOutput) Serial.print(idx+1);
 	            if (_serialOutput) Serial.print(F(" Tie: "));
 	            if (_serialOutput) Serial.println(_ATEM_DskTie[idx], BIN);
 			}
-          } else
-		  if(strcmp(cmdStr, "KeOn") == 0) {  // Upstream Keyer on
+          } break;
+		  case ATEM_FOURCC('K','e','O','n'): {  // Upstream Keyer on
+			uint8_t mE = _packetBuffer[0];
 			idx = _packetBuffer[1];
-			if (idx >=0 && idx <=3)	{
-				_ATEM_KeOn[idx] = _packetBuffer[2] > 0 ? true : false;
+			if (mE < ATEM_maxME && idx <=3)	{
+				if (_ATEM_KeOn[mE][idx] != (_packetBuffer[2] > 0))	{
+					_ATEM_KeOn[mE][idx] = _packetBuffer[2] > 0 ? true : false;
+					_changed(ATEM_CHANGED_UPSTREAM_KEYER);
+				}
 	            if (_serialOutput) Serial.print(F("Upstream Keyer "));
 	            if (_serialOutput) Serial.print(idx+1);
 	            if (_serialOutput) Serial.print(F(": "));
-	            if (_serialOutput) Serial.println(_ATEM_KeOn[idx], BIN);
+	            if (_serialOutput) Serial.println(_ATEM_KeOn[mE][idx], BIN);
 			}
-	      } else 
-		  if(strcmp(cmdStr, "ColV") == 0) {  // Color Generator Change
+	      } break;
+		  case ATEM_FOURCC('C','o','l','V'): {  // Color Generator Change
 				// Todo: Relatively easy: 8 bytes, first is the color generator, the last 6 is hsl words
-		  } else 
-		  if(strcmp(cmdStr, "MPCE") == 0) {  // Media Player Clip Enable
+		  } break;
+		  case ATEM_FOURCC('M','P','C','E'): {  // Media Player Clip Enable
 				idx = _packetBuffer[0];
-				if (idx >=0 && idx <=1)	{
+				if (idx <=1)	{
+					if (_ATEM_MPType[idx] != _packetBuffer[1] || _ATEM_MPStill[idx] != _packetBuffer[2] || _ATEM_MPClip[idx] != _packetBuffer[3])	{
+						_changed(ATEM_CHANGED_MEDIA_PLAYER);
+					}
 					_ATEM_MPType[idx] = _packetBuffer[1];
 					_ATEM_MPStill[idx] = _packetBuffer[2];
 					_ATEM_MPClip[idx] = _packetBuffer[3];
 				}
-		  } else 
-		  if(strcmp(cmdStr, "AuxS") == 0) {  // Aux Output Source
+		  } break;
+		  case ATEM_FOURCC('A','u','x','S'): {  // Aux Output Source
 				uint8_t auxInput = _packetBuffer[0];
-				if (auxInput >=0 && auxInput <=2)	{
-					if (!ver42())	{
-						_ATEM_AuxS[auxInput] = _packetBuffer[1];
-					} else {
-						_ATEM_AuxS[auxInput] = (uint16_t)(_packetBuffer[2]<<8) | _packetBuffer[3];
+				if (auxInput <=2)	{
+					uint16_t auxS = _readInputField();
+					if (_ATEM_AuxS[auxInput] != auxS)	{
+						_ATEM_AuxS[auxInput] = auxS;
+						_changed(ATEM_CHANGED_AUX);
 					}
 		            if (_serialOutput) Serial.print(F("Aux "));
 		            if (_serialOutput) Serial.print(auxInput+1);
@@ -423,23 +793,27 @@ void ATEM::_parsePacket(uint16_t packetLength)	{
 		            if (_serialOutput) Serial.println(_ATEM_AuxS[auxInput], DEC);
 				}
 
-		    } else 
-		    if(strcmp(cmdStr, "_ver") == 0) {  // Firmware version
+		    } break;
+		    case ATEM_FOURCC('_','v','e','r'): {  // Firmware version
 				_ATEM_ver_m = _packetBuffer[1];	// Firmware version, "left of decimal point" (what is that called anyway?)
 				_ATEM_ver_l = _packetBuffer[3];	// Firmware version, decimals ("right of decimal point")
-		    } else 
-			if(strcmp(cmdStr, "_pin") == 0) {  // Name
+				_setProtocolVersion();
+		    } break;
+			case ATEM_FOURCC('_','p','i','n'): {  // Name
 				for(uint8_t i=0;i<16;i++)	{
 					_ATEM_pin[i] = _packetBuffer[i];
 				}
 				_ATEM_pin[16] = 0;	// Termination
-		    } else 
-			if(strcmp(cmdStr, "AMTl") == 0) {  // Audio Monitor Tally (on/off settings)
+		    } break;
+			case ATEM_FOURCC('A','M','T','l'): {  // Audio Monitor Tally (on/off settings)
 				// Same system as for video: "TlIn"... just implement when time.
-		    } else 
+		    } break;
 			// Note for future reveng: For master control, volume at least comes back in "AMMO" (CAMM is the command code.)
-			if(strcmp(cmdStr, "AMIP") == 0) {  // Audio Monitor Input P... (state) (On, Off, AFV)
+			case ATEM_FOURCC('A','M','I','P'): {  // Audio Monitor Input P... (state) (On, Off, AFV)
 				if (_packetBuffer[1]<13)	{
+					if (_ATEM_AudioChannelMode[_packetBuffer[1]] != _packetBuffer[8])	{
+						_changed(ATEM_CHANGED_AUDIO);
+					}
 					_ATEM_AudioChannelMode[_packetBuffer[1]]  = _packetBuffer[8];	
 					// 0+1 = Channel (high+low byte)
 					// 6 = On/Off/AFV
@@ -474,8 +848,8 @@ void ATEM::_parsePacket(uint16_t packetLength)	{
 				Serial.print((uint16_t)_packetBuffer[4]*256+_packetBuffer[5]);
 				Serial.print("/");
 				Serial.println((uint16_t)_packetBuffer[6]*256+_packetBuffer[7]);
-		   */ } else 
-			if(strcmp(cmdStr, "AMLv") == 0) {  // Audio Monitor Levels
+		   */ } break;
+			case ATEM_FOURCC('A','M','L','v'): {  // Audio Monitor Levels
 				// Get number of channels:
 			  	_readToPacketBuffer(4);	// AMLv (AudioMonitorLevels)
 
@@ -507,10 +881,14 @@ void ATEM::_parsePacket(uint16_t packetLength)	{
 					}
 					
 				}
-			} else 
-			if(strcmp(cmdStr, "VidM") == 0) {  // Video format (SD, HD, framerate etc.)
-				_ATEM_VidM = _packetBuffer[0];	
-		    } else {
+			} break;
+			case ATEM_FOURCC('V','i','d','M'): {  // Video format (SD, HD, framerate etc.)
+				if (_ATEM_VidM != _packetBuffer[0])	{
+					_ATEM_VidM = _packetBuffer[0];	
+					_changed(ATEM_CHANGED_VIDEO_MODE);
+				}
+		    } break;
+		    default: {
 			
 		
 		
@@ -518,7 +896,10 @@ void ATEM::_parsePacket(uint16_t packetLength)	{
 			/*
 	            if (_serialOutput) {
 					Serial.print(("???? Unknown token: "));
-					Serial.print(cmdStr);
+					Serial.write((uint8_t)(cmd>>24));
+					Serial.write((uint8_t)(cmd>>16));
+					Serial.write((uint8_t)(cmd>>8));
+					Serial.write((uint8_t)cmd);
 					Serial.print(" : ");
 				}
 				for(uint8_t a=(-2+8);a<_cmdLength-2;a++)	{
@@ -529,19 +910,20 @@ void ATEM::_parsePacket(uint16_t packetLength)	{
 				if (_serialOutput) Serial.println("");
 	        */
 			}
+			}
 			
-			// Empty, if long packet and not read yet:
-	      while (_readToPacketBuffer())	{}
+			// Empty, if long packet and not read yet. The bytes are skipped in the W5100 RX memory, not read:
+	      if (_cmdLength-8 > _cmdPointer)	{
+	      	_Udp.skip(_cmdLength-8-_cmdPointer);
+	      }
 	
           indexPointer+=_cmdLength;
         } else { 
       		indexPointer = 2000;
+      		_packetErrors++;
           
-			// Flushing the buffer:
-			// TODO: Other way? _Udp.flush() ??
-	          while(_Udp.available()) {
-	              _Udp.read(_packetBuffer, 96);
-	          }
+			// Flushing the buffer (steps over the rest of the packet in the W5100 RX memory):
+	        _Udp.flush();
         }
       }
 }
@@ -550,70 +932,80 @@ void ATEM::_parsePacket(uint16_t packetLength)	{
  * Sending a regular answer packet back (tell the switcher that "we heard you, thanks.")
  */
 void ATEM::_sendAnswerPacket(uint16_t remotePacketID)  {
+  unsigned long spiTransactionsStart = W5100.spiTransactions;
+
+  // Answer packet: The template from _prepareAnswerPacket() with the remote packet ID patched in
+  _answerPacket[4] = remotePacketID/256;  // Remote Packet ID, MSB
+  _answerPacket[5] = remotePacketID%256;  // Remote Packet ID, LSB
 
-  //Answer packet:
-  memset(_packetBuffer, 0, 12);			// Using 12 bytes of answer buffer, setting to zeros.
-  _packetBuffer[2] = 0x80;  // ??? API
-  _packetBuffer[3] = _sessionID;  // Session ID
-  _packetBuffer[4] = remotePacketID/256;  // Remote Packet ID, MSB
-  _packetBuffer[5] = remotePacketID%256;  // Remote Packet ID, LSB
-  _packetBuffer[9] = 0x41;  // ??? API
-  // The rest is zeros.
-
-  // Create header:
-  uint16_t returnPacketLength = 10+2;
-  _packetBuffer[0] = returnPacketLength/256;
-  _packetBuffer[1] = returnPacketLength%256;
-  _packetBuffer[0] |= B10000000;
-
-  // Send connectAnswerString to ATEM:
+  // Send answer to ATEM. The destination registers of the socket are only written if they changed,
+  // and the W5100 sends the packet while we go on reading:
   _Udp.beginPacket(_switcherIP,  9910);
-  _Udp.write(_packetBuffer,returnPacketLength);
+  _Udp.write(_answerPacket,12);
   _Udp.endPacket();  
+  _answerPacketsSent++;
+
+  _spiTransactionsPerAnswer = W5100.spiTransactions - spiTransactionsStart;
+
+  if (((remotePacketID - _lastAnsweredPacketID) & 0x7FFF) < 0x4000)	{	// Not an answer to an old retransmission
+  	_lastAnsweredPacketID = remotePacketID;
+  }
 }
 
 /**
- * Sending a command packet back (ask the switcher to do something)
+ * ACK coalescing: Holds back the answer to a packet which directly follows the one answered last (or held back),
+ * so a run of packets drained in one runLoop() gets a single answer for the highest remote packet ID.
+ * Anything else (a gap, or a retransmission of an older packet) is answered by itself right away.
  */
-void ATEM::_sendCommandPacket(const char cmd[4], uint8_t commandBytes[64], uint8_t cmdBytes)  {	// TEMP: 16->64
-
-  if (cmdBytes <= 64)	{	// Currently, only a lenght up to 16 - can be extended, but then the _packetBuffer buffer must be prolonged as well (to more than 36)	<- TEMP 16->64
-	  //Answer packet preparations:
-	  memset(_packetBuffer, 0, 84);	// <- TEMP 36->84
-	  _packetBuffer[2] = 0x80;  // ??? API
-	  _packetBuffer[3] = _sessionID;  // Session ID
-	  _packetBuffer[10] = _localPacketIdCounter/256;  // Remote Packet ID, MSB
-	  _packetBuffer[11] = _localPacketIdCounter%256;  // Remote Packet ID, LSB
-
-	  // The rest is zeros.
-
-	  // Command identifier (4 bytes, after header (12 bytes) and local segment length (4 bytes)):
-	  int i;
-	  for (i=0; i<4; i++)  {
-	    _packetBuffer[12+4+i] = cmd[i];
-	  }
-
-  		// Command value (after command):
-	  for (i=0; i<cmdBytes; i++)  {
-	    _packetBuffer[12+4+4+i] = commandBytes[i];
-	  }
+void ATEM::_coalesceAnswerPacket(uint16_t remotePacketID)  {
+  uint16_t previousPacketID = _answerPending ? _pendingAnswerPacketID : _lastAnsweredPacketID;
+
+  if (((remotePacketID - previousPacketID) & 0x7FFF) == 1)	{
+  	if (_answerPending)	{
+  		_answerPacketsSaved++;
+  		if (_firstCoalescedTime==0)	{
+  			_firstCoalescedTime = millis();
+  		}
+  	}
+  	_pendingAnswerPacketID = remotePacketID;
+  	_answerPending = true;
+  } else {
+  	_flushAnswerPacket();
+  	_sendAnswerPacket(remotePacketID);
+  }
+}
 
-	  // Command length:
-	  _packetBuffer[12] = (4+4+cmdBytes)/256;
-	  _packetBuffer[12+1] = (4+4+cmdBytes)%256;
+/**
+ * Sends the answer held back by _coalesceAnswerPacket(), if any
+ */
+void ATEM::_flushAnswerPacket()  {
+  if (_answerPending)	{
+  	_answerPending = false;
+  	_sendAnswerPacket(_pendingAnswerPacketID);
+  }
+}
 
-	  // Create header:
-	  uint16_t returnPacketLength = 10+2+(4+4+cmdBytes);
-	  _packetBuffer[0] = returnPacketLength/256;
-	  _packetBuffer[1] = returnPacketLength%256;
-	  _packetBuffer[0] |= B00001000;
+/**
+ * Builds the constant part of the answer packets, once per session
+ */
+void ATEM::_prepareAnswerPacket()  {
+  memset(_answerPacket, 0, 12);
+  _answerPacket[0] = B10000000;  // Length (12) and "This is a response on your request"
+  _answerPacket[1] = 12;
+  _answerPacket[2] = 0x80;  // ??? API
+  _answerPacket[3] = _sessionID;  // Session ID
+  _answerPacket[9] = 0x41;  // ??? API
+  // The rest is zeros, except for the remote packet ID in byte 4-5.
+}
 
-	  // Send connectAnswerString to ATEM:
-	  _Udp.beginPacket(_switcherIP,  9910);
-	  _Udp.write(_packetBuffer,returnPacketLength);
-	  _Udp.endPacket();  
+/**
+ * Sending a command packet back (ask the switcher to do something)
+ * The command is queued, see _queueCommand()
+ */
+void ATEM::_sendCommandPacket(const char cmd[4], uint8_t commandBytes[64], uint8_t cmdBytes)  {	// TEMP: 16->64
 
-	  _localPacketIdCounter++;
+  if (cmdBytes <= 64)	{	// Currently, only a lenght up to 16 - can be extended, but then the _packetBuffer buffer must be prolonged as well (to more than 36)	<- TEMP 16->64
+	  _queueCommand(cmd, commandBytes, cmdBytes);
 	}
 }
 
@@ -625,45 +1017,42 @@ void ATEM::_wipeCleanPacketBuffer() {
 }
 
 /**
- * Sets all zeros in packet buffer:
+ * Sending a command packet with the first cmdBytes of the packet buffer as command value
+ * The command is queued, see _queueCommand()
  */
 void ATEM::_sendPacketBufferCmdData(const char cmd[4], uint8_t cmdBytes)  {
 	
   if (cmdBytes <= 96-20)	{
-	  //Answer packet preparations:
-	  uint8_t _headerBuffer[20];
-	  memset(_headerBuffer, 0, 20);
-	  _headerBuffer[2] = 0x80;  // ??? API
-	  _headerBuffer[3] = _sessionID;  // Session ID
-	  _headerBuffer[10] = _localPacketIdCounter/256;  // Remote Packet ID, MSB
-	  _headerBuffer[11] = _localPacketIdCounter%256;  // Remote Packet ID, LSB
-
-	  // The rest is zeros.
-
-	  // Command identifier (4 bytes, after header (12 bytes) and local segment length (4 bytes)):
-	  int i;
-	  for (i=0; i<4; i++)  {
-	    _headerBuffer[12+4+i] = cmd[i];
-	  }
-
-	  // Command length:
-	  _headerBuffer[12] = (4+4+cmdBytes)/256;
-	  _headerBuffer[12+1] = (4+4+cmdBytes)%256;
+	  _queueCommand(cmd, _packetBuffer, cmdBytes);
+	}
+}
 
-	  // Create header:
-	  uint16_t returnPacketLength = 20+cmdBytes;
-	  _headerBuffer[0] = returnPacketLength/256;
-	  _headerBuffer[1] = returnPacketLength%256;
-	  _headerBuffer[0] |= B00001000;
+/**
+ * Adds a command segment to the command queue. The queue is sent as one packet by flushCommands(), which runLoop() calls.
+ * If the segment does not fit, the queue is sent first. If that has to wait for a free slot too, the segment is dropped
+ * and counted in getCommandPacketsLost().
+ */
+void ATEM::_queueCommand(const char cmd[4], const uint8_t *cmdData, uint8_t cmdBytes)	{
+	uint8_t segmentLength = 4+4+cmdBytes;
+	if (segmentLength > ATEM_commandQueueSize)	{
+		return;
+	}
+	if (_commandQueueLength + segmentLength > ATEM_commandQueueSize && !flushCommands())	{
+		_commandPacketsLost++;
+		if (_serialOutput) Serial.println(F("Command dropped, queue full"));
+		return;
+	}
 
-	  // Send connectAnswerString to ATEM:
-	  _Udp.beginPacket(_switcherIP,  9910);
-	  _Udp.write(_headerBuffer,20);
-	  _Udp.write(_packetBuffer,cmdBytes);
-	  _Udp.endPacket();  
+	// Segment: Command length (word), two zeros, command identifier (4 bytes) and command value:
+	uint8_t *segment = _commandQueue + _commandQueueLength;
+	segment[0] = 0;
+	segment[1] = segmentLength;
+	segment[2] = 0;
+	segment[3] = 0;
+	memcpy(segment+4, cmd, 4);
+	memcpy(segment+8, cmdData, cmdBytes);
 
-	  _localPacketIdCounter++;
-	}
+	_commandQueueLength += segmentLength;
 }
 
 
@@ -691,6 +1080,133 @@ bool ATEM::hasInitialized()	{
 	return _hasInitialized;
 }
 
+/**
+ * Setter method: In boot dump mode the UDP socket gets 4 KB of the W5100 RX memory and every packet of the initial state dump is
+ * acknowledged, so the switcher retransmits the ones that were dropped. hasInitialized() only turns true once the gaps are filled.
+ * Must be set before connect(), and before any other socket is opened (e.g. by EthernetServer::begin()): the RX memory is
+ * partitioned once, here, as repartitioning would move the buffers of open sockets. Reconnects keep it.
+ */
+void ATEM::bootDumpMode(boolean bootDumpMode)	{
+	_bootDumpMode = bootDumpMode;
+	if (_bootDumpMode)	{
+		_Udp.begin(_localPort);
+		_Udp.enlargeRXBuffer();	// 4 KB instead of 2 KB, so a burst of initial state packets has room to land
+	}
+}
+
+/**
+ * Setter method: With ACK coalescing, the packets drained in one runLoop() are answered with a single ACK for the
+ * highest remote packet ID of an unbroken run, instead of one ACK per packet. Where the remote packet IDs have a gap,
+ * the packets are answered one by one. Saves outbound packets and SPI time when the switcher sends in bursts.
+ * This relies on the switcher taking an ACK for all packets up to its ID: Each session first coalesces a single answer,
+ * and if the switcher retransmits the packet which was only covered that way, every packet is answered by itself for
+ * the rest of the session. The initial state dump is always answered packet by packet.
+ */
+void ATEM::ackCoalescing(boolean ackCoalescing)	{
+	_ackCoalescing = ackCoalescing;
+}
+
+/**
+ * Setter method: In event driven mode runLoop() only reads from the W5100 when its receive interrupt flag for the
+ * socket is set, which costs one SPI transaction instead of polling the receive size, and delay() and idle() sleep while
+ * nothing arrives. The flag is polled: On the Ethernet shield the W5100 INT line would need pin 2, which the radio uses.
+ */
+void ATEM::eventDriven(boolean eventDriven)	{
+	_eventDriven = eventDriven;
+}
+
+/**
+ * Getter method: Time (micros) the packet with the most recent change arrived, for measuring how long it takes to act on it
+ */
+unsigned long ATEM::getLastChangeTime()	{
+	return _lastChangeTime;
+}
+
+/**
+ * Getter method: Number of runLoop() calls since begin()
+ */
+unsigned long ATEM::getRunLoops()	{
+	return _runLoops;
+}
+
+/**
+ * Getter method: Number of runLoop() calls in event driven mode which found nothing to read
+ */
+unsigned long ATEM::getIdleRunLoops()	{
+	return _idleRunLoops;
+}
+
+/**
+ * Getter method: Microseconds idle() has slept since begin(). Wraps around after about 71 minutes.
+ */
+unsigned long ATEM::getIdleTime()	{
+	return _idleTime;
+}
+
+/**
+ * Getter method: Number of answer packets ACK coalescing has saved since begin()
+ */
+unsigned long ATEM::getAnswerPacketsSaved()	{
+	return _answerPacketsSaved;
+}
+
+/**
+ * Getter method: Number of packets received from the switcher since begin()
+ */
+unsigned long ATEM::getPacketsReceived()	{
+	return _packetsReceived;
+}
+
+/**
+ * Getter method: Number of answer packets (ACKs) sent to the switcher since begin()
+ */
+unsigned long ATEM::getAnswerPacketsSent()	{
+	return _answerPacketsSent;
+}
+
+/**
+ * Getter method: Number of packets from the switcher which didn't parse: Length not matching the
+ * datagram, or a malformed command segment
+ */
+uint16_t ATEM::getPacketErrors()	{
+	return _packetErrors;
+}
+
+/**
+ * Getter method: True between the handshake and hasInitialized(), while the switcher is sending the initial state dump.
+ * Anything else in the loop (web server, radio) should stand back meanwhile so the RX buffer is drained as fast as possible.
+ * Turns false if the switcher goes silent for a second.
+ */
+bool ATEM::isReceivingBootDump()	{
+	return _isReceivingBootDump && (unsigned long)millis() - _lastContact < 1000;
+}
+
+/**
+ * Getter method: Returns the ATEM_CHANGED_* bits of the state values the switcher has changed since the last call, and clears them.
+ * Only actual changes count - the switcher sends many values again without changing them.
+ * Pass a mask to get (and clear) only some of the bits.
+ */
+uint16_t ATEM::getChanges(uint16_t mask)	{
+	uint16_t changes = _changes & mask;
+	_changes &= ~mask;
+	return changes;
+}
+
+/**
+ * Setter method: Registers a function which is called from runLoop() with the ATEM_CHANGED_* bits of each packet that changed something.
+ * Not called before hasInitialized(); the changes from the initial state dump are passed in one call when it is done. NULL unregisters.
+ */
+void ATEM::onChange(ATEMChangeCallback callback)	{
+	_changeCallback = callback;
+}
+
+/**
+ * Returns the number of initial state packets that were missing at the end of the dump and had to be retransmitted (boot dump mode)
+ */
+uint8_t ATEM::getBootDumpMissingPackets()	{
+	return _bootDumpMissingPackets;
+}
+
 /**
  * Returns last Remote Packet ID
  */
@@ -698,6 +1214,56 @@ uint16_t ATEM::getATEM_lastRemotePacketId()	{
 	return _lastRemotePacketID;
 }
 
+/**
+ * Returns the session ID the switcher gave us in the handshake
+ */
+uint8_t ATEM::getSessionID()	{
+	return _sessionID;
+}
+
+/**
+ * Returns the number of command packets sent again because the switcher did not acknowledge them in time
+ */
+uint16_t ATEM::getCommandRetransmissions()	{
+	return _commandRetransmissions;
+}
+
+/**
+ * Returns the number of command packets given up without an acknowledge from the switcher, plus the commands dropped
+ * because the queue was full while every slot waited for an acknowledge
+ */
+uint16_t ATEM::getCommandPacketsLost()	{
+	return _commandPacketsLost;
+}
+
+/**
+ * Returns the smoothed round trip time (ms) of command packets, 0 before the first one is acknowledged
+ */
+uint16_t ATEM::getCommandRTT()	{
+	return _commandSRTT;
+}
+
+/**
+ * Returns the current retransmission timeout (ms) for command packets
+ */
+uint16_t ATEM::getCommandRTO()	{
+	return _commandRTO;
+}
+
+/**
+ * Returns the number of W5100 SPI transactions spent on the most recent answer (ACK) packet
+ */
+uint16_t ATEM::getSPITransactionsPerAnswer()	{
+	return _spiTransactionsPerAnswer;
+}
+
+/**
+ * Returns the number of W5100 SPI transactions spent on receiving (and acknowledging) the most recent packet from the switcher
+ */
+uint16_t ATEM::getSPITransactionsPerPacket()	{
+	return _spiTransactionsPerPacket;
+}
+
 uint8_t ATEM::getATEMmodel()	{
 /*	Serial.println(_ATEM_pin);
 	Serial.println(strcmp(_ATEM_pin, "ATEM Television ") == 0);
@@ -733,30 +1299,61 @@ uint8_t ATEM::getATEMmodel()	{
  *
  ********************************/
 
-uint16_t ATEM::getProgramInput() {
-	return _ATEM_PrgI;
+uint16_t ATEM::getProgramInput(uint8_t mE) {
+	return mE < ATEM_maxME ? _ATEM_PrgI[mE] : 0;
 }
-uint16_t ATEM::getPreviewInput() {
-	return _ATEM_PrvI;
+uint16_t ATEM::getPreviewInput(uint8_t mE) {
+	return mE < ATEM_maxME ? _ATEM_PrvI[mE] : 0;
 }
 boolean ATEM::getProgramTally(uint8_t inputNumber) {
-  	// TODO: Validate that input number exists on current model! <8 at the moment.
-	return (_ATEM_TlIn[inputNumber-1] & 1) >0 ? true : false;
+	if (inputNumber < 1 || inputNumber > ATEM_maxInputs)	return false;
+	return (_ATEM_TlIn_program[(inputNumber-1)>>3] >> ((inputNumber-1)&7)) & 1 ? true : false;
 }
 boolean ATEM::getPreviewTally(uint8_t inputNumber) {
-  	// TODO: Validate that input number exists on current model! 1-8 at the moment.
-	return (_ATEM_TlIn[inputNumber-1] & 2) >0 ? true : false;
+	if (inputNumber < 1 || inputNumber > ATEM_maxInputs)	return false;
+	return (_ATEM_TlIn_preview[(inputNumber-1)>>3] >> ((inputNumber-1)&7)) & 1 ? true : false;
+}
+
+/**
+ * Returns the program tally of all inputs as a bitmask, bit 0 = input 1
+ */
+uint64_t ATEM::getProgramTallyMask() {
+	return _tallyMask(_ATEM_TlIn_program);
+}
+
+/**
+ * Returns the preview tally of all inputs as a bitmask, bit 0 = input 1
+ */
+uint64_t ATEM::getPreviewTallyMask() {
+	return _tallyMask(_ATEM_TlIn_preview);
+}
+
+/**
+ * Returns a bitmask (bit 0 = input 1) of the inputs whose program or preview tally changed since the last call, and clears it
+ */
+uint64_t ATEM::getTallyChangedMask() {
+	uint64_t mask = _tallyMask(_ATEM_TlIn_changed);
+	memset(_ATEM_TlIn_changed, 0, ATEM_tallyBytes);
+	return mask;
 }
-boolean ATEM::getUpstreamKeyerStatus(uint8_t inputNumber) {
-	if (inputNumber>=1 && inputNumber<=4)	{
-		return _ATEM_KeOn[inputNumber-1];
+
+uint64_t ATEM::_tallyMask(const uint8_t *bitPlane) {
+	uint64_t mask = 0;
+	for(uint8_t b = ATEM_tallyBytes; b > 0; --b) {
+		mask = (mask << 8) | bitPlane[b-1];
+	}
+	return mask;
+}
+boolean ATEM::getUpstreamKeyerStatus(uint8_t inputNumber, uint8_t mE) {
+	if (inputNumber>=1 && inputNumber<=4 && mE < ATEM_maxME)	{
+		return _ATEM_KeOn[mE][inputNumber-1];
 	}
 	return false;
 }
-boolean ATEM::getUpstreamKeyerOnNextTransitionStatus(uint8_t inputNumber) {	// input 0 = background
-	if (inputNumber>=0 && inputNumber<=4)	{
+boolean ATEM::getUpstreamKeyerOnNextTransitionStatus(uint8_t inputNumber, uint8_t mE) {	// input 0 = background
+	if (inputNumber<=4 && mE < ATEM_maxME)	{
 			// Notice: the first bit is set for the "background", not valid.
-		return (_ATEM_TrSS_KeyersOnNextTransition & (0x01 << inputNumber)) ? true : false;
+		return (_ATEM_TrSS_KeyersOnNextTransition[mE] & (0x01 << inputNumber)) ? true : false;
 	}
 	return false;
 }
@@ -767,14 +1364,58 @@ boolean ATEM::getDownstreamKeyerStatus(uint8_t inputNumber) {
 	}
 	return false;
 }
-uint16_t ATEM::getTransitionPosition() {
-	return _ATEM_TrPs_position;
+uint16_t ATEM::getTransitionPosition(uint8_t mE) {
+	return mE < ATEM_maxME ? _ATEM_TrPs_position[mE] : 0;
 }
-bool ATEM::getTransitionPreview()	{
-	return _ATEM_TrPr;
+uint8_t ATEM::getTransitionFramesRemaining(uint8_t mE) {
+	return mE < ATEM_maxME ? _ATEM_TrPs_frameCount[mE] : 0;
 }
-uint8_t ATEM::getTransitionType()	{
-	return _ATEM_TrSS_TransitionStyle;
+
+/**
+ * Returns true while a transition (auto or T-bar) is between start and end, meaning the preview source is going to air.
+ * Taken from the in-transition flag of TrPs rather than the position, which the switcher reports from 0 to 10000.
+ */
+bool ATEM::isInTransition(uint8_t mE) {
+	return mE < ATEM_maxME && _ATEM_TrPs_inTransition[mE];
+}
+
+/**
+ * Returns the time (millis) an auto transition is predicted to finish, from the frames left and the frame rate of the video format.
+ * Only meaningful while isInTransition(). A T-bar transition finishes when the T-bar is moved, not at this time.
+ */
+unsigned long ATEM::getTransitionEndTime(uint8_t mE) {
+	return mE < ATEM_maxME ? _ATEM_TrPs_endTime[mE] : 0;
+}
+
+/**
+ * Returns true if the input is on air: On program, or on preview while a transition brings it to air.
+ * Use this for red tally - it lights when the source starts mixing in, not when the transition is done and program changes.
+ */
+bool ATEM::isOnAir(uint16_t inputNumber, uint8_t mE) {
+	return mE < ATEM_maxME && (_ATEM_PrgI[mE] == inputNumber || (isInTransition(mE) && _ATEM_PrvI[mE] == inputNumber));
+}
+
+/**
+ * Returns the duration of a frame in microseconds for the current video format (VidM)
+ */
+uint16_t ATEM::_frameDuration() {
+	switch (_ATEM_VidM)	{
+		case 0:	// 525i59.94 NTSC
+		case 5:	// 1080i59.94
+			return 33367;
+		case 2:	// 720p50
+			return 20000;
+		case 3:	// 720p59.94
+			return 16683;
+		default:	// 625i50 PAL, 1080i50
+			return 40000;
+	}
+}
+bool ATEM::getTransitionPreview(uint8_t mE)	{
+	return mE < ATEM_maxME ? _ATEM_TrPr[mE] : false;
+}
+uint8_t ATEM::getTransitionType(uint8_t mE)	{
+	return mE < ATEM_maxME ? _ATEM_TrSS_TransitionStyle[mE] : 0;
 }
 uint8_t ATEM::getTransitionMixTime() {
 	return _ATEM_TMxP_time;		// Transition time for Mix Transitions
@@ -835,6 +1476,7 @@ uint8_t ATEM::getAudioChannelMode(uint8_t channelNumber)	{
 		12: EXT*/
 		return _ATEM_AudioChannelMode[channelNumber];
 	}
+	return 0;
 }
 
 
@@ -847,40 +1489,34 @@ uint8_t ATEM::getAudioChannelMode(uint8_t channelNumber)	{
 
 
 
-void ATEM::changeProgramInput(uint16_t inputNumber)  {
+void ATEM::changeProgramInput(uint16_t inputNumber, uint8_t mE)  {
   // TODO: Validate that input number exists on current model!
 	// On ATEM 1M/E: Black (0), 1 (1), 2 (2), 3 (3), 4 (4), 5 (5), 6 (6), 7 (7), 8 (8), Bars (9), Color1 (10), Color 2 (11), Media 1 (12), Media 2 (14)
 
   _wipeCleanPacketBuffer();
-  if (!ver42())	{
-	  _packetBuffer[1] = inputNumber;
-  } else {
-	  _packetBuffer[2] = (inputNumber >> 8);
-	  _packetBuffer[3] = (inputNumber & 0xFF);
-  }
+  _writeInputField(inputNumber);
+  _packetBuffer[0] = mE;
   _sendPacketBufferCmdData("CPgI", 4);
 }
-void ATEM::changePreviewInput(uint16_t inputNumber)  {
+void ATEM::changePreviewInput(uint16_t inputNumber, uint8_t mE)  {
   // TODO: Validate that input number exists on current model!
 
   _wipeCleanPacketBuffer();
-  if (!ver42())	{
-	  _packetBuffer[1] = inputNumber;
-  } else {
-	  _packetBuffer[2] = (inputNumber >> 8);
-	  _packetBuffer[3] = (inputNumber & 0xFF);
-  }
+  _writeInputField(inputNumber);
+  _packetBuffer[0] = mE;
   _sendPacketBufferCmdData("CPvI", 4);
 }
-void ATEM::doCut()	{
+void ATEM::doCut(uint8_t mE)	{
   _wipeCleanPacketBuffer();
+  _packetBuffer[0] = mE;
   _packetBuffer[1] = 0xef;
   _packetBuffer[2] = 0xbf;
   _packetBuffer[3] = 0x5f;
   _sendPacketBufferCmdData("DCut", 4);
 }
-void ATEM::doAuto()	{
+void ATEM::doAuto(uint8_t mE)	{
   _wipeCleanPacketBuffer();
+  _packetBuffer[0] = mE;
   _packetBuffer[1] = 0x32;
   _packetBuffer[2] = 0x16;
   _packetBuffer[3] = 0x02;
@@ -893,23 +1529,23 @@ void ATEM::fadeToBlackActivate()	{
   _packetBuffer[3] = 0x99;
   _sendPacketBufferCmdData("FtbA", 4);	// Reflected back from ATEM in "FtbS"
 }
-void ATEM::changeTransitionPosition(word value)	{
+void ATEM::changeTransitionPosition(word value, uint8_t mE)	{
 	if (value>0 && value<=1000)	{
-		uint8_t commandBytes[4] = {0, 0xe4, (value*10)/256, (value*10)%256};
+		uint8_t commandBytes[4] = {mE, 0xe4, (uint8_t)((value*10)/256), (uint8_t)((value*10)%256)};
 		_sendCommandPacket("CTPs", commandBytes, 4);  // Change Transition Position (CTPs)
 	}
 }
-void ATEM::changeTransitionPositionDone()	{	// When the last value of the transition is sent (1000), send this one too (we are done, change tally lights and preview bus!)
-	uint8_t commandBytes[4] = {0, 0xf6, 0, 0};  	// Done
+void ATEM::changeTransitionPositionDone(uint8_t mE)	{	// When the last value of the transition is sent (1000), send this one too (we are done, change tally lights and preview bus!)
+	uint8_t commandBytes[4] = {mE, 0xf6, 0, 0};  	// Done
 	_sendCommandPacket("CTPs", commandBytes, 4);  // Change Transition Position (CTPs)
 }
-void ATEM::changeTransitionPreview(bool state)	{
-	uint8_t commandBytes[4] = {0x00, state ? 0x01 : 0x00, 0x00, 0x00};
+void ATEM::changeTransitionPreview(bool state, uint8_t mE)	{
+	uint8_t commandBytes[4] = {mE, (uint8_t)(state ? 0x01 : 0x00), 0x00, 0x00};
 	_sendCommandPacket("CTPr", commandBytes, 4);	// Reflected back from ATEM in "TrPr"
 }
-void ATEM::changeTransitionType(uint8_t type)	{
-	if (type>=0 && type<=4)	{	// 0=MIX, 1=DIP, 2=WIPE, 3=DVE, 4=STING
-		uint8_t commandBytes[4] = {0x01, 0x00, type, 0x02};
+void ATEM::changeTransitionType(uint8_t type, uint8_t mE)	{
+	if (type<=4)	{	// 0=MIX, 1=DIP, 2=WIPE, 3=DVE, 4=STING
+		uint8_t commandBytes[4] = {0x01, mE, type, 0x02};
 		_sendCommandPacket("CTTp", commandBytes, 4);	// Reflected back from ATEM in "TrSS"
 	}
 }
@@ -925,18 +1561,19 @@ void ATEM::changeFadeToBlackTime(uint8_t frames)	{
 		_sendCommandPacket("FtbC", commandBytes, 4);	// Reflected back from ATEM in "FtbP"
 	}
 }
-void ATEM::changeUpstreamKeyOn(uint8_t keyer, bool state)	{
+void ATEM::changeUpstreamKeyOn(uint8_t keyer, bool state, uint8_t mE)	{
 	if (keyer>=1 && keyer<=4)	{	// Todo: Should match available keyers depending on model?
 	  _wipeCleanPacketBuffer();
+	  _packetBuffer[0] = mE;
 	  _packetBuffer[1] = keyer-1;
 	  _packetBuffer[2] = state ? 0x01 : 0x00;
 	  _packetBuffer[3] = 0x90;
 	  _sendPacketBufferCmdData("CKOn", 4);	// Reflected back from ATEM in "KeOn"
 	}
 }
-void ATEM::changeUpstreamKeyNextTransition(uint8_t keyer, bool state)	{	// Supporting "Background" by "0"
-	if (keyer>=0 && keyer<=4)	{	// Todo: Should match available keyers depending on model?
-		uint8_t stateValue = _ATEM_TrSS_KeyersOnNextTransition;
+void ATEM::changeUpstreamKeyNextTransition(uint8_t keyer, bool state, uint8_t mE)	{	// Supporting "Background" by "0"
+	if (keyer<=4 && mE < ATEM_maxME)	{	// Todo: Should match available keyers depending on model?
+		uint8_t stateValue = _ATEM_TrSS_KeyersOnNextTransition[mE];
 		if (state)	{
 			stateValue = stateValue | (B1 << keyer);
 		} else {
@@ -944,26 +1581,26 @@ void ATEM::changeUpstreamKeyNextTransition(uint8_t keyer, bool state)	{	// Suppo
 		}
 				// TODO: Requires internal storage of state here so we can preserve all other states when changing the one we want to change.
 					// Below: Byte 2 is which ME (1 or 2):
-		uint8_t commandBytes[4] = {0x02, 0x00, 0x6a, stateValue & B11111};
+		uint8_t commandBytes[4] = {0x02, mE, 0x6a, (uint8_t)(stateValue & B11111)};
 		_sendCommandPacket("CTTp", commandBytes, 4);	// Reflected back from ATEM in "TrSS"
 	}
 }
 void ATEM::changeDownstreamKeyOn(uint8_t keyer, bool state)	{
 	if (keyer>=1 && keyer<=2)	{	// Todo: Should match available keyers depending on model?
 		
-		uint8_t commandBytes[4] = {keyer-1, state ? 0x01 : 0x00, 0xff, 0xff};
+		uint8_t commandBytes[4] = {(uint8_t)(keyer-1), (uint8_t)(state ? 0x01 : 0x00), 0xff, 0xff};
 		_sendCommandPacket("CDsL", commandBytes, 4);	// Reflected back from ATEM in "DskP" and "DskS"
 	}
 }
 void ATEM::changeDownstreamKeyTie(uint8_t keyer, bool state)	{
 	if (keyer>=1 && keyer<=2)	{	// Todo: Should match available keyers depending on model?
-		uint8_t commandBytes[4] = {keyer-1, state ? 0x01 : 0x00, 0xff, 0xff};
+		uint8_t commandBytes[4] = {(uint8_t)(keyer-1), (uint8_t)(state ? 0x01 : 0x00), 0xff, 0xff};
 		_sendCommandPacket("CDsT", commandBytes, 4);
 	}
 }
 void ATEM::doAutoDownstreamKeyer(uint8_t keyer)	{
 	if (keyer>=1 && keyer<=2)	{	// Todo: Should match available keyers depending on model?
-  		uint8_t commandBytes[4] = {keyer-1, 0x32, 0x16, 0x02};	// I don't know what that actually means...
+  		uint8_t commandBytes[4] = {(uint8_t)(keyer-1), 0x32, 0x16, 0x02};	// I don't know what that actually means...
   		_sendCommandPacket("DDsA", commandBytes, 4);
 	}
 }
@@ -973,10 +1610,10 @@ void ATEM::changeAuxState(uint8_t auxOutput, uint16_t inputNumber)  {
 
 	if (auxOutput>=1 && auxOutput<=3)	{	// Todo: Should match available aux outputs
 		if (!ver42())	{
-	  		uint8_t commandBytes[4] = {auxOutput-1, inputNumber, 0, 0};
+	  		uint8_t commandBytes[4] = {(uint8_t)(auxOutput-1), (uint8_t)inputNumber, 0, 0};
 	  		_sendCommandPacket("CAuS", commandBytes, 4);
 		} else {
-	  		uint8_t commandBytes[8] = {0x01, auxOutput-1, inputNumber >> 8, inputNumber & 0xFF, 0,0,0,0};
+	  		uint8_t commandBytes[8] = {0x01, (uint8_t)(auxOutput-1), (uint8_t)(inputNumber >> 8), (uint8_t)(inputNumber & 0xFF), 0,0,0,0};
 	  		_sendCommandPacket("CAuS", commandBytes, 8);
 		}
 		//Serial.print("freeMemory()=");
@@ -993,11 +1630,11 @@ void ATEM::settingsMemoryClear()	{
 }
 void ATEM::changeColorValue(uint8_t colorGenerator, uint16_t hue, uint16_t saturation, uint16_t lightness)  {
 	if (colorGenerator>=1 && colorGenerator<=2
-			&& hue>=0 && hue<=3600 
-			&& saturation >=0 && saturation <=1000 
-			&& lightness >=0 && lightness <= 1000
+			&& hue<=3600 
+			&& saturation <=1000 
+			&& lightness <= 1000
 		)	{	// Todo: Should match available aux outputs
-  		uint8_t commandBytes[8] = {0x07, colorGenerator-1, 
+  		uint8_t commandBytes[8] = {0x07, (uint8_t)(colorGenerator-1), 
 			highByte(hue), lowByte(hue),
 			highByte(saturation), lowByte(saturation),
 			highByte(lightness), lowByte(lightness)
@@ -1026,14 +1663,14 @@ void ATEM::mediaPlayerSelectSource(uint8_t mediaPlayer, boolean movieclip, uint8
 			
 			// For some reason you have to send this command immediate after (or in fact it could be in the same packet)
 			// If not done, the clip will not change if there is a shift from stills to clips or vice versa.
-		uint8_t commandBytes2[8] = {0x01, mediaPlayer-1, movieclip?2:1, 0xbf, movieclip?0x96:0xd5, 0xb6, 0x04, 0};
+		uint8_t commandBytes2[8] = {0x01, (uint8_t)(mediaPlayer-1), (uint8_t)(movieclip?2:1), 0xbf, (uint8_t)(movieclip?0x96:0xd5), 0xb6, 0x04, 0};
 		_sendCommandPacket("MPSS", commandBytes2, 8);
 	}
 }
 
 void ATEM::mediaPlayerClipStart(uint8_t mediaPlayer)  {
 	if (mediaPlayer>=1 && mediaPlayer<=2)	{
-		uint8_t commandBytes2[8] = {0x01, mediaPlayer-1, 0x01, 0xbf, 0x21, 0xa9, 0x94, 0xfa}; // 3rd byte is "start", remaining 5 bytes seems random...
+		uint8_t commandBytes2[8] = {0x01, (uint8_t)(mediaPlayer-1), 0x01, 0xbf, 0x21, 0xa9, 0x94, 0xfa}; // 3rd byte is "start", remaining 5 bytes seems random...
 		_sendCommandPacket("SCPS", commandBytes2, 8);
 	}
 }
@@ -1041,7 +1678,7 @@ void ATEM::mediaPlayerClipStart(uint8_t mediaPlayer)  {
 
 void ATEM::changeSwitcherVideoFormat(uint8_t format)	{
 	// Changing the video format it uses: 525i59.94 NTSC (0), 625i50 PAL (1), 720p50 (2), 720p59.94 (3), 1080i50 (4), 1080i59.94 (5)
-	if (format>=0 && format<=5)	{	// Todo: Should match available aux outputs
+	if (format<=5)	{	// Todo: Should match available aux outputs
   		uint8_t commandBytes[4] = {format, 0xeb, 0xff, 0xbf};
   		_sendCommandPacket("CVdM", commandBytes, 4);
     }	
@@ -1050,7 +1687,7 @@ void ATEM::changeSwitcherVideoFormat(uint8_t format)	{
 
 
 void ATEM::changeDVESettingsTemp(unsigned long Xpos,unsigned long Ypos,unsigned long Xsize,unsigned long Ysize)	{	// TEMP
-  		uint8_t commandBytes[64] = {0x00, 0x00, 0x00, B1111, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, highByte(Xsize), lowByte(Xsize), 0x00, 0x00, highByte(Ysize), lowByte(Ysize), (Xpos >>24) & 0xFF, (Xpos >>16) & 0xFF, (Xpos >>8) & 0xFF, (Xpos >>0) & 0xFF, (Ypos >>24) & 0xFF, (Ypos >>16) & 0xFF, (Ypos >>8) & 0xFF, (Ypos >>0) & 0xFF, 0xbf, 0xff, 0xdb, 0x7f, 0xc2, 0xa2, 0x09, 0x90, 0xdb, 0x7e, 0xbf, 0xff, 0x82, 0x34, 0x2e, 0x0b, 0x05, 0x00, 0x00, 0x00, 0x34, 0xc1, 0x00, 0x2c, 0xe2, 0x00, 0x4e, 0x02, 0xa3, 0x98, 0xac, 0x02, 0xdb, 0xd9, 0xbf, 0xff, 0x74, 0x34, 0xe9, 0x01};
+  		uint8_t commandBytes[64] = {0x00, 0x00, 0x00, B1111, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, highByte(Xsize), lowByte(Xsize), 0x00, 0x00, highByte(Ysize), lowByte(Ysize), (uint8_t)((Xpos >>24) & 0xFF), (uint8_t)((Xpos >>16) & 0xFF), (uint8_t)((Xpos >>8) & 0xFF), (uint8_t)((Xpos >>0) & 0xFF), (uint8_t)((Ypos >>24) & 0xFF), (uint8_t)((Ypos >>16) & 0xFF), (uint8_t)((Ypos >>8) & 0xFF), (uint8_t)((Ypos >>0) & 0xFF), 0xbf, 0xff, 0xdb, 0x7f, 0xc2, 0xa2, 0x09, 0x90, 0xdb, 0x7e, 0xbf, 0xff, 0x82, 0x34, 0x2e, 0x0b, 0x05, 0x00, 0x00, 0x00, 0x34, 0xc1, 0x00, 0x2c, 0xe2, 0x00, 0x4e, 0x02, 0xa3, 0x98, 0xac, 0x02, 0xdb, 0xd9, 0xbf, 0xff, 0x74, 0x34, 0xe9, 0x01};
   		_sendCommandPacket("CKDV", commandBytes, 64);
 }
 void ATEM::changeDVEMaskTemp(unsigned long top,unsigned long bottom,unsigned long left,unsigned long right)	{	// TEMP
@@ -1058,7 +1695,7 @@ void ATEM::changeDVEMaskTemp(unsigned long top,unsigned long bottom,unsigned lon
   		_sendCommandPacket("CKDV", commandBytes, 64);
 }
 void ATEM::changeDVEBorder(bool enableBorder)	{	// TEMP
-  		uint8_t commandBytes[64] = {0x00, 0x00, 0x00, 0x20, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, enableBorder?1:0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0};
+  		uint8_t commandBytes[64] = {0x00, 0x00, 0x00, 0x20, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, (uint8_t)(enableBorder?1:0), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,0,0,0,0,0,0,0,0,0,0,0,0};
   		_sendCommandPacket("CKDV", commandBytes, 64);
 }
 
@@ -1070,40 +1707,42 @@ void ATEM::changeDVESettingsTemp_RunKeyFrame(uint8_t runType)	{	// runType: 1=A,
   		uint8_t commandBytes[8] = {0x02, 0x00, 0x00, 0x02, 0x00, runType, 0xff, 0xff};
   		_sendCommandPacket("RFlK", commandBytes, 8);
 }
-void ATEM::changeKeyerMask(uint16_t topMask, uint16_t bottomMask, uint16_t leftMask, uint16_t rightMask)	{
+void ATEM::changeKeyerMask(uint16_t topMask, uint16_t bottomMask, uint16_t leftMask, uint16_t rightMask, uint8_t mE)	{
 		// In "B11110", bits are (from right to left): 0=?, 1=topMask, 2=bottomMask, 3=leftMask, 4=rightMask
-  		uint8_t commandBytes[12] = {B11110, 0x00, 0x00, 0x00, highByte(topMask), lowByte(topMask), highByte(bottomMask), lowByte(bottomMask), highByte(leftMask), lowByte(leftMask), highByte(rightMask), lowByte(rightMask)};
+		// Byte 1 is the M/E, byte 2 the keyer (always the first one here)
+  		uint8_t commandBytes[12] = {B11110, mE, 0x00, 0x00, highByte(topMask), lowByte(topMask), highByte(bottomMask), lowByte(bottomMask), highByte(leftMask), lowByte(leftMask), highByte(rightMask), lowByte(rightMask)};
   		_sendCommandPacket("CKMs", commandBytes, 12);
 }
 
 void ATEM::changeDownstreamKeyMask(uint8_t keyer, uint16_t topMask, uint16_t bottomMask, uint16_t leftMask, uint16_t rightMask)	{
 		// In "B11110", bits are (from right to left): 0=?, 1=topMask, 2=bottomMask, 3=leftMask, 4=rightMask
 		if (keyer>=1 && keyer<=2)	{
-  			uint8_t commandBytes[12] = {B11110, keyer-1, 0x00, 0x00, highByte(topMask), lowByte(topMask), highByte(bottomMask), lowByte(bottomMask), highByte(leftMask), lowByte(leftMask), highByte(rightMask), lowByte(rightMask)};
+  			uint8_t commandBytes[12] = {B11110, (uint8_t)(keyer-1), 0x00, 0x00, highByte(topMask), lowByte(topMask), highByte(bottomMask), lowByte(bottomMask), highByte(leftMask), lowByte(leftMask), highByte(rightMask), lowByte(rightMask)};
   			_sendCommandPacket("CDsM", commandBytes, 12);
 		}
 }
 
 
 
-void ATEM::changeUpstreamKeyFillSource(uint8_t keyer, uint16_t inputNumber)	{
+void ATEM::changeUpstreamKeyFillSource(uint8_t keyer, uint16_t inputNumber, uint8_t mE)	{
 	if (keyer>=1 && keyer<=4)	{	// Todo: Should match available keyers depending on model?
 	  	// TODO: Validate that input number exists on current model!
 		// 0-15 on 1M/E
 		if (!ver42())	{
-			uint8_t commandBytes[4] = {0, keyer-1, inputNumber, 0};
+			uint8_t commandBytes[4] = {mE, (uint8_t)(keyer-1), (uint8_t)inputNumber, 0};
 			_sendCommandPacket("CKeF", commandBytes, 4);
 		} else {
-			uint8_t commandBytes[4] = {0, keyer-1, highByte(inputNumber), lowByte(inputNumber)};
+			uint8_t commandBytes[4] = {mE, (uint8_t)(keyer-1), highByte(inputNumber), lowByte(inputNumber)};
 			_sendCommandPacket("CKeF", commandBytes, 4);
 		}
 	}
 }
 
 // TODO: ONLY clip works right now! there is a bug...
-void ATEM::changeUpstreamKeyBlending(uint8_t keyer, bool preMultipliedAlpha, uint16_t clip, uint16_t gain, bool invKey)	{
+void ATEM::changeUpstreamKeyBlending(uint8_t keyer, bool preMultipliedAlpha, uint16_t clip, uint16_t gain, bool invKey, uint8_t mE)	{
 	if (keyer>=1 && keyer<=4)	{	// Todo: Should match available keyers depending on model?
-		uint8_t commandBytes[12] = {0x02, keyer-1, 0, preMultipliedAlpha?1:0, highByte(clip), lowByte(clip), highByte(gain), lowByte(gain), invKey?1:0, 0, 0, 0};
+		// Byte 1 is the M/E, byte 2 the keyer
+		uint8_t commandBytes[12] = {0x02, mE, (uint8_t)(keyer-1), (uint8_t)(preMultipliedAlpha?1:0), highByte(clip), lowByte(clip), highByte(gain), lowByte(gain), (uint8_t)(invKey?1:0), 0, 0, 0};
 		_sendCommandPacket("CKLm", commandBytes, 12);
 	}
 }
@@ -1111,7 +1750,7 @@ void ATEM::changeUpstreamKeyBlending(uint8_t keyer, bool preMultipliedAlpha, uin
 // TODO: ONLY clip works right now! there is a bug...
 void ATEM::changeDownstreamKeyBlending(uint8_t keyer, bool preMultipliedAlpha, uint16_t clip, uint16_t gain, bool invKey)	{
 	if (keyer>=1 && keyer<=4)	{	// Todo: Should match available keyers depending on model?
-		uint8_t commandBytes[12] = {0x02, keyer-1, preMultipliedAlpha?1:0, 0, highByte(clip), lowByte(clip), highByte(gain), lowByte(gain), invKey?1:0, 0, 0, 0};
+		uint8_t commandBytes[12] = {0x02, (uint8_t)(keyer-1), (uint8_t)(preMultipliedAlpha?1:0), 0, highByte(clip), lowByte(clip), highByte(gain), lowByte(gain), (uint8_t)(invKey?1:0), 0, 0, 0};
 		_sendCommandPacket("CDsG", commandBytes, 12);
 	}
 }
@@ -1123,10 +1762,10 @@ void ATEM::changeDownstreamKeyFillSource(uint8_t keyer, uint16_t inputNumber)	{
 	  	// TODO: Validate that input number exists on current model!
 		// 0-15 on 1M/E
 		if (!ver42())	{
-			uint8_t commandBytes[4] = {keyer-1, inputNumber, 0, 0};
+			uint8_t commandBytes[4] = {(uint8_t)(keyer-1), (uint8_t)inputNumber, 0, 0};
 			_sendCommandPacket("CDsF", commandBytes, 4);
 		} else {
-			uint8_t commandBytes[4] = {keyer-1, 0, highByte(inputNumber), lowByte(inputNumber)};
+			uint8_t commandBytes[4] = {(uint8_t)(keyer-1), 0, highByte(inputNumber), lowByte(inputNumber)};
 			_sendCommandPacket("CDsF", commandBytes, 4);
 		}
 	}
@@ -1137,10 +1776,10 @@ void ATEM::changeDownstreamKeyKeySource(uint8_t keyer, uint16_t inputNumber)	{
 	  	// TODO: Validate that input number exists on current model!
 		// 0-15 on 1M/E
 		if (!ver42())	{
-			uint8_t commandBytes[4] = {keyer-1, inputNumber, 0, 0};
+			uint8_t commandBytes[4] = {(uint8_t)(keyer-1), (uint8_t)inputNumber, 0, 0};
 			_sendCommandPacket("CDsC", commandBytes, 4);
 		} else {
-			uint8_t commandBytes[4] = {keyer-1, 0, highByte(inputNumber), lowByte(inputNumber)};
+			uint8_t commandBytes[4] = {(uint8_t)(keyer-1), 0, highByte(inputNumber), lowByte(inputNumber)};
 			_sendCommandPacket("CDsC", commandBytes, 4);
 		}
 	}
@@ -1280,15 +1919,39 @@ Level:		Playback:	Colors:			Protocol:
 	_ATEM_AMLv_channel = AMLv;	// Should check that it's in range 0-12
 }
 
+/**
+ * Returns true if the switcher runs firmware 2.12 (ATEM Control Panel software v. 4.2) or later, which uses 16 bit input numbers.
+ * Decided once when the version arrives, see _setProtocolVersion()
+ */
 bool ATEM::ver42()	{
-	//Serial.println(_ATEM_ver_m);
-	//Serial.println(_ATEM_ver_l);
-	
+	return _ver42;
+}
+
+/**
+ * Selects the protocol dialect from the firmware version: Where the input number field of PrgI, PrvI, AuxS, CPgI and CPvI is.
+ * Before 4.2 it is byte 1, from 4.2 it is the word in byte 2-3. Kept as an offset and a mask for the high byte,
+ * so _readInputField() and _writeInputField() don't need to check the version every time.
+ */
+void ATEM::_setProtocolVersion()	{
 	// ATEM Control Panel software v. 4.2 = firmware version 2.12
-	
-	Serial.println((_ATEM_ver_m>2) || (_ATEM_ver_m>=2 && _ATEM_ver_l>=12));
-	
-	return (_ATEM_ver_m>2) || (_ATEM_ver_m>=2 && _ATEM_ver_l>=12);
+	_ver42 = (_ATEM_ver_m>2) || (_ATEM_ver_m>=2 && _ATEM_ver_l>=12);
+	_inputFieldOffset = _ver42 ? 2 : 0;
+	_inputFieldHighMask = _ver42 ? 0xFF : 0x00;
+}
+
+/**
+ * Reads the input number of a PrgI, PrvI or AuxS segment from the packet buffer
+ */
+uint16_t ATEM::_readInputField()	{
+	return word(_packetBuffer[_inputFieldOffset] & _inputFieldHighMask, _packetBuffer[_inputFieldOffset+1]);
+}
+
+/**
+ * Writes the input number of a CPgI or CPvI command to the (wiped) packet buffer. Before 4.2 byte 0 is cleared, so set the M/E afterwards.
+ */
+void ATEM::_writeInputField(uint16_t inputNumber)	{
+	_packetBuffer[_inputFieldOffset] = highByte(inputNumber) & _inputFieldHighMask;
+	_packetBuffer[_inputFieldOffset+1] = lowByte(inputNumber);
 }
 
 
@@ -40,6 +40,57 @@ with the ATEM library. If not, see http://www.gnu.org/licenses/.
 	#include <avr/pgmspace.h>
 #endif
 
+	// Packs the 4 character segment name of an ATEM state segment (like "PrgI") into a 32 bit integer.
+	// Used as case label in ATEM::_parsePacket(), so the characters must be compile time constants there.
+#define ATEM_FOURCC(a, b, c, d) (((uint32_t)(uint8_t)(a)<<24) | ((uint32_t)(uint8_t)(b)<<16) | ((uint32_t)(uint8_t)(c)<<8) | (uint32_t)(uint8_t)(d))
+
+	// Bits returned by ATEM::getChanges() and passed to the ATEM::onChange() callback, one per group of state values:
+#define ATEM_CHANGED_PROGRAM			0x0001	// PrgI
+#define ATEM_CHANGED_PREVIEW			0x0002	// PrvI
+#define ATEM_CHANGED_TALLY				0x0004	// TlIn
+#define ATEM_CHANGED_TRANSITION			0x0008	// TrPs, TrPr, TrSS
+#define ATEM_CHANGED_FADE_TO_BLACK		0x0010	// FtbS
+#define ATEM_CHANGED_DOWNSTREAM_KEYER	0x0020	// DskS, DskP
+#define ATEM_CHANGED_UPSTREAM_KEYER		0x0040	// KeOn
+#define ATEM_CHANGED_AUX				0x0080	// AuxS
+#define ATEM_CHANGED_MEDIA_PLAYER		0x0100	// MPCE
+#define ATEM_CHANGED_AUDIO				0x0200	// AMIP (not the audio levels, they change all the time)
+#define ATEM_CHANGED_VIDEO_MODE			0x0400	// VidM
+
+	// M/Es the state is kept for. 1 is enough for 1 M/E switchers and saves RAM.
+	// Can be set with a compiler flag (-DATEM_maxME=1), which also reaches ATEM.cpp, unlike a #define in the sketch:
+#ifndef ATEM_maxME
+#define ATEM_maxME 2
+#endif
+
+	// Inputs the tally is kept for (max 64, see getProgramTallyMask()). Can be set with a compiler flag as well:
+#ifndef ATEM_maxInputs
+#define ATEM_maxInputs 48
+#endif
+#define ATEM_tallyBytes ((ATEM_maxInputs+7)/8)
+
+	// Bytes of command segments the command queue holds. Must fit the largest command, which is 8+76 bytes (see _sendPacketBufferCmdData())
+#define ATEM_commandQueueSize 84
+
+	// Command packets awaiting an acknowledge from the switcher, and how they are retransmitted (times in ms).
+	// Each slot costs 92 bytes of RAM (ATEM_OutstandingPacket), on top of the 84 bytes of the command queue.
+	// While all slots are in flight, further commands wait in the queue, see flushCommands():
+#define ATEM_maxOutstandingPackets 2
+#define ATEM_maxRetransmissions 4
+#define ATEM_initialRTO 200
+#define ATEM_minRTO 20
+#define ATEM_maxRTO 1000
+
+struct ATEM_OutstandingPacket {
+	uint16_t packetID;		// Local packet ID
+	uint8_t length;			// Bytes in data, 0 = slot is free
+	uint8_t retransmissions;
+	unsigned long sentTime;	// Time (millis) of the most recent transmission
+	uint8_t data[ATEM_commandQueueSize];	// The command segments
+};
+
+typedef void (*ATEMChangeCallback)(uint16_t changes);
+
 class ATEM
 {
   private:
@@ -53,27 +104,72 @@ class ATEM
 	uint8_t _packetBuffer[96];   			// Buffer for storing segments of the packets from ATEM and creating answer packets.
 	uint16_t _cmdLength;					// Used when parsing packets
 	uint16_t _cmdPointer;					// Used when parsing packets
+	uint16_t _spiTransactionsPerPacket;		// W5100 SPI transactions spent on the most recent packet from the switcher
+	uint16_t _spiTransactionsPerAnswer;		// W5100 SPI transactions spent on the most recent answer packet
+	uint8_t _answerPacket[12];				// Answer packet template, see _prepareAnswerPacket()
+	boolean _ackCoalescing;					// See ackCoalescing()
+	uint16_t _lastAnsweredPacketID;			// Highest remote packet ID answered
+	uint16_t _pendingAnswerPacketID;		// Remote packet ID of the answer held back by _coalesceAnswerPacket()
+	boolean _answerPending;
+	unsigned long _firstCoalescedTime;		// Time (millis) the first answer of the session was coalesced away, 0 = none yet
+	boolean _exactAnswers;					// The switcher retransmitted a packet only covered by a coalesced answer, see runLoop()
+	unsigned long _answerPacketsSaved;		// Statistics
+	unsigned long _packetsReceived;			// Statistics: Packets from the switcher, answer packets sent and packets which didn't parse
+	unsigned long _answerPacketsSent;
+	uint16_t _packetErrors;
+	boolean _eventDriven;					// See eventDriven()
+	unsigned long _runLoops;				// Statistics: runLoop() calls, those which found nothing to read and time slept (us)
+	unsigned long _idleRunLoops;
+	unsigned long _idleTime;
+	boolean _runLoopIdle;					// The last runLoop() found nothing to read, see idle()
 
 	uint16_t _localPacketIdCounter;  	// This is our counter for the command packages we might like to send to ATEM
+	uint8_t _commandQueue[ATEM_commandQueueSize];	// Command segments waiting for flushCommands()
+	uint8_t _commandQueueLength;		// Bytes used in _commandQueue
+	ATEM_OutstandingPacket _outstanding[ATEM_maxOutstandingPackets];	// Sent command packets not yet acknowledged
+	uint16_t _commandSRTT;				// Smoothed round trip time of command packets (ms)
+	boolean _commandRTTSampled;			// _commandSRTT holds a measurement
+	uint16_t _commandRTTVar;			// Round trip time variation (ms)
+	uint16_t _commandRTO;				// Retransmission timeout (ms)
+	uint16_t _commandRetransmissions;	// Statistics
+	uint16_t _commandPacketsLost;
 	boolean _hasInitialized;  			// If true, the initial reception of the ATEM memory has passed and we can begin to respond during the runLoop()
 	unsigned long _lastContact;			// Last time (millis) the switcher sent a packet to us.
 	unsigned long _isConnectingTime;	// Set to millis() after the connect() function was called - and it will force runLoop() to finish the connection session.
 
+	boolean _bootDumpMode;				// If set, every packet of the initial state dump is acknowledged and gaps are waited for, see bootDumpMode()
+	boolean _isReceivingBootDump;		// True from the handshake until _hasInitialized
+	uint32_t _bootDumpReceived;			// Bit n set if remote packet ID n+1 of the initial state dump has arrived
+	uint16_t _bootDumpEndPacketID;		// Remote packet ID of the first 12 byte packet, which ends the initial state dump
+	unsigned long _bootDumpEndTime;		// Time (millis) the end of the initial state dump was seen
+	uint8_t _bootDumpMissingPackets;	// Number of initial state packets that had to be retransmitted
+
+	uint16_t _changes;					// ATEM_CHANGED_* bits set by _parsePacket(), cleared by getChanges()
+	uint16_t _callbackChanges;			// ATEM_CHANGED_* bits not yet passed to _changeCallback
+	ATEMChangeCallback _changeCallback;	// See onChange()
+	unsigned long _packetTime;			// Time (micros) the packet being parsed arrived
+	unsigned long _lastChangeTime;		// See getLastChangeTime()
+
 		// Selected ATEM State values. Naming attempts to match the switchers own protocol names
 		// Set through _parsePacket() when the switcher sends state information
 		// Accessed through getter methods
 	uint8_t _ATEM_VidM;		// Video format used: 525i59.94 NTSC (0), 625i50 PAL (1), 720p50 (2), 720p59.94 (3), 1080i50 (4), 1080i59.94 (5)
-	uint16_t _ATEM_PrgI;		// Program input
-	uint16_t _ATEM_PrvI;		// Preview input
-	uint8_t _ATEM_TlIn[16];	// Inputs 1-16, bit 0 = Prg tally, bit 1 = Prv tally. Both can be set simultaneously.
-	boolean _ATEM_TrPr;		// Transition Preview: Is it on or not?
-	uint8_t _ATEM_TrSS_KeyersOnNextTransition;	// Bit 0: Background; Bit 1-4: Key 1-4
-	uint8_t _ATEM_TrSS_TransitionStyle;			// 0=MIX, 1=DIP, 2=WIPE, 3=DVE, 4=STING
-	boolean _ATEM_KeOn[4];	// Upstream Keyer 1-4 On state
+		// Per M/E (index 0 = M/E 1):
+	uint16_t _ATEM_PrgI[ATEM_maxME];		// Program input
+	uint16_t _ATEM_PrvI[ATEM_maxME];		// Preview input
+	uint8_t _ATEM_TlIn_program[ATEM_tallyBytes];	// Program tally, one bit per input: Bit 0 of byte 0 = input 1
+	uint8_t _ATEM_TlIn_preview[ATEM_tallyBytes];	// Preview tally, same layout
+	uint8_t _ATEM_TlIn_changed[ATEM_tallyBytes];	// Inputs whose tally changed since getTallyChangedMask(), same layout
+	boolean _ATEM_TrPr[ATEM_maxME];		// Transition Preview: Is it on or not?
+	uint8_t _ATEM_TrSS_KeyersOnNextTransition[ATEM_maxME];	// Bit 0: Background; Bit 1-4: Key 1-4
+	uint8_t _ATEM_TrSS_TransitionStyle[ATEM_maxME];			// 0=MIX, 1=DIP, 2=WIPE, 3=DVE, 4=STING
+	boolean _ATEM_KeOn[ATEM_maxME][4];	// Upstream Keyer 1-4 On state
 	boolean _ATEM_DskOn[2];	// Downstream Keyer 1-2 On state
 	boolean _ATEM_DskTie[2];	// Downstream Keyer Tie 1-2 On state
-	uint8_t _ATEM_TrPs_frameCount;	// Count down of frames in case of a transition (manual or auto)
-	uint16_t _ATEM_TrPs_position;	// Position from 0-1000 of the current transition in progress
+	uint8_t _ATEM_TrPs_frameCount[ATEM_maxME];	// Count down of frames in case of a transition (manual or auto)
+	bool _ATEM_TrPs_inTransition[ATEM_maxME];	// Set by the switcher from the start to the end of a transition
+	uint16_t _ATEM_TrPs_position[ATEM_maxME];	// Position from 0-10000 of the current transition in progress
+	unsigned long _ATEM_TrPs_endTime[ATEM_maxME];	// Predicted time (millis) the transition in progress is done, see getTransitionEndTime()
 	boolean _ATEM_FtbS_state;       // State of Fade To Black, 0 = off and 1 = activated
 	uint8_t _ATEM_FtbS_frameCount;	// Count down of frames in case of fade-to-black
 	uint8_t	_ATEM_FtbP_time;		// Transition time for Fade-to-black
@@ -85,6 +181,11 @@ class ATEM
 	uint16_t _ATEM_AMLv[2];	// Audio Meter Levels for a specific channel, see _ATEM_AMLv_channel
 	uint8_t _ATEM_AMLv_channel;		// The channel to read audio levels for.
 	uint8_t _ATEM_AudioChannelMode[13];	// Audio channel mode (ON=1, AFV=2, OFF=0/other)
+
+		// Protocol dialect, set by _setProtocolVersion() when the firmware version arrives:
+	boolean _ver42;					// Firmware 2.12 (software 4.2) or later
+	uint8_t _inputFieldOffset;		// Offset of the input number word in PrgI, PrvI, AuxS, CPgI and CPvI: 0 before 4.2, 2 from 4.2
+	uint8_t _inputFieldHighMask;	// Mask for the high byte of that word: 0x00 before 4.2 (it's not part of the input number), 0xFF from 4.2
 	
 	
   public:
@@ -97,17 +198,37 @@ class ATEM
     void begin(const IPAddress ip, const uint16_t localPort);
     void connect();
     void runLoop();
+	bool flushCommands();
 	bool isConnectionTimedOut();
+	bool isConnected() const;
 	void delay(const unsigned int delayTimeMillis);
+	void idle();
 
   private:
 	void _parsePacket(uint16_t packetLength);
 	bool _readToPacketBuffer();
 	bool _readToPacketBuffer(uint8_t maxBytes);
 	void _sendAnswerPacket(uint16_t remotePacketID);
+	void _prepareAnswerPacket();
+	void _coalesceAnswerPacket(uint16_t remotePacketID);
+	void _flushAnswerPacket();
+	void _notifyChanges();
 	void _sendCommandPacket(const char cmd[4], uint8_t commandBytes[16], uint8_t cmdBytes);
 	void _wipeCleanPacketBuffer();
 	void _sendPacketBufferCmdData(const char cmd[4], uint8_t cmdBytes);
+	void _queueCommand(const char cmd[4], const uint8_t *cmdData, uint8_t cmdBytes);
+	void _sendCommandPacketSlot(uint8_t slot);
+	void _ackCommandPackets(uint16_t localPacketID);
+	void _retransmitCommandPackets();
+	bool _trackBootDumpPacket(uint16_t remotePacketID);
+	bool _isBootDumpComplete();
+	uint32_t _bootDumpGaps();
+	void _changed(uint16_t changes);
+	uint64_t _tallyMask(const uint8_t *bitPlane);
+	void _setProtocolVersion();
+	uint16_t _readInputField();
+	void _writeInputField(uint16_t inputNumber);
+	uint16_t _frameDuration();
 
   public:
 
@@ -116,7 +237,29 @@ class ATEM
  ********************************/
   	void serialOutput(boolean serialOutput);
 	bool hasInitialized();
+	void bootDumpMode(boolean bootDumpMode);
+	bool isReceivingBootDump();
+	uint8_t getBootDumpMissingPackets();
+	void ackCoalescing(boolean ackCoalescing);
+	unsigned long getAnswerPacketsSaved();
+	unsigned long getPacketsReceived();
+	unsigned long getAnswerPacketsSent();
+	uint16_t getPacketErrors();
+	void eventDriven(boolean eventDriven);
+	unsigned long getRunLoops();
+	unsigned long getIdleRunLoops();
+	unsigned long getIdleTime();
+	uint16_t getChanges(uint16_t mask = 0xFFFF);
+	void onChange(ATEMChangeCallback callback);
+	unsigned long getLastChangeTime();
 	uint16_t getATEM_lastRemotePacketId();
+	uint8_t getSessionID();
+	uint16_t getCommandRetransmissions();
+	uint16_t getCommandPacketsLost();
+	uint16_t getCommandRTT();
+	uint16_t getCommandRTO();
+	uint16_t getSPITransactionsPerPacket();
+	uint16_t getSPITransactionsPerAnswer();
 	uint8_t getATEMmodel();
 
 /********************************
@@ -124,16 +267,23 @@ class ATEM
 * Returns the most recent information we've 
 * got about the switchers state
  ********************************/
-	uint16_t getProgramInput();
-	uint16_t getPreviewInput();
+	uint16_t getProgramInput(uint8_t mE = 0);
+	uint16_t getPreviewInput(uint8_t mE = 0);
 	boolean getProgramTally(uint8_t inputNumber);
 	boolean getPreviewTally(uint8_t inputNumber);
-	boolean getUpstreamKeyerStatus(uint8_t inputNumber);
-	boolean getUpstreamKeyerOnNextTransitionStatus(uint8_t inputNumber);
+	uint64_t getProgramTallyMask();
+	uint64_t getPreviewTallyMask();
+	uint64_t getTallyChangedMask();
+	boolean getUpstreamKeyerStatus(uint8_t inputNumber, uint8_t mE = 0);
+	boolean getUpstreamKeyerOnNextTransitionStatus(uint8_t inputNumber, uint8_t mE = 0);
 	boolean getDownstreamKeyerStatus(uint8_t inputNumber);
-	uint16_t getTransitionPosition();
-	bool getTransitionPreview();
-	uint8_t getTransitionType();
+	uint16_t getTransitionPosition(uint8_t mE = 0);
+	uint8_t getTransitionFramesRemaining(uint8_t mE = 0);
+	bool isInTransition(uint8_t mE = 0);
+	unsigned long getTransitionEndTime(uint8_t mE = 0);
+	bool isOnAir(uint16_t inputNumber, uint8_t mE = 0);
+	bool getTransitionPreview(uint8_t mE = 0);
+	uint8_t getTransitionType(uint8_t mE = 0);
 	uint8_t getTransitionMixTime();
     boolean getFadeToBlackState();
 	uint8_t getFadeToBlackFrameCount();
@@ -150,19 +300,19 @@ class ATEM
  * ATEM Switcher Change methods
  * Asks the switcher to changes something
  ********************************/
-	void changeProgramInput(uint16_t inputNumber);
-	void changePreviewInput(uint16_t inputNumber);
-	void doCut();
-	void doAuto();
+	void changeProgramInput(uint16_t inputNumber, uint8_t mE = 0);
+	void changePreviewInput(uint16_t inputNumber, uint8_t mE = 0);
+	void doCut(uint8_t mE = 0);
+	void doAuto(uint8_t mE = 0);
 	void fadeToBlackActivate();
-	void changeTransitionPosition(word value);
-	void changeTransitionPositionDone();
-	void changeTransitionPreview(bool state);
-	void changeTransitionType(uint8_t type);
+	void changeTransitionPosition(word value, uint8_t mE = 0);
+	void changeTransitionPositionDone(uint8_t mE = 0);
+	void changeTransitionPreview(bool state, uint8_t mE = 0);
+	void changeTransitionType(uint8_t type, uint8_t mE = 0);
 	void changeTransitionMixTime(uint8_t frames);
 	void changeFadeToBlackTime(uint8_t frames);
-	void changeUpstreamKeyOn(uint8_t keyer, bool state);
-	void changeUpstreamKeyNextTransition(uint8_t keyer, bool state);
+	void changeUpstreamKeyOn(uint8_t keyer, bool state, uint8_t mE = 0);
+	void changeUpstreamKeyNextTransition(uint8_t keyer, bool state, uint8_t mE = 0);
 	void changeDownstreamKeyOn(uint8_t keyer, bool state);
 	void changeDownstreamKeyTie(uint8_t keyer, bool state);	
 	void doAutoDownstreamKeyer(uint8_t keyer);
@@ -178,14 +328,14 @@ class ATEM
 	void changeDVEMaskTemp(unsigned long top,unsigned long bottom,unsigned long left,unsigned long right);
 	void changeDVEBorder(bool enableBorder);
 		
-	void changeUpstreamKeyFillSource(uint8_t keyer, uint16_t inputNumber);
-	void changeUpstreamKeyBlending(uint8_t keyer, bool preMultipliedAlpha, uint16_t clip, uint16_t gain, bool invKey);	
+	void changeUpstreamKeyFillSource(uint8_t keyer, uint16_t inputNumber, uint8_t mE = 0);
+	void changeUpstreamKeyBlending(uint8_t keyer, bool preMultipliedAlpha, uint16_t clip, uint16_t gain, bool invKey, uint8_t mE = 0);	
 	void changeDownstreamKeyBlending(uint8_t keyer, bool preMultipliedAlpha, uint16_t clip, uint16_t gain, bool invKey);
 	void changeDownstreamKeyFillSource(uint8_t keyer, uint16_t inputNumber);
 	void changeDownstreamKeyKeySource(uint8_t keyer, uint16_t inputNumber);
 	void changeDVESettingsTemp_RunKeyFrame(uint8_t runType);
 	void changeDVESettingsTemp_Rate(uint8_t rateFrames);
-	void changeKeyerMask(uint16_t topMask, uint16_t bottomMask, uint16_t leftMask, uint16_t rightMask);
+	void changeKeyerMask(uint16_t topMask, uint16_t bottomMask, uint16_t leftMask, uint16_t rightMask, uint8_t mE = 0);
 	void changeDownstreamKeyMask(uint8_t keyer, uint16_t topMask, uint16_t bottomMask, uint16_t leftMask, uint16_t rightMask);
 	
 	void changeAudioChannelMode(uint16_t channelNumber, uint8_t mode);
@@ -0,0 +1,99 @@
+/*
+Copyright 2012 Kasper Skårhøj, SKAARHOJ, kasperskaarhoj@gmail.com
+
+This file is part of the ATEM library for Arduino
+
+The ATEM library is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+The ATEM library is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the ATEM library. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+#include "StageTimer.h"
+
+#if STAGE_TIMER
+
+#ifndef __arm__
+	#include <avr/pgmspace.h>
+#endif
+
+static const char stageName0[] PROGMEM = "runLoop";
+static const char stageName1[] PROGMEM = "parsePacket";
+static const char stageName2[] PROGMEM = "http";
+static const char stageName3[] PROGMEM = "radioSend";
+static const char stageName4[] PROGMEM = "reset";
+static const char stageName5[] PROGMEM = "tallyLatency";
+static const char * const stageNames[STAGE_COUNT] PROGMEM = { stageName0, stageName1, stageName2, stageName3, stageName4, stageName5 };
+
+StageTimer StageTimers;
+
+StageTimer::StageTimer()	{
+	reset();
+}
+
+/**
+ * Adds a time (us) to the statistics of a stage
+ */
+void StageTimer::record(uint8_t stage, unsigned long time)	{
+	Stage &s = _stages[stage];
+
+	s.count++;
+	s.total += time;
+	if (time < s.min)	s.min = time;
+	if (time > s.max)	s.max = time;
+
+	uint8_t bucket = 0;
+	for (unsigned long limit = 32; time >= limit && bucket < STAGE_TIMER_BUCKETS-1; limit <<= 1)	{
+		bucket++;
+	}
+	if (s.histogram[bucket] == 0xFFFF)	{
+		for (uint8_t i = 0; i < STAGE_TIMER_BUCKETS; i++)	{
+			s.histogram[i] >>= 1;
+		}
+	}
+	s.histogram[bucket]++;
+}
+
+void StageTimer::reset()	{
+	memset(_stages, 0, sizeof(_stages));
+	for (uint8_t i = 0; i < STAGE_COUNT; i++)	{
+		_stages[i].min = 0xFFFFFFFF;
+	}
+}
+
+/**
+ * Prints a line per stage: Count, min/avg/max (us) and the histogram buckets
+ */
+void StageTimer::print(Print &out)	{
+	for (uint8_t i = 0; i < STAGE_COUNT; i++)	{
+		Stage &s = _stages[i];
+		out.print((const __FlashStringHelper *)pgm_read_word(&stageNames[i]));
+		out.print(F(" n="));
+		out.print(s.count);
+		if (s.count > 0)	{
+			out.print(F(" min="));
+			out.print(s.min);
+			out.print(F(" avg="));
+			out.print(s.total / s.count);
+			out.print(F(" max="));
+			out.print(s.max);
+		}
+		out.print(F(" hist="));
+		for (uint8_t b = 0; b < STAGE_TIMER_BUCKETS; b++)	{
+			if (b > 0)	out.print(',');
+			out.print(s.histogram[b]);
+		}
+		out.println();
+	}
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+Copyright 2012 Kasper Skårhøj, SKAARHOJ, kasperskaarhoj@gmail.com
+
+This file is part of the ATEM library for Arduino
+
+The ATEM library is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+The ATEM library is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the ATEM library. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+#ifndef StageTimer_h
+#define StageTimer_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+	// Set to 0 to compile the timing away: STAGE_BEGIN() and STAGE_END() turn into nothing and no RAM is used.
+	// Can be set with a compiler flag (-DSTAGE_TIMER=0), which also reaches the library sources, unlike a #define in the sketch:
+#ifndef STAGE_TIMER
+#define STAGE_TIMER 1
+#endif
+
+	// Stages timed, each takes 40 bytes of RAM:
+#define STAGE_RUNLOOP		0	// ATEM::runLoop()
+#define STAGE_PARSE_PACKET	1	// ATEM::_parsePacket()
+#define STAGE_HTTP			2	// Setup page
+#define STAGE_RADIO_SEND	3	// Sending a radio frame
+#define STAGE_RESET			4	// Reset button
+#define STAGE_TALLY_LATENCY	5	// Not a loop stage: Switcher packet to receiver LED, measured with radio echoes
+#define STAGE_COUNT			6
+
+	// Log2 histogram: Bucket 0 holds times below 32 us, bucket n times from 16<<n us, the last one everything from 32 ms
+#define STAGE_TIMER_BUCKETS	12
+
+#if STAGE_TIMER
+	#define STAGE_BEGIN(stage)	unsigned long _stageStart##stage = micros()
+	#define STAGE_END(stage)	StageTimers.record(stage, micros() - _stageStart##stage)
+#else
+	#define STAGE_BEGIN(stage)
+	#define STAGE_END(stage)
+#endif
+
+
+class StageTimer
+{
+  private:
+	struct Stage {
+		unsigned long count;
+		unsigned long total;	// us, wraps around after 71 minutes of time spent in the stage
+		unsigned long min;
+		unsigned long max;
+		uint16_t histogram[STAGE_TIMER_BUCKETS];	// Halved altogether when a bucket is full, which keeps the shape
+	};
+	Stage _stages[STAGE_COUNT];
+
+  public:
+	StageTimer();
+	void record(uint8_t stage, unsigned long time);
+	void reset();
+	void print(Print &out);
+};
+
+#if STAGE_TIMER
+extern StageTimer StageTimers;
+#endif
+
+#endif
@@ -0,0 +1,521 @@
+/*****************
+ * Example: ATEM Switcher Simulator
+ * Stands in for an ATEM switcher, so the ATEM library (and the tally transmitter) can be load tested without a real switcher.
+ * Run it on a second Arduino with Ethernet and give its IP address to the client as the switcher IP.
+ *
+ * The simulator answers the connect handshake, streams a boot dump of configurable size, asks for an ACK on every packet,
+ * retransmits packets which are not acknowledged in time and cuts between inputs at a configurable rate.
+ * Every 5 seconds it reports on the Serial monitor (at 115200 baud):
+ * - Cuts sent, retransmissions and dropped cuts (not acknowledged after SIM_MAX_RETRIES retransmissions)
+ * - ACK packets received. A client with ACK coalescing sends fewer than one per packet if SIM_CUMULATIVE_ACK is set.
+ * - Latency from sending a cut to receiving the ACK for it (50/90/99 percentiles and max). The client answers
+ *   after the packet is parsed, so this is the time until the getters return the new inputs, plus the network round trip.
+ * Send a number followed by a newline to change the cut rate (cuts per second, 0 = stop cutting).
+ * The simulator also builds for a PC, where it runs against the ATEM class over loopback, see extras/host/README.
+ */
+/*****************
+ * TO MAKE THIS EXAMPLE WORK:
+ * - You must have an Arduino with Ethernet Shield (or compatible such as "Arduino Ethernet", http://arduino.cc/en/Main/ArduinoBoardEthernet)
+ * - You must make specific set ups in the below lines where the comment "// SETUP" is found!
+ */
+
+
+
+// Including libraries:
+#include <SPI.h>         // needed for Arduino versions later than 0018
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+
+
+// MAC address and IP address for this *particular* Arduino / Ethernet Shield!
+byte mac[] = {
+  0x90, 0xA2, 0xDA, 0x0D, 0x6B, 0xBA };      // <= SETUP!  MAC address of the Arduino
+IPAddress ip(192, 168, 10, 240);              // <= SETUP!  IP address of the simulated switcher
+
+
+#define SIM_INPUTS 8				// Number of inputs cut between (1-SIM_INPUTS)
+#define SIM_CUTS_PER_SECOND 10		// Initial cut rate, can be changed from the Serial monitor
+#define SIM_BOOT_PACKETS 12			// Number of packets in the boot dump (max 24). A real switcher sends 10-20 kbytes.
+#define SIM_BOOT_PACKET_SIZE 1300	// Size of each boot dump packet (max 1400)
+#define SIM_VER_M 2					// Firmware version reported in _ver. 2.12 and later uses 16 bit input numbers
+#define SIM_VER_L 15
+#define SIM_RTO 200					// Milliseconds before an unacknowledged packet is retransmitted (grows with each retransmission)
+#define SIM_MAX_RETRIES 5			// Retransmissions before a packet is given up
+#ifndef SIM_CUMULATIVE_ACK
+#define SIM_CUMULATIVE_ACK 0		// If 0, an ACK only acknowledges the exact packet ID: A coalescing client sees a few
+									// retransmissions and then answers every packet. If 1, it also acknowledges all earlier
+									// outstanding packets, which would hide boot dump packets the client never received.
+#endif
+#define SIM_PING_INTERVAL 500		// A packet is sent at least this often (ms), to keep the client connection alive
+#define SIM_CLIENT_TIMEOUT 5000		// The session is ended if the client has not been heard from in this time (ms)
+#define SIM_REPORT_INTERVAL 5000
+
+#define SIM_OUTSTANDING 32			// Packets which may await an ACK at the same time. Must be a power of two.
+#define SIM_LATENCY_BUCKETS 100		// Latency histogram has 1 ms buckets, the last one holds everything above
+
+// Kinds of packets sent:
+#define SIM_BOOT 1			// Part of the boot dump, contents given by the packet ID
+#define SIM_BOOT_END 2		// The 12 byte packet which ends the boot dump
+#define SIM_PING 3			// 12 byte keep alive
+#define SIM_STATE 4			// Program/Preview change
+
+struct simPacket {
+  uint16_t id;				// 0 = slot is free
+  uint8_t kind;
+  uint8_t retries;
+  uint16_t program;
+  uint16_t preview;
+  unsigned long sentAt;		// Time of first transmission
+};
+
+EthernetUDP Udp;
+
+IPAddress clientIP;
+uint16_t clientPort;
+uint8_t sessionID = 0;
+boolean connected = false;
+unsigned long lastClientContact;
+unsigned long lastSent;
+
+uint16_t packetIdCounter;
+simPacket outstanding[SIM_OUTSTANDING];
+
+uint16_t program = 1;
+uint16_t preview = 2;
+uint16_t cutsPerSecond = SIM_CUTS_PER_SECOND;
+unsigned long lastCut;
+
+// Statistics, reset with every report:
+unsigned long statCuts;
+unsigned long statRetransmits;
+unsigned long statDropped;
+unsigned long statBootRetransmits;
+unsigned long statCommands;
+unsigned long statAcks;
+uint16_t latency[SIM_LATENCY_BUCKETS+1];
+uint16_t latencyMax;
+unsigned long lastReport;
+
+uint8_t packetBuffer[64];
+
+
+
+// No-cost stream operator as described at
+// http://arduiniana.org/libraries/streaming/
+template<class T>
+inline Print &operator <<(Print &obj, T arg)
+{
+  obj.print(arg);
+  return obj;
+}
+
+
+
+void setup() {
+
+  // Start the Ethernet, Serial (debugging) and UDP:
+  Ethernet.begin(mac,ip);
+  Serial.begin(115200);
+  Serial << F("\n- - - - - - - -\nATEM Switcher Simulator at ") << ip << F(", ") << cutsPerSecond << F(" cuts/sec\n");
+
+  Udp.begin(9910);
+  lastReport = millis();
+}
+
+void loop() {
+  receivePackets();
+
+  if (connected)  {
+    if ((unsigned long)millis() - lastClientContact > SIM_CLIENT_TIMEOUT)  {
+      Serial << F("Client timed out\n");
+      connected = false;
+    } else {
+      retransmitPackets();
+
+      // While the window is full, cuts and pings wait: Giving up the oldest packet could be a boot dump packet
+      // which the client still needs.
+      if (cutsPerSecond > 0 && (unsigned long)millis() - lastCut >= 1000 / cutsPerSecond && !windowFull())  {
+        lastCut = millis();
+        cut();
+      }
+      if ((unsigned long)millis() - lastSent >= SIM_PING_INTERVAL && !windowFull())  {
+        queuePacket(SIM_PING);
+      }
+    }
+  }
+
+  readCutRate();
+
+  if ((unsigned long)millis() - lastReport >= SIM_REPORT_INTERVAL)  {
+    lastReport = millis();
+    report();
+  }
+}
+
+
+
+/**
+ * Reads all packets from the client: Connect hellos, ACKs and commands
+ */
+void receivePackets()  {
+  uint16_t packetSize;
+  while ((packetSize = Udp.parsePacket()) >= 12)  {
+    Udp.read(packetBuffer, 12);
+    uint8_t flags = packetBuffer[0] & B11111000;
+
+    if (flags & 0x10)  {  // Connect hello, starts a new session
+      clientIP = Udp.remoteIP();
+      clientPort = Udp.remotePort();
+      startSession();
+    } else if (connected)  {
+      lastClientContact = millis();
+      if (flags & 0x80)  {  // ACK of one of our packets
+        acknowledge(word(packetBuffer[4], packetBuffer[5]));
+      }
+      if ((flags & 0x08) && packetSize > 12)  {  // A command, which wants an ACK back
+        uint16_t remotePacketID = word(packetBuffer[10], packetBuffer[11]);
+        runCommands(packetSize);
+        sendAnswerPacket(remotePacketID);
+      }
+    }
+    Udp.flush();
+  }
+}
+
+/**
+ * Answers a connect hello and streams the boot dump
+ */
+void startSession()  {
+  sessionID++;
+  uint8_t helloAnswer[] = {
+    0x10, 0x14, 0x53, 0xAB, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, sessionID, 0x00, 0x00, 0x00, 0x00 };
+  Udp.beginPacket(clientIP, clientPort);
+  Udp.write(helloAnswer, 20);
+  Udp.endPacket();
+
+  // The client answers the hello, but there is no need to wait for it: A real switcher also sends the boot dump right after.
+  memset(outstanding, 0, sizeof(outstanding));
+  packetIdCounter = 0;
+  connected = true;
+  lastClientContact = millis();
+  lastCut = millis();
+
+  for (uint8_t i = 0; i < SIM_BOOT_PACKETS; i++)  {
+    queuePacket(SIM_BOOT);
+  }
+  queuePacket(SIM_BOOT_END);
+
+  Serial << F("Client ") << clientIP << F(":") << clientPort << F(" connected, session ") << sessionID << F("\n");
+}
+
+/**
+ * Cuts: Preview goes to program and the next input is put on preview
+ */
+void cut()  {
+  uint16_t newProgram = preview;
+  preview = preview % SIM_INPUTS + 1;
+  if (preview == newProgram)  {
+    preview = preview % SIM_INPUTS + 1;
+  }
+  program = newProgram;
+
+  queuePacket(SIM_STATE);
+  statCuts++;
+}
+
+/**
+ * Applies CPgI, CPvI and DCut from the client and sends back the new state
+ */
+void runCommands(uint16_t packetSize)  {
+  uint16_t indexPointer = 12;
+  boolean changed = false;
+
+  while (indexPointer + 8 <= packetSize)  {
+    Udp.read(packetBuffer, 8);
+    uint16_t cmdLength = word(packetBuffer[0], packetBuffer[1]);
+    if (cmdLength < 8)  {
+      break;
+    }
+    uint8_t payloadLength = min(cmdLength - 8, (int)sizeof(packetBuffer));
+    char cmd[5] = { (char)packetBuffer[4], (char)packetBuffer[5], (char)packetBuffer[6], (char)packetBuffer[7], 0 };
+    Udp.read(packetBuffer, payloadLength);
+    uint16_t input = SIM_VER_M > 2 || SIM_VER_L >= 12 ? word(packetBuffer[2], packetBuffer[3]) : packetBuffer[1];
+
+    if (!strcmp(cmd, "CPgI"))  {
+      program = input;
+      changed = true;
+    } else if (!strcmp(cmd, "CPvI"))  {
+      preview = input;
+      changed = true;
+    } else if (!strcmp(cmd, "DCut"))  {
+      uint16_t newProgram = preview;
+      preview = program;
+      program = newProgram;
+      changed = true;
+    }
+    Udp.skip(cmdLength - 8 - payloadLength);
+    indexPointer += cmdLength;
+    statCommands++;
+  }
+
+  if (changed)  {
+    queuePacket(SIM_STATE);
+  }
+}
+
+
+
+/**
+ * Returns true if the slot of the next packet ID still holds a packet waiting for its ACK
+ */
+boolean windowFull()  {
+  uint16_t nextID = packetIdCounter + 1;
+  return outstanding[(nextID ? nextID : 1) & (SIM_OUTSTANDING-1)].id != 0;
+}
+
+/**
+ * Sends a new packet which asks for an ACK, and keeps it for retransmission
+ */
+void queuePacket(uint8_t kind)  {
+  packetIdCounter++;
+  if (packetIdCounter == 0)  {
+    packetIdCounter = 1;
+  }
+
+  uint8_t slot = packetIdCounter & (SIM_OUTSTANDING-1);
+  simPacket &p = outstanding[slot];
+  if (p.id != 0)  {  // Window is full, the oldest packet is given up
+    dropPacket(slot);
+  }
+  p.id = packetIdCounter;
+  p.kind = kind;
+  p.retries = 0;
+  p.program = program;
+  p.preview = preview;
+  p.sentAt = millis();
+
+  sendPacket(slot, false);
+}
+
+void retransmitPackets()  {
+  for (uint8_t i = 0; i < SIM_OUTSTANDING; i++)  {
+    simPacket &p = outstanding[i];
+    if (p.id != 0 && (unsigned long)millis() - p.sentAt >= (unsigned long)SIM_RTO * (p.retries + 1))  {
+      if (p.retries == SIM_MAX_RETRIES)  {
+        dropPacket(i);
+      } else {
+        p.retries++;
+        if (p.kind == SIM_STATE)  {
+          statRetransmits++;
+        } else if (p.kind == SIM_BOOT)  {
+          statBootRetransmits++;
+        }
+        sendPacket(i, true);
+      }
+    }
+  }
+}
+
+void dropPacket(uint8_t slot)  {
+  simPacket &p = outstanding[slot];
+  if (p.kind == SIM_STATE)  {
+    statDropped++;
+  }
+  p.id = 0;
+}
+
+void acknowledge(uint16_t id)  {
+  statAcks++;
+  if (SIM_CUMULATIVE_ACK)  {
+    for (uint8_t i = 0; i < SIM_OUTSTANDING; i++)  {
+      if (outstanding[i].id != 0 && (int16_t)(id - outstanding[i].id) >= 0)  {
+        acknowledgeSlot(i);
+      }
+    }
+  } else if (outstanding[id & (SIM_OUTSTANDING-1)].id == id && id != 0)  {
+    acknowledgeSlot(id & (SIM_OUTSTANDING-1));
+  }
+}
+
+void acknowledgeSlot(uint8_t slot)  {
+  simPacket &p = outstanding[slot];
+  if (p.kind == SIM_STATE)  {
+    unsigned long ms = (unsigned long)millis() - p.sentAt;
+    latency[ms < SIM_LATENCY_BUCKETS ? ms : SIM_LATENCY_BUCKETS]++;
+    if (ms > latencyMax)  {
+      latencyMax = ms > 0xFFFF ? 0xFFFF : ms;
+    }
+  }
+  p.id = 0;
+}
+
+/**
+ * Writes a packet to the client. The contents are generated from the packet kind and stored state, so nothing but
+ * the small simPacket record has to be kept for retransmissions.
+ */
+void sendPacket(uint8_t slot, boolean retransmission)  {
+  simPacket &p = outstanding[slot];
+  uint16_t length = 12;
+  if (p.kind == SIM_BOOT)  {
+    length = SIM_BOOT_PACKET_SIZE;
+  } else if (p.kind == SIM_STATE)  {
+    length = 12 + stateLength();
+  }
+
+  uint8_t header[12];
+  memset(header, 0, 12);
+  header[0] = B00001000 | (retransmission ? B00100000 : 0) | (length >> 8);
+  header[1] = length & 0xFF;
+  header[2] = 0x80;
+  header[3] = sessionID;
+  header[10] = p.id >> 8;
+  header[11] = p.id & 0xFF;
+
+  Udp.beginPacket(clientIP, clientPort);
+  Udp.write(header, 12);
+  if (p.kind == SIM_BOOT)  {
+    writeBootDump(slot);
+  } else if (p.kind == SIM_STATE)  {
+    writeState(p.program, p.preview);
+  }
+  Udp.endPacket();
+
+  lastSent = millis();
+}
+
+/**
+ * The first boot dump packet has version and inputs, the rest of the dump is filler the client does not know
+ */
+void writeBootDump(uint8_t slot)  {
+  simPacket &p = outstanding[slot];
+  uint16_t length = 12;
+  if (p.id == 1)  {
+    uint8_t ver[] = { 0, SIM_VER_M, 0, SIM_VER_L };
+    writeSegment("_ver", ver, 4);
+    writeState(p.program, p.preview);
+    length += 12 + stateLength();
+  }
+
+  memset(packetBuffer, 0, sizeof(packetBuffer));
+  while (length < SIM_BOOT_PACKET_SIZE)  {
+    uint16_t segmentLength = SIM_BOOT_PACKET_SIZE - length;
+    if (segmentLength > 200 + 8)  {  // Leaves room for the header of at least one more segment
+      segmentLength = 200;
+    }
+    writeSegment("_Sim", NULL, segmentLength - 8);
+    length += segmentLength;
+  }
+}
+
+uint16_t stateLength()  {
+  return 12 + 12 + 8 + 2 + SIM_INPUTS;
+}
+
+void writeState(uint16_t program, uint16_t preview)  {
+  // M/E, then the input in byte 1 (before 2.12) or in bytes 2-3
+  uint8_t prgI[4] = { 0, 0, 0, 0 };
+  uint8_t prvI[4] = { 0, 0, 0, 0 };
+  if (SIM_VER_M > 2 || SIM_VER_L >= 12)  {
+    prgI[2] = highByte(program);
+    prgI[3] = lowByte(program);
+    prvI[2] = highByte(preview);
+    prvI[3] = lowByte(preview);
+  } else {
+    prgI[1] = lowByte(program);
+    prvI[1] = lowByte(preview);
+  }
+  writeSegment("PrgI", prgI, 4);
+  writeSegment("PrvI", prvI, 4);
+
+  uint8_t tlIn[2 + SIM_INPUTS];
+  memset(tlIn, 0, sizeof(tlIn));
+  tlIn[1] = SIM_INPUTS;
+  if (program >= 1 && program <= SIM_INPUTS)  tlIn[2 + program - 1] |= 1;
+  if (preview >= 1 && preview <= SIM_INPUTS)  tlIn[2 + preview - 1] |= 2;
+  writeSegment("TlIn", tlIn, sizeof(tlIn));
+}
+
+/**
+ * Writes a segment: Length word, two unused bytes, four character command and the data.
+ * If data is NULL, zeros are written.
+ */
+void writeSegment(const char cmd[4], const uint8_t *data, uint16_t dataLength)  {
+  uint8_t segmentHeader[8];
+  segmentHeader[0] = highByte(8 + dataLength);
+  segmentHeader[1] = lowByte(8 + dataLength);
+  segmentHeader[2] = 0;
+  segmentHeader[3] = 0;
+  memcpy(segmentHeader + 4, cmd, 4);
+  Udp.write(segmentHeader, 8);
+  if (data != NULL)  {
+    Udp.write(data, dataLength);
+  } else {
+    while (dataLength > 0)  {
+      uint8_t chunk = min(dataLength, (int)sizeof(packetBuffer));
+      Udp.write(packetBuffer, chunk);
+      dataLength -= chunk;
+    }
+  }
+}
+
+void sendAnswerPacket(uint16_t remotePacketID)  {
+  uint8_t answer[12];
+  memset(answer, 0, 12);
+  answer[0] = B10000000;
+  answer[1] = 12;
+  answer[2] = 0x80;
+  answer[3] = sessionID;
+  answer[4] = remotePacketID >> 8;
+  answer[5] = remotePacketID & 0xFF;
+  Udp.beginPacket(clientIP, clientPort);
+  Udp.write(answer, 12);
+  Udp.endPacket();
+}
+
+
+
+void readCutRate()  {
+  if (Serial.available())  {
+    cutsPerSecond = Serial.parseInt();
+    Serial << F("Cut rate: ") << cutsPerSecond << F(" cuts/sec\n");
+  }
+}
+
+/**
+ * Prints statistics for the last report interval and resets them
+ */
+void report()  {
+  unsigned long acked = 0;
+  for (uint8_t i = 0; i <= SIM_LATENCY_BUCKETS; i++)  {
+    acked += latency[i];
+  }
+
+  Serial << F("Cuts: ") << statCuts << F(", acked: ") << acked << F(", retransmits: ") << statRetransmits << F(", dropped: ") << statDropped;
+  Serial << F(", commands: ") << statCommands << F(", boot dump retransmits: ") << statBootRetransmits << F(", ACK packets: ") << statAcks << F("\n");
+  if (acked > 0)  {
+    Serial << F("ACK latency ms p50: ") << percentile(acked, 50) << F(", p90: ") << percentile(acked, 90) << F(", p99: ") << percentile(acked, 99) << F(", max: ") << latencyMax << F("\n");
+  }
+
+  statCuts = 0;
+  statRetransmits = 0;
+  statDropped = 0;
+  statBootRetransmits = 0;
+  statCommands = 0;
+  statAcks = 0;
+  memset(latency, 0, sizeof(latency));
+  latencyMax = 0;
+}
+
+/**
+ * Returns the latency (ms) which the given percentage of ACKs came in under. SIM_LATENCY_BUCKETS means that much or more.
+ */
+uint8_t percentile(unsigned long acked, uint8_t percent)  {
+  unsigned long count = 0;
+  for (uint8_t i = 0; i < SIM_LATENCY_BUCKETS; i++)  {
+    count += latency[i];
+    if (count * 100 >= acked * percent)  {
+      return i;
+    }
+  }
+  return SIM_LATENCY_BUCKETS;
+}
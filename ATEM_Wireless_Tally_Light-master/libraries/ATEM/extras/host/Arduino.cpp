@@ -0,0 +1,79 @@
+/*
+	Host stand-in for the Arduino core: time, Serial and the objects the libraries expect
+*/
+
+#include "Arduino.h"
+#include "Ethernet.h"
+#include "EEPROM.h"
+#include "utility/w5100.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+HostSerial Serial;
+EthernetClass Ethernet;
+W5100Class W5100;
+EEPROMClass EEPROM;
+
+static unsigned long long monotonicMicros()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+	// The clock starts at 1 s, as a sketch has been running for a while when it connects: the ATEM class takes a
+	// time of 0 for "not connecting"
+static unsigned long long startMicros = monotonicMicros() - 1000000ULL;
+
+	// Both wrap around at 32 bits, as on the Arduino
+unsigned long millis()
+{
+	return (uint32_t)((monotonicMicros() - startMicros) / 1000);
+}
+
+unsigned long micros()
+{
+	return (uint32_t)(monotonicMicros() - startMicros);
+}
+
+void delay(unsigned long ms)
+{
+	usleep(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	usleep(us);
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+	if (c != '\r') putchar(c);
+	written++;
+	return 1;
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		write(buffer[i]);
+	}
+	return size;
+}
+
+EEPROMClass::EEPROMClass()
+{
+	memset(_memory, 0xFF, sizeof(_memory));
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+	return address >= 0 && address < HOST_EEPROM_SIZE ? _memory[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+	if (address >= 0 && address < HOST_EEPROM_SIZE) _memory[address] = value;
+}
@@ -0,0 +1,85 @@
+/*
+	Host (Linux/POSIX) stand-in for the parts of the Arduino core the ATEM library and the switcher simulator use,
+	so they can be compiled and run on a PC, see README.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <avr/pgmspace.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef unsigned int word;
+
+	// The binary constants of the Arduino core (binary.h) which the library uses:
+#define B1 1
+#define B100 4
+#define B1111 15
+#define B11110 30
+#define B11111 31
+#define B00000111 7
+#define B00001000 8
+#define B00010000 16
+#define B00100000 32
+#define B10000000 128
+#define B11111000 248
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+inline word makeWord(uint8_t h, uint8_t l) { return (h << 8) | l; }
+#define word(...) makeWord(__VA_ARGS__)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+	// Pins do nothing and read LOW
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return LOW; }
+inline void analogWrite(uint8_t, int) {}
+
+#include "Print.h"
+#include "IPAddress.h"
+
+	// Serial prints to stdout and counts what it printed; nothing is ever received
+class HostSerial : public Print
+{
+  public:
+	unsigned long written;	// Bytes printed
+	void begin(unsigned long) {}
+	int available() { return 0; }
+	int read() { return -1; }
+	long parseInt() { return 0; }
+	virtual size_t write(uint8_t c);
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+};
+
+extern HostSerial Serial;
+
+#endif
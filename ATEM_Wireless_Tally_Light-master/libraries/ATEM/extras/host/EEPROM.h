@@ -0,0 +1,24 @@
+/*
+	Host stand-in for the EEPROM library: 1 KB of memory, erased (0xFF) at the start, as on the ATmega328
+*/
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <inttypes.h>
+
+#define HOST_EEPROM_SIZE 1024
+
+class EEPROMClass
+{
+  public:
+    EEPROMClass();
+    uint8_t read(int);
+    void write(int, uint8_t);
+  private:
+    uint8_t _memory[HOST_EEPROM_SIZE];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,33 @@
+/*
+	Host stand-in: the PC's network is already up, Ethernet.begin() does nothing and there is no DHCP to keep.
+	Sockets are bound to all interfaces, see EthernetUdp.h and EthernetClient.h
+*/
+
+#ifndef ethernet_h
+#define ethernet_h
+
+#include "Arduino.h"
+#include "EthernetUdp.h"
+#include "EthernetClient.h"
+#include "EthernetServer.h"
+
+	// Results of maintain(), as in Dhcp.h
+#define DHCP_CHECK_NONE         (0)
+#define DHCP_CHECK_RENEW_FAIL   (1)
+#define DHCP_CHECK_RENEW_OK     (2)
+#define DHCP_CHECK_REBIND_FAIL  (3)
+#define DHCP_CHECK_REBIND_OK    (4)
+
+class EthernetClass {
+public:
+  void begin(uint8_t *, IPAddress) {}
+  void beginPolled(uint8_t *, IPAddress, IPAddress, IPAddress) {}
+  int maintain() { return DHCP_CHECK_NONE; }
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  IPAddress subnetMask() { return IPAddress(255, 0, 0, 0); }
+  IPAddress gatewayIP() { return IPAddress(); }
+};
+
+extern EthernetClass Ethernet;
+
+#endif
@@ -0,0 +1,252 @@
+/*
+	Host stand-in for EthernetClient, on a POSIX TCP socket, see EthernetClient.h
+*/
+
+#include "EthernetClient.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#ifdef __linux__
+#include <linux/sockios.h>
+#endif
+
+	// The socket table, as the W5100's: The TX memory holds the bytes of the SEND in progress first, then the queued ones
+struct HostSocket {
+  int fd; // -1 if free
+  uint16_t serverPort;
+  uint8_t tx[HOST_TX_MEMORY];
+  uint16_t sendLength; // bytes of the SEND in progress the kernel hasn't taken yet
+  bool sendPending; // SEND in progress: until the kernel has taken all of it and the other end acknowledged it
+  uint16_t queued;
+};
+
+static HostSocket sockets[MAX_SOCK_NUM] = {
+  { -1, 0, { 0 }, 0, false, 0 }, { -1, 0, { 0 }, 0, false, 0 }, { -1, 0, { 0 }, 0, false, 0 }, { -1, 0, { 0 }, 0, false, 0 }
+};
+
+EthernetClient::EthernetClient() : _sock(MAX_SOCK_NUM) {}
+
+EthernetClient::EthernetClient(uint8_t sock) : _sock(sock) {}
+
+uint8_t EthernetClient::take(int fd, uint16_t serverPort) {
+  for (uint8_t sock = 0; sock < MAX_SOCK_NUM; sock++) {
+    if (sockets[sock].fd < 0) {
+      // The kernel's own send buffer as small as it goes, the nearest to the W5100's TX memory
+      int size = HOST_TX_MEMORY;
+      setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      sockets[sock].fd = fd;
+      sockets[sock].serverPort = serverPort;
+      sockets[sock].sendLength = 0;
+      sockets[sock].sendPending = false;
+      sockets[sock].queued = 0;
+      return sock;
+    }
+  }
+  return MAX_SOCK_NUM;
+}
+
+uint16_t EthernetClient::serverPort() {
+  return _sock < MAX_SOCK_NUM ? sockets[_sock].serverPort : 0;
+}
+
+size_t EthernetClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t EthernetClient::write(const uint8_t *buf, size_t size) {
+  // Waits until the data has gone out, as the W5100 version does, but a second at most for each piece the kernel takes
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return 0;
+
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t n = send(sockets[_sock].fd, buf + sent, size - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+    } else {
+      struct pollfd p = { sockets[_sock].fd, POLLOUT, 0 };
+      if (n < 0 && poll(&p, 1, 1000) <= 0)
+        return sent;
+    }
+  }
+  return sent;
+}
+
+int EthernetClient::available() {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return 0;
+
+  int length = 0;
+  if (ioctl(sockets[_sock].fd, FIONREAD, &length) < 0)
+    return 0;
+  return length;
+}
+
+int EthernetClient::read() {
+  uint8_t b;
+  if (read(&b, 1) > 0)
+    return b;
+  return -1;
+}
+
+int EthernetClient::read(uint8_t *buf, size_t size) {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return -1;
+
+  ssize_t n = recv(sockets[_sock].fd, buf, size, MSG_DONTWAIT);
+  return n > 0 ? n : -1;
+}
+
+int EthernetClient::peek() {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return -1;
+
+  uint8_t b;
+  if (recv(sockets[_sock].fd, &b, 1, MSG_DONTWAIT | MSG_PEEK) > 0)
+    return b;
+  return -1;
+}
+
+void EthernetClient::flush() {
+  while (available())
+    read();
+}
+
+void EthernetClient::stop() {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return;
+
+  while (sending());
+  close(sockets[_sock].fd);
+  sockets[_sock].fd = -1;
+  _sock = MAX_SOCK_NUM;
+}
+
+uint8_t EthernetClient::connected() {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return 0;
+
+  // Closed by the other end: connected as long as there is something left to read, as in CLOSE_WAIT on the W5100
+  uint8_t b;
+  ssize_t n = recv(sockets[_sock].fd, &b, 1, MSG_DONTWAIT | MSG_PEEK);
+  if (n > 0)
+    return 1;
+  if (n == 0)
+    return 0;
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+EthernetClient::operator bool() {
+  return _sock != MAX_SOCK_NUM;
+}
+
+int EthernetClient::availableForWrite() {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return 0;
+  if (sending())
+    return 0;
+  return HOST_TX_MEMORY - sockets[_sock].queued;
+}
+
+size_t EthernetClient::queue(const uint8_t *buf, size_t size) {
+  int space = availableForWrite();
+  if (space <= 0)
+    return 0;
+  if (size > (size_t)space)
+    size = space;
+
+  HostSocket &s = sockets[_sock];
+  memcpy(s.tx + s.queued, buf, size);
+  s.queued += size;
+  return size;
+}
+
+size_t EthernetClient::queue_P(PGM_P buf, size_t size) {
+  return queue((const uint8_t *)buf, size);
+}
+
+uint16_t EthernetClient::queued() {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return 0;
+  return sockets[_sock].queued;
+}
+
+bool EthernetClient::sendQueued() {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return false;
+  if (sending())
+    return false;
+
+  HostSocket &s = sockets[_sock];
+  if (s.queued > 0) {
+    s.sendLength = s.queued;
+    s.queued = 0;
+    s.sendPending = true;
+    push();
+  }
+  return true;
+}
+
+bool EthernetClient::sending() {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0 || !sockets[_sock].sendPending)
+    return false;
+  if (!push())
+    return true;
+
+  // As SEND_OK on the W5100, the SEND is done once the other end has acknowledged it
+  int unacknowledged = 0;
+#ifdef SIOCOUTQ
+  ioctl(sockets[_sock].fd, SIOCOUTQ, &unacknowledged);
+#endif
+  if (unacknowledged > 0)
+    return true;
+  sockets[_sock].sendPending = false;
+  return false;
+}
+
+bool EthernetClient::push() {
+  HostSocket &s = sockets[_sock];
+  if (s.sendLength == 0)
+    return true;
+
+  ssize_t n = send(s.fd, s.tx, s.sendLength, MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (n < 0) {
+    // Gone: the data is dropped, as the W5100 does when the connection closes
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      s.sendLength = 0;
+      s.queued = 0;
+    }
+    return s.sendLength == 0;
+  }
+  s.sendLength -= n;
+  memmove(s.tx, s.tx + n, s.sendLength + s.queued);
+  return s.sendLength == 0;
+}
+
+void EthernetClient::stopNoWait() {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return;
+
+  // The kernel sends what it has taken, then the FIN
+  close(sockets[_sock].fd);
+  sockets[_sock].fd = -1;
+  _sock = MAX_SOCK_NUM;
+}
+
+void EthernetClient::abort() {
+  if (_sock == MAX_SOCK_NUM || sockets[_sock].fd < 0)
+    return;
+
+  // A zero linger time makes close() reset the connection
+  struct linger l = { 1, 0 };
+  setsockopt(sockets[_sock].fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+  close(sockets[_sock].fd);
+  sockets[_sock].fd = -1;
+  _sock = MAX_SOCK_NUM;
+}
@@ -0,0 +1,60 @@
+/*
+	Host stand-in for EthernetClient, on a POSIX TCP socket: the calls ATEMTally's setup page uses, non-blocking
+	as on the W5100. Like the chip, the sockets are a table of MAX_SOCK_NUM, and a client is a socket number into
+	it, so copies of a client share its state.
+	The TX memory is kept at 2 KB per socket, and a SEND is in progress until the other end has acknowledged all of
+	it, so a client which stops reading stops the page as it does on the Arduino.
+*/
+
+#ifndef ethernetclient_h
+#define ethernetclient_h
+
+#include "Arduino.h"
+
+#define MAX_SOCK_NUM 4
+#define HOST_TX_MEMORY 2048
+
+class EthernetClient : public Print {
+
+public:
+  EthernetClient();
+  EthernetClient(uint8_t sock);
+
+  virtual size_t write(uint8_t);
+  virtual size_t write(const uint8_t *buf, size_t size);
+  int available();
+  int read();
+  int read(uint8_t *buf, size_t size);
+  int peek();
+  void flush();
+  void stop();
+  uint8_t connected();
+  operator bool();
+
+  // Non-blocking writing, see the W5100 version: queue() copies what fits into the TX memory, sendQueued()
+  // hands all queued bytes to the kernel; sending() is true and availableForWrite() 0 until it has taken them
+  // all and the other end has acknowledged them.
+  int availableForWrite();
+  size_t queue(const uint8_t *buf, size_t size);
+  size_t queue_P(PGM_P buf, size_t size);
+  uint16_t queued();
+  bool sendQueued();
+  bool sending();
+
+  // Closing without waiting: stopNoWait() closes after the data sent, abort() resets the connection.
+  void stopNoWait();
+  void abort();
+
+  friend class EthernetServer;
+
+  using Print::write;
+
+private:
+  uint8_t _sock;
+
+  static uint8_t take(int fd, uint16_t serverPort); // puts an accepted connection into a free socket, MAX_SOCK_NUM if none is free
+  uint16_t serverPort();
+  bool push(); // hands what sendQueued() started to the kernel, true when all of it is taken
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+	Host stand-in for EthernetServer, on a POSIX TCP socket, see EthernetServer.h
+*/
+
+#include "EthernetServer.h"
+#include "EthernetClient.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+EthernetServer::EthernetServer(uint16_t port) : _port(port), _fd(-1) {}
+
+void EthernetServer::begin()
+{
+  if (_fd >= 0)
+    return;
+
+  _fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (_fd < 0)
+    return;
+
+  int reuse = 1;
+  setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(_port);
+  if (bind(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(_fd, MAX_SOCK_NUM) < 0) {
+    close(_fd);
+    _fd = -1;
+    return;
+  }
+  fcntl(_fd, F_SETFL, O_NONBLOCK);
+}
+
+void EthernetServer::accept()
+{
+  if (_fd < 0)
+    return;
+
+  // Connections beyond the free sockets wait in the backlog, as they are refused by the W5100 only later
+  int fd;
+  while ((fd = ::accept(_fd, NULL, NULL)) >= 0) {
+    if (EthernetClient::take(fd, _port) == MAX_SOCK_NUM) {
+      close(fd);
+      return;
+    }
+  }
+}
+
+EthernetClient EthernetServer::available()
+{
+  accept();
+
+  // A connected client with something to read, as in the W5100 version
+  for (int sock = 0; sock < MAX_SOCK_NUM; sock++) {
+    EthernetClient client(sock);
+    if (client.serverPort() == _port && client.connected() && client.available()) {
+      return client;
+    }
+  }
+
+  return EthernetClient(MAX_SOCK_NUM);
+}
@@ -0,0 +1,23 @@
+/*
+	Host stand-in for EthernetServer, on a POSIX TCP socket listening on all interfaces, see EthernetClient.h
+*/
+
+#ifndef ethernetserver_h
+#define ethernetserver_h
+
+#include "Arduino.h"
+
+class EthernetClient;
+
+class EthernetServer {
+private:
+  uint16_t _port;
+  int _fd; // listening socket, -1 if not open
+  void accept();
+public:
+  EthernetServer(uint16_t);
+  EthernetClient available();
+  void begin();
+};
+
+#endif
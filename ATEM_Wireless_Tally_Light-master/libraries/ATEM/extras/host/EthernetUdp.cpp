@@ -0,0 +1,206 @@
+/*
+	Host stand-in for EthernetUDP, on a POSIX UDP socket, see EthernetUdp.h
+*/
+
+#include "EthernetUdp.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+uint8_t EthernetUDP::lossPercent = 0;
+unsigned long EthernetUDP::datagramsLost = 0;
+void (*EthernetUDP::capture)(uint16_t port, const uint8_t *datagram, uint16_t length) = NULL;
+uint16_t EthernetUDP::replayPort = 0;
+
+static const uint8_t *replayDatagram = NULL;
+static uint16_t replayLength = 0;
+
+void EthernetUDP::replay(const uint8_t *datagram, uint16_t length)
+{
+  replayDatagram = datagram;
+  replayLength = length < UDP_HOST_PACKET_MAX_SIZE ? length : UDP_HOST_PACKET_MAX_SIZE;
+}
+
+EthernetUDP::EthernetUDP() : _fd(-1), _port(0), _remotePort(0), _sendPort(0), _rxLength(0), _rxOffset(0), _txLength(0) {}
+
+uint8_t EthernetUDP::begin(uint16_t port) {
+  if (_fd >= 0)
+    return 0;
+
+  _fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (_fd < 0)
+    return 0;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(_fd);
+    _fd = -1;
+    return 0;
+  }
+  fcntl(_fd, F_SETFL, O_NONBLOCK);
+  setReceiveBuffer(2048);
+
+  _port = port;
+  _rxLength = 0;
+  _rxOffset = 0;
+  return 1;
+}
+
+void EthernetUDP::stop()
+{
+  if (_fd < 0)
+    return;
+
+  close(_fd);
+  _fd = -1;
+}
+
+uint8_t EthernetUDP::enlargeRXBuffer()
+{
+  if (_fd < 0)
+    return 0;
+
+  setReceiveBuffer(4096);
+  return 1;
+}
+
+void EthernetUDP::setReceiveBuffer(int size)
+{
+  // Linux doubles the value for its bookkeeping and enforces a minimum, so this is the nearest it gets to the W5100
+  setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+int EthernetUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  _sendIP = ip;
+  _sendPort = port;
+  _txLength = 0;
+  return _fd >= 0 && port != 0;
+}
+
+int EthernetUDP::endPacket()
+{
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  memcpy(&addr.sin_addr.s_addr, _sendIP.raw_address(), 4);
+  addr.sin_port = htons(_sendPort);
+
+  int ret = sendto(_fd, _txBuffer, _txLength, 0, (struct sockaddr *)&addr, sizeof(addr));
+  _txLength = 0;
+  return ret >= 0;
+}
+
+size_t EthernetUDP::write(uint8_t byte)
+{
+  return write(&byte, 1);
+}
+
+size_t EthernetUDP::write(const uint8_t *buffer, size_t size)
+{
+  if (size > (size_t)(UDP_HOST_PACKET_MAX_SIZE - _txLength))
+    size = UDP_HOST_PACKET_MAX_SIZE - _txLength;
+  memcpy(_txBuffer + _txLength, buffer, size);
+  _txLength += size;
+  return size;
+}
+
+int EthernetUDP::parsePacket()
+{
+  _rxLength = 0;
+  _rxOffset = 0;
+  if (_fd < 0)
+    return 0;
+
+  if (replayPort != 0 && _port == replayPort) {
+    if (replayLength == 0)
+      return 0;
+    memcpy(_rxBuffer, replayDatagram, replayLength);
+    _rxLength = replayLength;
+    replayLength = 0;
+    _remoteIP = IPAddress(127, 0, 0, 1);
+    _remotePort = 9910;
+    return _rxLength;
+  }
+
+  while (true) {
+    struct sockaddr_in addr;
+    socklen_t addrLength = sizeof(addr);
+    int n = recvfrom(_fd, _rxBuffer, sizeof(_rxBuffer), 0, (struct sockaddr *)&addr, &addrLength);
+    if (n <= 0)
+      return 0;
+    if (lossPercent > 0 && random() % 100 < lossPercent) {
+      datagramsLost++;
+      continue;
+    }
+
+    _remoteIP = IPAddress((const uint8_t *)&addr.sin_addr.s_addr);
+    _remotePort = ntohs(addr.sin_port);
+    _rxLength = n;
+    if (capture != NULL)
+      capture(_port, _rxBuffer, n);
+    return n;
+  }
+}
+
+bool EthernetUDP::received()
+{
+  if (_fd < 0)
+    return false;
+  if (replayPort != 0 && _port == replayPort)
+    return replayLength > 0;
+
+  struct pollfd p;
+  p.fd = _fd;
+  p.events = POLLIN;
+  return poll(&p, 1, 0) > 0;
+}
+
+int EthernetUDP::available() {
+  return _rxLength - _rxOffset;
+}
+
+int EthernetUDP::read()
+{
+  if (_rxOffset >= _rxLength)
+    return -1;
+  return _rxBuffer[_rxOffset++];
+}
+
+int EthernetUDP::read(unsigned char* buffer, size_t len)
+{
+  int n = available();
+  if ((size_t)n > len)
+    n = len;
+  memcpy(buffer, _rxBuffer + _rxOffset, n);
+  _rxOffset += n;
+  return n;
+}
+
+int EthernetUDP::peek()
+{
+  if (_rxOffset >= _rxLength)
+    return -1;
+  return _rxBuffer[_rxOffset];
+}
+
+void EthernetUDP::flush()
+{
+  _rxOffset = _rxLength;
+}
+
+int EthernetUDP::skip(size_t len)
+{
+  int n = available();
+  if ((size_t)n > len)
+    n = len;
+  _rxOffset += n;
+  return n;
+}
@@ -0,0 +1,68 @@
+/*
+	Host stand-in for EthernetUDP, on a POSIX UDP socket: the same calls as the W5100 version, so the ATEM class and
+	the switcher simulator run unchanged on a PC, talking over loopback.
+	The socket's receive buffer is kept as small as the W5100 RX memory (2 KB, 4 KB after enlargeRXBuffer()), so a
+	burst of large datagrams overflows it the same way. lossPercent drops received datagrams at random on top of that.
+	For benchmarks, capture sees every datagram taken in, and replay() feeds datagrams to a socket without the network.
+*/
+
+#ifndef ethernetudp_h
+#define ethernetudp_h
+
+#include "Arduino.h"
+
+#define UDP_TX_PACKET_MAX_SIZE 24
+#define UDP_HOST_PACKET_MAX_SIZE 2048
+
+class EthernetUDP : public Print {
+private:
+  int _fd; // socket, -1 if not open
+  uint16_t _port; // local port to listen on
+  IPAddress _remoteIP; // remote IP address for the incoming packet whilst it's being processed
+  uint16_t _remotePort; // remote port for the incoming packet whilst it's being processed
+  IPAddress _sendIP; // destination of the packet being built
+  uint16_t _sendPort;
+  uint8_t _rxBuffer[UDP_HOST_PACKET_MAX_SIZE]; // the incoming packet
+  uint16_t _rxLength;
+  uint16_t _rxOffset; // next unread byte of the incoming packet
+  uint8_t _txBuffer[UDP_HOST_PACKET_MAX_SIZE]; // the packet being built
+  uint16_t _txLength;
+
+  void setReceiveBuffer(int size);
+
+public:
+  static uint8_t lossPercent; // Received datagrams dropped at random, in percent
+  static unsigned long datagramsLost; // Received datagrams dropped by lossPercent
+  static void (*capture)(uint16_t port, const uint8_t *datagram, uint16_t length); // If set, called with every datagram taken in and the local port
+  static uint16_t replayPort; // If set, the socket on this port takes in only what replay() hands it, never the network
+  static void replay(const uint8_t *datagram, uint16_t length); // The datagram the next parsePacket() on replayPort takes in
+
+  EthernetUDP();  // Constructor
+  uint8_t begin(uint16_t);	// initialize, start listening on specified port. Returns 1 if successful, 0 if the port is taken
+  void stop();  // Finish with the UDP socket
+  uint8_t enlargeRXBuffer(); // 4 KB receive buffer instead of 2 KB
+
+  // Sending UDP packets
+  int beginPacket(IPAddress ip, uint16_t port);
+  int endPacket();
+  size_t write(uint8_t);
+  size_t write(const uint8_t *buffer, size_t size);
+
+  using Print::write;
+
+  // Receiving UDP packets
+  int parsePacket();
+  bool received();
+  int available();
+  int read();
+  int read(unsigned char* buffer, size_t len);
+  int read(char* buffer, size_t len) { return read((unsigned char*)buffer, len); };
+  int peek();
+  void flush();
+  int skip(size_t len);
+
+  IPAddress remoteIP() { return _remoteIP; };
+  uint16_t remotePort() { return _remotePort; };
+};
+
+#endif
@@ -0,0 +1,43 @@
+/*
+	Host stand-in for the IPAddress class of the Arduino core
+*/
+
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include <stdint.h>
+#include <string.h>
+#include "Print.h"
+
+class IPAddress : public Printable {
+private:
+	uint8_t _address[4];
+
+public:
+	IPAddress() { memset(_address, 0, 4); }
+	IPAddress(uint8_t first_octet, uint8_t second_octet, uint8_t third_octet, uint8_t fourth_octet) {
+		_address[0] = first_octet;
+		_address[1] = second_octet;
+		_address[2] = third_octet;
+		_address[3] = fourth_octet;
+	}
+	IPAddress(const uint8_t *address) { memcpy(_address, address, 4); }
+
+	bool operator==(const IPAddress& addr) const { return memcmp(_address, addr._address, 4) == 0; }
+	bool operator!=(const IPAddress& addr) const { return !(*this == addr); }
+	uint8_t operator[](int index) const { return _address[index]; }
+	uint8_t& operator[](int index) { return _address[index]; }
+
+	uint8_t *raw_address() { return _address; }
+
+	virtual size_t printTo(Print& p) const {
+		size_t n = 0;
+		for (int i = 0; i < 4; i++) {
+			if (i > 0) n += p.print('.');
+			n += p.print(_address[i], 10);
+		}
+		return n;
+	}
+};
+
+#endif
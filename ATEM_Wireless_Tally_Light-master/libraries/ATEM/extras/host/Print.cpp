@@ -0,0 +1,129 @@
+/*
+	Host stand-in for the Print class of the Arduino core
+*/
+
+#include "Arduino.h"
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+	size_t n = 0;
+	while (size--) {
+		n += write(*buffer++);
+	}
+	return n;
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base)
+{
+	char buf[8 * sizeof(long) + 1];
+	char *str = &buf[sizeof(buf) - 1];
+
+	*str = '\0';
+	if (base < 2) base = 10;
+	do {
+		unsigned long m = n;
+		n /= base;
+		char c = m - base * n;
+		*--str = c < 10 ? c + '0' : c + 'A' - 10;
+	} while (n);
+
+	return write(str);
+}
+
+size_t Print::print(const __FlashStringHelper *ifsh)
+{
+	return write(reinterpret_cast<const char *>(ifsh));
+}
+
+size_t Print::print(const char str[])
+{
+	return write(str);
+}
+
+size_t Print::print(char c)
+{
+	return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char b, int base)
+{
+	return print((unsigned long) b, base);
+}
+
+size_t Print::print(int n, int base)
+{
+	return print((long) n, base);
+}
+
+size_t Print::print(unsigned int n, int base)
+{
+	return print((unsigned long) n, base);
+}
+
+size_t Print::print(long n, int base)
+{
+	if (base == 10 && n < 0) {
+		return print('-') + printNumber(-n, 10);
+	}
+	return printNumber(n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+	return printNumber(n, base);
+}
+
+size_t Print::print(const Printable& x)
+{
+	return x.printTo(*this);
+}
+
+size_t Print::println(void)
+{
+	return write("\r\n");
+}
+
+size_t Print::println(const __FlashStringHelper *ifsh)
+{
+	return print(ifsh) + println();
+}
+
+size_t Print::println(const char c[])
+{
+	return print(c) + println();
+}
+
+size_t Print::println(char c)
+{
+	return print(c) + println();
+}
+
+size_t Print::println(unsigned char b, int base)
+{
+	return print(b, base) + println();
+}
+
+size_t Print::println(int num, int base)
+{
+	return print(num, base) + println();
+}
+
+size_t Print::println(unsigned int num, int base)
+{
+	return print(num, base) + println();
+}
+
+size_t Print::println(long num, int base)
+{
+	return print(num, base) + println();
+}
+
+size_t Print::println(unsigned long num, int base)
+{
+	return print(num, base) + println();
+}
+
+size_t Print::println(const Printable& x)
+{
+	return print(x) + println();
+}
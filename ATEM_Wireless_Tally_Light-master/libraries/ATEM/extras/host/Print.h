@@ -0,0 +1,55 @@
+/*
+	Host stand-in for the Print class of the Arduino core: the same print() and println() overloads
+*/
+
+#ifndef Print_h
+#define Print_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+class Print;
+
+class Printable
+{
+  public:
+	virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print
+{
+  private:
+	size_t printNumber(unsigned long n, uint8_t base);
+
+  public:
+	virtual size_t write(uint8_t) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	size_t write(const char *str) { return str == NULL ? 0 : write((const uint8_t *)str, strlen(str)); }
+
+	size_t print(const __FlashStringHelper *);
+	size_t print(const char[]);
+	size_t print(char);
+	size_t print(unsigned char, int = 10);
+	size_t print(int, int = 10);
+	size_t print(unsigned int, int = 10);
+	size_t print(long, int = 10);
+	size_t print(unsigned long, int = 10);
+	size_t print(const Printable&);
+
+	size_t println(const __FlashStringHelper *);
+	size_t println(const char[]);
+	size_t println(char);
+	size_t println(unsigned char, int = 10);
+	size_t println(int, int = 10);
+	size_t println(unsigned int, int = 10);
+	size_t println(long, int = 10);
+	size_t println(unsigned long, int = 10);
+	size_t println(const Printable&);
+	size_t println(void);
+};
+
+#endif
@@ -0,0 +1,3 @@
+/*
+	Host stand-in: nothing to set up
+*/
@@ -0,0 +1,10 @@
+/*
+	Host stand-in: the EEPROM stand-in (EEPROM.h) is always ready
+*/
+
+#ifndef _AVR_EEPROM_H_
+#define _AVR_EEPROM_H_
+
+#define eeprom_is_ready() 1
+
+#endif
@@ -0,0 +1,20 @@
+/*
+	Host stand-in: program memory is ordinary memory on a PC
+*/
+
+#ifndef __PGMSPACE_H_
+#define __PGMSPACE_H_
+
+#include <string.h>
+
+#define PROGMEM
+typedef char prog_char;
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(addr))
+#define strlen_P(s) strlen(s)
+#define memcpy_P(dest, src, n) memcpy((dest), (src), (n))
+
+#endif
@@ -0,0 +1,13 @@
+/*
+	Host stand-in: ATEM::idle() does not sleep on a PC
+*/
+
+#ifndef _AVR_SLEEP_H_
+#define _AVR_SLEEP_H_
+
+#define SLEEP_MODE_IDLE 0
+
+#define set_sleep_mode(mode)
+#define sleep_mode()
+
+#endif
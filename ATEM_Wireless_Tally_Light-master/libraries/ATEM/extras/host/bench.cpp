@@ -0,0 +1,345 @@
+/*
+	Parser benchmark: captures the packets the ATEMSwitcherSimulator example sends the ATEM class on loopback (the
+	boot dump, then cuts), then replays them into a second ATEM object with EthernetUDP::replay(), without the
+	network, and reports the time per state segment of _parsePacket(). The cost of a packet without segments is
+	measured the same way and taken off. It also times the dispatch on the segment name by itself: the strcmp()
+	chain _parsePacket() had before, and the fourcc switch it has now.
+	Then the input field of both protocol dialects (before and from firmware 2.12, software 4.2), selected by a
+	_ver segment: the captured PrgI segments, in the layout of each, and changeProgramInput(), which writes CPgI.
+
+	Options:
+	-r <cuts/s>		Cut rate of the simulator while capturing (default 100)
+	-t <s>			Capture time after the boot dump (default 2)
+	-n <passes>		Replays of all captured packets (default 2000)
+
+	Exits with 1 if the capture never got past the boot dump, or if with either dialect the input read is wrong, a
+	command is lost, or anything is printed to Serial.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "ATEM.h"
+
+	// The simulator sketch, see simulator.cpp:
+void simulator_setup();
+void simulator_loop();
+extern uint16_t cutsPerSecond;
+
+#define CAPTURE_PORT 56417
+#define REPLAY_PORT 56418
+
+	// Packet header flags, see ATEM::runLoop()
+#define HEADER_ACK 0x08
+#define HEADER_INIT 0x10
+#define HEADER_RETRANSMISSION 0x20
+#define HEADER_RESPONSE 0x80
+
+typedef std::vector<uint8_t> Packet;
+
+static std::vector<Packet> captured;
+
+static volatile int dispatched;		// Keeps the dispatch calls from being optimized away
+
+static void capturePacket(uint16_t port, const uint8_t *datagram, uint16_t length) {
+	if (port == CAPTURE_PORT) {
+		captured.push_back(Packet(datagram, datagram + length));
+	}
+}
+
+static unsigned long long nanos() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+	// A packet without segments and without asking for an ACK
+static Packet emptyPacket() {
+	Packet p(12, 0);
+	p[1] = 12;
+	return p;
+}
+
+	// A packet with one segment
+static Packet segmentPacket(const char name[4], const uint8_t data[4]) {
+	Packet p(24, 0);
+	p[1] = 24;
+	p[13] = 12;
+	memcpy(&p[16], name, 4);
+	memcpy(&p[20], data, 4);
+	return p;
+}
+
+	// A response acknowledging the client's command packets up to packetID
+static Packet ackPacket(uint16_t packetID) {
+	Packet p = emptyPacket();
+	p[0] = HEADER_RESPONSE;
+	p[4] = highByte(packetID);
+	p[5] = lowByte(packetID);
+	return p;
+}
+
+	// The protocol dialects: where PrgI, PrvI, AuxS, CPgI and CPvI have the input number, see ATEM::_setProtocolVersion()
+struct Dialect {
+	const char *name;
+	uint8_t major;
+	uint8_t minor;
+	bool ver42;
+};
+
+static const Dialect dialects[] = {
+	{ "before 4.2", 2, 11, false },
+	{ "4.2 and later", 2, 15, true }
+};
+
+	// Replays the packets, passes times over, and returns the ns it took
+static unsigned long long replay(ATEM& client, std::vector<Packet>& packets, unsigned long passes) {
+	unsigned long long start = nanos();
+	for (unsigned long pass = 0; pass < passes; pass++) {
+		for (size_t i = 0; i < packets.size(); i++) {
+			EthernetUDP::replay(&packets[i][0], packets[i].size());
+			client.runLoop();
+		}
+	}
+	return nanos() - start;
+}
+
+	// The segment name dispatch of _parsePacket() before: a NUL-terminated copy and a strcmp() chain
+static int __attribute__((noinline)) dispatchStrcmp(const uint8_t *name) {
+	char cmdStr[] = { (char)name[0], (char)name[1], (char)name[2], (char)name[3], 0 };
+	int handler = strcmp(cmdStr, "AMLv") ? 0x100 : 0;	// Read into the packet buffer
+	if (!strcmp(cmdStr, "PrgI")) handler |= 1;
+	else if (!strcmp(cmdStr, "PrvI")) handler |= 2;
+	else if (!strcmp(cmdStr, "TlIn")) handler |= 3;
+	else if (!strcmp(cmdStr, "Time")) handler |= 4;
+	else if (!strcmp(cmdStr, "TrPr")) handler |= 5;
+	else if (!strcmp(cmdStr, "TrPs")) handler |= 6;
+	else if (!strcmp(cmdStr, "TrSS")) handler |= 7;
+	else if (!strcmp(cmdStr, "FtbS")) handler |= 8;
+	else if (!strcmp(cmdStr, "FtbP")) handler |= 9;
+	else if (!strcmp(cmdStr, "TMxP")) handler |= 10;
+	else if (!strcmp(cmdStr, "DskS")) handler |= 11;
+	else if (!strcmp(cmdStr, "DskP")) handler |= 12;
+	else if (!strcmp(cmdStr, "KeOn")) handler |= 13;
+	else if (!strcmp(cmdStr, "ColV")) handler |= 14;
+	else if (!strcmp(cmdStr, "MPCE")) handler |= 15;
+	else if (!strcmp(cmdStr, "AuxS")) handler |= 16;
+	else if (!strcmp(cmdStr, "_ver")) handler |= 17;
+	else if (!strcmp(cmdStr, "_pin")) handler |= 18;
+	else if (!strcmp(cmdStr, "AMTl")) handler |= 19;
+	else if (!strcmp(cmdStr, "AMIP")) handler |= 20;
+	else if (!strcmp(cmdStr, "AMLv")) handler |= 21;
+	else if (!strcmp(cmdStr, "VidM")) handler |= 22;
+	return handler;
+}
+
+	// The segment name dispatch of _parsePacket() now: a packed fourcc and a switch
+static int __attribute__((noinline)) dispatchFourcc(const uint8_t *name) {
+	uint32_t cmd = ATEM_FOURCC(name[0], name[1], name[2], name[3]);
+	int handler = cmd != ATEM_FOURCC('A','M','L','v') ? 0x100 : 0;
+	switch (cmd) {
+		case ATEM_FOURCC('P','r','g','I'): handler |= 1; break;
+		case ATEM_FOURCC('P','r','v','I'): handler |= 2; break;
+		case ATEM_FOURCC('T','l','I','n'): handler |= 3; break;
+		case ATEM_FOURCC('T','i','m','e'): handler |= 4; break;
+		case ATEM_FOURCC('T','r','P','r'): handler |= 5; break;
+		case ATEM_FOURCC('T','r','P','s'): handler |= 6; break;
+		case ATEM_FOURCC('T','r','S','S'): handler |= 7; break;
+		case ATEM_FOURCC('F','t','b','S'): handler |= 8; break;
+		case ATEM_FOURCC('F','t','b','P'): handler |= 9; break;
+		case ATEM_FOURCC('T','M','x','P'): handler |= 10; break;
+		case ATEM_FOURCC('D','s','k','S'): handler |= 11; break;
+		case ATEM_FOURCC('D','s','k','P'): handler |= 12; break;
+		case ATEM_FOURCC('K','e','O','n'): handler |= 13; break;
+		case ATEM_FOURCC('C','o','l','V'): handler |= 14; break;
+		case ATEM_FOURCC('M','P','C','E'): handler |= 15; break;
+		case ATEM_FOURCC('A','u','x','S'): handler |= 16; break;
+		case ATEM_FOURCC('_','v','e','r'): handler |= 17; break;
+		case ATEM_FOURCC('_','p','i','n'): handler |= 18; break;
+		case ATEM_FOURCC('A','M','T','l'): handler |= 19; break;
+		case ATEM_FOURCC('A','M','I','P'): handler |= 20; break;
+		case ATEM_FOURCC('A','M','L','v'): handler |= 21; break;
+		case ATEM_FOURCC('V','i','d','M'): handler |= 22; break;
+	}
+	return handler;
+}
+
+	// Runs a dispatch over every segment name, passes times over, and returns the ns it took
+static unsigned long long timeDispatch(int (*dispatch)(const uint8_t *), std::vector<uint8_t>& names, unsigned long passes) {
+	unsigned long long start = nanos();
+	for (unsigned long pass = 0; pass < passes; pass++) {
+		for (size_t i = 0; i < names.size(); i += 4) {
+			dispatched = dispatch(&names[i]);
+		}
+	}
+	return nanos() - start;
+}
+
+int main(int argc, char *argv[]) {
+	int rate = 100;
+	int seconds = 2;
+	unsigned long passes = 2000;
+
+	int option;
+	while ((option = getopt(argc, argv, "r:t:n:")) != -1) {
+		switch (option) {
+			case 'r': rate = atoi(optarg); break;
+			case 't': seconds = atoi(optarg); break;
+			case 'n': passes = atol(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-r cuts/s] [-t s] [-n passes]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	// Capture: the simulator and a client on loopback, as in loopback.cpp
+	simulator_setup();
+	cutsPerSecond = rate;
+	EthernetUDP::capture = capturePacket;
+
+	ATEM AtemSwitcher;
+	AtemSwitcher.begin(IPAddress(127, 0, 0, 1), CAPTURE_PORT);
+	AtemSwitcher.bootDumpMode(true);
+	AtemSwitcher.connect();
+
+	unsigned long start = millis();
+	unsigned long initializedTime = 0;
+	while (initializedTime == 0 ? (unsigned long)millis() - start < 5000 : (unsigned long)millis() - initializedTime < (unsigned long)seconds * 1000) {
+		simulator_loop();
+		AtemSwitcher.runLoop();
+		if (initializedTime == 0 && AtemSwitcher.hasInitialized()) {
+			initializedTime = millis();
+		}
+		if (AtemSwitcher.isConnectionTimedOut()) {
+			AtemSwitcher.connect();
+		}
+	}
+	EthernetUDP::capture = NULL;
+	if (initializedTime == 0) {
+		printf("never initialized\n");
+		return 1;
+	}
+
+	// The packets with segments, once each and without the flags which would have the client answer them. The
+	// first packet of the session (the switcher's answer to connect()) is kept for the replay's own connect().
+	Packet hello;
+	std::vector<Packet> packets;
+	std::vector<uint8_t> names;		// Every segment name, in the order the parser sees them
+	std::vector<uint8_t> prgI;		// The data of every PrgI segment, as the simulator sends it (from 4.2: M/E, 0, input)
+	std::vector<uint16_t> seen;
+	for (size_t i = 0; i < captured.size(); i++) {
+		Packet& p = captured[i];
+		if (p.size() < 12) continue;
+		if (p[0] & HEADER_INIT) {
+			if (hello.empty() && p.size() == 20) hello = p;
+			continue;
+		}
+		uint16_t id = word(p[10], p[11]);
+		if (p.size() == 12 || std::find(seen.begin(), seen.end(), id) != seen.end()) continue;
+		seen.push_back(id);
+		p[0] &= ~(HEADER_ACK | HEADER_RETRANSMISSION);
+		packets.push_back(p);
+		for (size_t s = 12; s + 8 <= p.size(); s += word(p[s], p[s+1])) {
+			names.insert(names.end(), &p[s+4], &p[s+8]);
+			if (!memcmp(&p[s+4], "PrgI", 4) && s + 12 <= p.size()) prgI.insert(prgI.end(), &p[s+8], &p[s+12]);
+			if (word(p[s], p[s+1]) < 8) break;
+		}
+	}
+	unsigned long segments = names.size() / 4;
+	unsigned long known = 0;
+	for (size_t i = 0; i < names.size(); i += 4) {
+		if (dispatchFourcc(&names[i]) & 0xFF) known++;
+	}
+
+	// Replay: a client of its own, connected with the captured answer and initialized by a packet without segments
+	ATEM client;
+	client.begin(IPAddress(127, 0, 0, 1), REPLAY_PORT);
+	EthernetUDP::replayPort = REPLAY_PORT;
+	client.connect();
+	Packet empty = emptyPacket();
+	EthernetUDP::replay(&hello[0], hello.size());
+	client.runLoop();
+	EthernetUDP::replay(&empty[0], empty.size());
+	client.runLoop();
+	if (!client.hasInitialized()) {
+		printf("replay never initialized\n");
+		return 1;
+	}
+
+	std::vector<Packet> emptyPackets(packets.size(), empty);
+	replay(client, packets, passes / 10 + 1);	// Warm up
+	unsigned long long emptyTime = replay(client, emptyPackets, passes);
+	unsigned long long packetTime = replay(client, packets, passes);
+
+	timeDispatch(dispatchStrcmp, names, passes / 10 + 1);
+	unsigned long long strcmpTime = timeDispatch(dispatchStrcmp, names, passes);
+	unsigned long long fourccTime = timeDispatch(dispatchFourcc, names, passes);
+
+	printf("\nATEM parser: %lu packets captured, %lu with segments, %lu segments (%lu names known to the parser), %lu passes\n",
+		(unsigned long)captured.size(), (unsigned long)packets.size(), segments, known, passes);
+	printf("runLoop() per packet without segments: %.0f ns\n", (double)emptyTime / (passes * packets.size()));
+	printf("_parsePacket() per segment: %.1f ns\n", (double)(packetTime - emptyTime) / (passes * segments));
+	printf("dispatch per segment, strcmp() chain (before): %.1f ns, fourcc switch (now): %.1f ns\n",
+		(double)strcmpTime / (passes * segments), (double)fourccTime / (passes * segments));
+
+	// The input field in both dialects: The PrgI segments in the dialect's layout, each in a packet of its own, then
+	// changeProgramInput() in batches which fill the command queue, sent and acknowledged between the timed batches
+	double emptyPacketTime = (double)emptyTime / (passes * packets.size());
+	unsigned long inputs = prgI.size() / 4;
+	bool failed = inputs == 0;
+	const uint8_t commandBatch = ATEM_commandQueueSize / 12;
+	uint16_t commandPacketID = 1;
+	for (size_t d = 0; d < sizeof(dialects) / sizeof(dialects[0]); d++) {
+		const Dialect& dialect = dialects[d];
+		uint8_t version[] = { 0, dialect.major, 0, dialect.minor };
+		Packet versionPacket = segmentPacket("_ver", version);
+		EthernetUDP::replay(&versionPacket[0], versionPacket.size());
+		client.runLoop();
+
+		std::vector<Packet> prgIPackets;
+		for (unsigned long i = 0; i < inputs; i++) {
+			uint8_t data[4] = { prgI[i*4], 0, prgI[i*4+2], prgI[i*4+3] };
+			if (!dialect.ver42) {
+				data[1] = data[3];	// Before 4.2: M/E, input
+				data[2] = 0;
+				data[3] = 0;
+			}
+			prgIPackets.push_back(segmentPacket("PrgI", data));
+		}
+
+		Serial.written = 0;
+		unsigned long long prgITime = replay(client, prgIPackets, passes);
+		bool readRight = client.getProgramInput() == word(prgI[inputs*4-2], prgI[inputs*4-1]);
+
+		unsigned long long changeTime = 0;
+		uint16_t lostBefore = client.getCommandPacketsLost();
+		for (unsigned long pass = 0; pass < passes; pass++) {
+			unsigned long long start = nanos();
+			for (uint8_t i = 0; i < commandBatch; i++) {
+				client.changeProgramInput(1 + (pass + i) % 8);
+			}
+			changeTime += nanos() - start;
+			client.flushCommands();
+			Packet ack = ackPacket(commandPacketID++);
+			EthernetUDP::replay(&ack[0], ack.size());
+			client.runLoop();
+		}
+		unsigned long long timingTime = 0;
+		for (unsigned long pass = 0; pass < passes; pass++) {
+			unsigned long long start = nanos();
+			timingTime += nanos() - start;
+		}
+
+		bool ok = client.ver42() == dialect.ver42 && readRight && client.getCommandPacketsLost() == lostBefore &&
+			Serial.written == 0;
+		printf("input field %s: PrgI %.1f ns per segment, changeProgramInput() %.1f ns, Serial bytes: %lu%s\n",
+			dialect.name, (double)prgITime / (passes * inputs) - emptyPacketTime,
+			(double)(changeTime - timingTime) / (passes * commandBatch), Serial.written, ok ? "" : " FAILED");
+		failed |= !ok;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,299 @@
+/*
+	Loopback harness: runs the ATEM class against the ATEMSwitcherSimulator example on one PC, both on
+	EthernetUDP over loopback (see EthernetUdp.h), and reports how long a cut takes to show in the getters.
+
+	Options:
+	-r <cuts/s>		Cut rate of the simulator (default 100)
+	-t <s>			Run time (default 10)
+	-c <0|1>		ACK coalescing, ATEM::ackCoalescing() (default 1)
+	-b <0|1>		Boot dump mode, ATEM::bootDumpMode() (default 1)
+	-l <percent>	Datagrams lost at random on receive, both ways (default 0)
+	-w <us>			Busy time per pass of the loop, standing in for the rest of a sketch. The simulator goes on sending meanwhile (default 0)
+	-s				Strict: fail if the simulator retransmitted anything
+	-H				Stalled HTTP client: serves the setup page with ATEMTally::serve_http() on each pass, as the transmitter
+					does, and for the second half of the run keeps a client connected which asks for the page and never
+					reads it. Needs a run time of 8 s or more, so the client outlasts HTTP_TIMEOUT
+
+	Exits with 1 if the connection never initialized, no cut showed in the getters, or (with -s) on retransmissions.
+	With -H also if the stalled client never held up the page, or the ACK turnaround went up with it. A packet from the
+	switcher waits for its ACK until runLoop() comes round again, so the turnaround is bounded by the time of a pass
+	of runLoop() and serve_http(), which is measured rather than the simulator's ACKs: the simulator runs in the
+	same process and stops sending while a pass takes long.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <vector>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "ATEM.h"
+#include "ATEMTally.h"
+#include "StageTimer.h"
+
+	// The simulator sketch, see simulator.cpp:
+void simulator_setup();
+void simulator_loop();
+void report();
+extern uint16_t program;
+extern uint16_t cutsPerSecond;
+extern unsigned long statRetransmits;
+extern unsigned long statBootRetransmits;
+extern unsigned long statDropped;
+extern unsigned long statAcks;
+
+struct Cut {
+	uint16_t input;
+	unsigned long time;		// us
+};
+
+	// Sums one of the simulator's statistics, which it resets with every report
+struct Total {
+	unsigned long previous;
+	unsigned long sum;
+
+	Total() : previous(0), sum(0) {}
+	void update(unsigned long value) {
+		sum += value >= previous ? value - previous : value;
+		previous = value;
+	}
+};
+
+static unsigned long percentileOf(std::vector<unsigned long>& sorted, int percent) {
+	return sorted[(sorted.size() - 1) * percent / 100];
+}
+
+static void printDistribution(const char *name, std::vector<unsigned long>& samples) {
+	if (samples.empty()) {
+		printf("%s: none\n", name);
+		return;
+	}
+	std::sort(samples.begin(), samples.end());
+	printf("%s us p50: %lu, p90: %lu, p99: %lu, max: %lu\n", name, percentileOf(samples, 50), percentileOf(samples, 90),
+		percentileOf(samples, 99), samples.back());
+}
+
+	// The setup page, on the transmitter's port 80 moved to one a user can open:
+#define HTTP_PORT 8080
+#define HTTP_STALLED_REQUEST "GET / HTTP/1.1\r\nHost: tally\r\n\r\n"
+
+	// With the stalled client, the p99 ACK turnaround may go up by this much (us) over twice that without it, and
+	// no pass may take longer than HTTP_PASS_LIMIT (us). A PC holds up a process for up to some 20 ms now and then, a page
+	// waiting on the stalled client would hold up the pass until the client is dropped.
+#define HTTP_STALL_SLACK 200
+#define HTTP_PASS_LIMIT 50000
+
+	// A client which asks for the page and never reads it: its receive buffer fills, and the page stops on the
+	// W5100's TX memory until serve_http() drops the client after HTTP_TIMEOUT. Then it connects again.
+struct StalledClient {
+	int fd;
+	unsigned long connects;
+	unsigned long dropped;		// Reset by serve_http(): stalled for HTTP_TIMEOUT
+	unsigned long served;		// Closed after the whole page: it did not stall
+
+	StalledClient() : fd(-1), connects(0), dropped(0), served(0) {}
+
+	void connectTo(uint16_t port) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		int size = 1024;
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(port);
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			send(fd, HTTP_STALLED_REQUEST, strlen(HTTP_STALLED_REQUEST), MSG_NOSIGNAL) < 0) {
+			close(fd);
+			fd = -1;
+			return;
+		}
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		connects++;
+	}
+
+	void keepOpen(uint16_t port) {
+		if (fd >= 0) {
+			struct pollfd p = { fd, POLLRDHUP, 0 };
+			if (poll(&p, 1, 0) <= 0) return;
+			if (p.revents & (POLLERR | POLLHUP)) {
+				dropped++;
+			} else {
+				served++;
+			}
+			close(fd);
+		}
+		connectTo(port);
+	}
+};
+
+	// The status the transmitter adds to the page, cut down to the loop timing
+static void print_status(Print& out) {
+	StageTimers.print(out);
+}
+
+int main(int argc, char *argv[]) {
+	int rate = 100;
+	int seconds = 10;
+	bool coalescing = true;
+	bool bootDump = true;
+	int busyTime = 0;
+	bool strict = false;
+	bool stalledHTTP = false;
+
+	int option;
+	while ((option = getopt(argc, argv, "r:t:c:b:l:w:sH")) != -1) {
+		switch (option) {
+			case 'r': rate = atoi(optarg); break;
+			case 't': seconds = atoi(optarg); break;
+			case 'c': coalescing = atoi(optarg) != 0; break;
+			case 'b': bootDump = atoi(optarg) != 0; break;
+			case 'l': EthernetUDP::lossPercent = atoi(optarg); break;
+			case 'w': busyTime = atoi(optarg); break;
+			case 's': strict = true; break;
+			case 'H': stalledHTTP = true; break;
+			default:
+				fprintf(stderr, "usage: %s [-r cuts/s] [-t s] [-c 0|1] [-b 0|1] [-l percent] [-w us] [-s] [-H]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	if (stalledHTTP && seconds < 8) {
+		fprintf(stderr, "-H needs -t 8 or more: the stalled client has to outlast HTTP_TIMEOUT\n");
+		return 2;
+	}
+
+	simulator_setup();
+	cutsPerSecond = rate;
+
+	ATEM AtemSwitcher;
+	AtemSwitcher.begin(IPAddress(127, 0, 0, 1), 56417);
+	AtemSwitcher.bootDumpMode(bootDump);
+	AtemSwitcher.ackCoalescing(coalescing);
+	AtemSwitcher.connect();
+
+	// The setup page, as in the transmitter's setup() and task_http():
+	ATEMTally tally;
+	EthernetServer server(HTTP_PORT);
+	byte mac[] = { 0x90, 0xA2, 0xDA, 0x00, 0xE8, 0xE9 };
+	byte ip[] = { 127, 0, 0, 1 };
+	byte switcherIP[] = { 127, 0, 0, 1 };
+	int switcherPort = 9910;
+	StalledClient stalledClient;
+	if (stalledHTTP) {
+		tally.initialize();
+		server.begin();
+	}
+
+	std::vector<Cut> pending;			// Cuts not seen in the getters yet
+	std::vector<unsigned long> latencies;
+	std::vector<unsigned long> turnaroundBefore, turnaroundStalled;	// With -H, pass times: before the stalled client, and with it
+	unsigned long superseded = 0;		// Cuts followed by the next one before the getters showed them
+	bool initialized = false;
+	unsigned long initializedTime = 0;
+	uint16_t shown = 0;
+	Total retransmits, bootRetransmits, dropped, acks;
+
+	// One pass of the simulator, which records a cut it makes:
+	auto runSimulator = [&]() {
+		uint16_t programBefore = program;
+		unsigned long simulatorTime = micros();
+		simulator_loop();
+		if (program != programBefore && AtemSwitcher.hasInitialized()) {
+			Cut c = { program, simulatorTime };
+			pending.push_back(c);
+		}
+		retransmits.update(statRetransmits);
+		bootRetransmits.update(statBootRetransmits);
+		dropped.update(statDropped);
+		acks.update(statAcks);
+	};
+
+	unsigned long start = millis();
+	while ((unsigned long)millis() - start < (unsigned long)seconds * 1000) {
+		bool stalled = stalledHTTP && (unsigned long)millis() - start >= (unsigned long)seconds * 500;
+		if (stalled) {
+			stalledClient.keepOpen(HTTP_PORT);
+		}
+		runSimulator();
+		unsigned long passStart = micros();
+		AtemSwitcher.runLoop();
+		if (AtemSwitcher.hasInitialized()) {
+			if (!initialized) {
+				initialized = true;
+				initializedTime = millis() - start;
+				shown = AtemSwitcher.getProgramInput();
+			}
+			if (AtemSwitcher.getProgramInput() != shown) {
+				shown = AtemSwitcher.getProgramInput();
+				unsigned long now = micros();
+				for (size_t i = 0; i < pending.size(); i++) {
+					if (pending[i].input == shown) {
+						latencies.push_back(now - pending[i].time);
+						superseded += i;
+						pending.erase(pending.begin(), pending.begin() + i + 1);
+						break;
+					}
+				}
+			}
+		}
+		if (AtemSwitcher.isConnectionTimedOut()) {
+			AtemSwitcher.connect();
+		}
+		if (stalledHTTP) {
+			STAGE_BEGIN(STAGE_HTTP);
+			if (tally.serve_http(server, mac, ip, switcherIP, switcherPort, print_status)) {
+				STAGE_END(STAGE_HTTP);
+			}
+			if (initialized) {
+				(stalled ? turnaroundStalled : turnaroundBefore).push_back(micros() - passStart);
+			}
+		}
+
+		// The switcher goes on sending while the sketch is busy, so packets pile up for the next runLoop():
+		unsigned long busyStart = micros();
+		while ((unsigned long)(micros() - busyStart) < (unsigned long)busyTime)
+			runSimulator();
+	}
+	report();
+
+	printf("\nATEM loopback: %d cuts/s for %d s, ACK coalescing %s, boot dump mode %s, %d%% loss\n", rate, seconds,
+		coalescing ? "on" : "off", bootDump ? "on" : "off", EthernetUDP::lossPercent);
+	if (initialized) {
+		printf("initialized after: %lu ms\n", initializedTime);
+	} else {
+		printf("never initialized\n");
+	}
+	printf("cuts shown: %lu, superseded: %lu, not shown at the end: %lu\n", (unsigned long)latencies.size(), superseded,
+		(unsigned long)pending.size());
+	if (!latencies.empty()) {
+		printDistribution("cut to getter", latencies);
+	}
+	printf("simulator retransmits: %lu, boot dump retransmits: %lu, dropped: %lu, ACK packets: %lu\n", retransmits.sum,
+		bootRetransmits.sum, dropped.sum, acks.sum);
+	printf("client packets: %lu, ACKs sent: %lu, ACKs saved: %lu, errors: %u, datagrams lost: %lu\n",
+		AtemSwitcher.getPacketsReceived(), AtemSwitcher.getAnswerPacketsSent(), AtemSwitcher.getAnswerPacketsSaved(),
+		AtemSwitcher.getPacketErrors(), EthernetUDP::datagramsLost);
+
+	if (stalledHTTP) {
+		printf("stalled HTTP client: %lu connects, dropped by the page: %lu, served the whole page: %lu\n",
+			stalledClient.connects, stalledClient.dropped, stalledClient.served);
+		printDistribution("ACK turnaround (pass time) before the stalled client", turnaroundBefore);
+		printDistribution("ACK turnaround (pass time) with the stalled client", turnaroundStalled);
+		StageTimers.print(Serial);
+	}
+
+	if (!initialized || latencies.empty()) return 1;
+	if (strict && retransmits.sum + bootRetransmits.sum > 0) return 1;
+	if (stalledHTTP) {
+		if (stalledClient.dropped == 0 || turnaroundBefore.empty() || turnaroundStalled.empty()) return 1;
+		if (percentileOf(turnaroundStalled, 99) > 2 * percentileOf(turnaroundBefore, 99) + HTTP_STALL_SLACK) return 1;
+		if (turnaroundStalled.back() > HTTP_PASS_LIMIT) return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,33 @@
+/*
+	Builds the ATEMSwitcherSimulator example for the host, with its setup() and loop() renamed so the loopback
+	harness can run it next to the ATEM class. The prototypes are the ones the Arduino IDE generates for the sketch.
+*/
+
+#include "Arduino.h"
+
+#define setup simulator_setup
+#define loop simulator_loop
+
+void setup();
+void loop();
+void receivePackets();
+void startSession();
+void cut();
+void runCommands(uint16_t packetSize);
+boolean windowFull();
+void queuePacket(uint8_t kind);
+void retransmitPackets();
+void dropPacket(uint8_t slot);
+void acknowledge(uint16_t id);
+void acknowledgeSlot(uint8_t slot);
+void sendPacket(uint8_t slot, boolean retransmission);
+void writeBootDump(uint8_t slot);
+uint16_t stateLength();
+void writeState(uint16_t program, uint16_t preview);
+void writeSegment(const char cmd[4], const uint8_t *data, uint16_t dataLength);
+void sendAnswerPacket(uint16_t remotePacketID);
+void readCutRate();
+void report();
+uint8_t percentile(unsigned long acked, uint8_t percent);
+
+#include "../../examples/ATEMSwitcherSimulator/ATEMSwitcherSimulator.ino"
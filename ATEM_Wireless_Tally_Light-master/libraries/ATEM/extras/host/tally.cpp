@@ -0,0 +1,255 @@
+/*
+	Tally harness: the ATEMSwitcherSimulator example and the ATEM class on loopback as in loopback.cpp, followed by the
+	transmitter's radio path (TallyFrame.h), a simulated RF12 medium and a receiver for each input. The receiver named
+	by -p echoes each new state, and the transmitter turns the echoes into the tallyLatency stage, as it does on the
+	Arduino. The harness also knows when the LED really changed, so it reports how far the echo estimate is off.
+
+	Options:
+	-r <cuts/s>		Cut rate of the simulator (default 10)
+	-t <s>			Run time (default 10)
+	-n <receivers>	Receivers, nodes 1-n, each showing the input of its number (default 4)
+	-p <node>		Receiver which echoes, LATENCY_PROBE_NODE of the transmitter (default 1)
+	-h <us>			Receiver time from taking a frame to its LED and echo (default 100)
+	-l <percent>	Radio frames lost at random, echoes included (default 0)
+
+	Exits with 1 if the connection never initialized or no echo came back.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "ATEM.h"
+#include "StageTimer.h"
+#include "TallyFrame.h"
+
+	// The simulator sketch, see simulator.cpp:
+void simulator_setup();
+void simulator_loop();
+extern uint16_t cutsPerSecond;
+
+	// As in ATEM_Tally_Transmitter.ino:
+#define RADIO_REPEATS 3
+#define RADIO_HEARTBEAT 300
+#define LATENCY_PROBE_WAIT 15
+
+	// RF12 at about 49.2 kbps (see RF12Mod.cpp): 163 us per byte. Each frame has 3 bytes of preamble, 2 of sync,
+	// header, length, 2 of CRC and a tail byte around the data:
+#define RADIO_US_PER_BYTE 163
+#define RADIO_OVERHEAD 9
+
+	// The radio medium: One frame in the air at a time, which every node but the sender takes at its end
+struct Medium {
+	bool busy;
+	uint8_t data[TALLY_FRAME_MAX_LENGTH];
+	uint8_t length;
+	uint8_t from;			// 0 = transmitter, receivers by node
+	unsigned long end;		// us
+	bool lost;
+
+	Medium() : busy(false), length(0), from(0), end(0), lost(false) {}
+
+	bool canSend() {
+		return !busy;
+	}
+
+	void send(uint8_t node, const uint8_t *frame, uint8_t frameLength, int lossPercent) {
+		memcpy(data, frame, frameLength);
+		length = frameLength;
+		from = node;
+		end = micros() + (RADIO_OVERHEAD + frameLength) * RADIO_US_PER_BYTE;
+		lost = rand() % 100 < lossPercent;
+		busy = true;
+	}
+};
+
+struct Receiver {
+	TallyFrameDecoder decoder;
+	unsigned long ledTime;		// us, when the LED took the last frame
+	bool echoDue;
+	unsigned long echoTime;		// us, when the echo goes out, also when the LED took the frame echoed
+	uint8_t echo[TALLY_ECHO_LENGTH];
+};
+
+static unsigned long percentileOf(std::vector<unsigned long>& sorted, int percent) {
+	return sorted[(sorted.size() - 1) * percent / 100];
+}
+
+static void printDistribution(const char *name, std::vector<unsigned long>& samples) {
+	if (samples.empty()) {
+		printf("%s: none\n", name);
+		return;
+	}
+	std::sort(samples.begin(), samples.end());
+	printf("%s us p50: %lu, p90: %lu, p99: %lu, max: %lu\n", name, percentileOf(samples, 50), percentileOf(samples, 90),
+		percentileOf(samples, 99), samples.back());
+}
+
+int main(int argc, char *argv[]) {
+	int rate = 10;
+	int seconds = 10;
+	int receiverCount = 4;
+	int probeNode = 1;
+	int holdTime = 100;
+	int lossPercent = 0;
+
+	int option;
+	while ((option = getopt(argc, argv, "r:t:n:p:h:l:")) != -1) {
+		switch (option) {
+			case 'r': rate = atoi(optarg); break;
+			case 't': seconds = atoi(optarg); break;
+			case 'n': receiverCount = constrain(atoi(optarg), 1, TALLY_FRAME_INPUTS); break;
+			case 'p': probeNode = atoi(optarg); break;
+			case 'h': holdTime = atoi(optarg); break;
+			case 'l': lossPercent = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-r cuts/s] [-t s] [-n receivers] [-p node] [-h us] [-l percent]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	simulator_setup();
+	cutsPerSecond = rate;
+
+	ATEM AtemSwitcher;
+	AtemSwitcher.begin(IPAddress(127, 0, 0, 1), 56417);
+	AtemSwitcher.bootDumpMode(true);
+	AtemSwitcher.ackCoalescing(true);
+	AtemSwitcher.connect();
+
+	Medium medium;
+	std::vector<Receiver> receivers(receiverCount + 1);
+	for (int node = 1; node <= receiverCount; node++) {
+		receivers[node].decoder.begin(node);
+		receivers[node].ledTime = 0;
+		receivers[node].echoDue = false;
+	}
+
+	// The transmitter's radio state, see task_radio() and receive_echo():
+	TallyFrameEncoder tallyFrame;
+	bool deltaPending = false;
+	uint8_t repeatsLeft = 0;
+	unsigned long lastSend = 0;
+	unsigned long tallyChangeTime = 0;
+	bool probeWaiting = false;
+	uint8_t probeSequence = 0;
+	unsigned long probeSent = 0;
+	unsigned long probeAge = 0;
+	unsigned long probeWaitStart = 0;
+	unsigned long probeChangeTime = 0;
+	unsigned int probesLost = 0;
+	unsigned long framesSent = 0, framesLost = 0, echoesSkipped = 0;
+
+	std::vector<unsigned long> estimated;	// Echo estimate of each probe, as recorded in tallyLatency
+	std::vector<unsigned long> actual;		// Switcher packet to the LED of the probe node, for the same probes
+	std::vector<unsigned long> error;		// Difference of the two
+
+	unsigned long start = millis();
+	while ((unsigned long)millis() - start < (unsigned long)seconds * 1000) {
+		simulator_loop();
+		AtemSwitcher.runLoop();
+		if (AtemSwitcher.isConnectionTimedOut()) {
+			AtemSwitcher.connect();
+		}
+
+		// The medium: A frame at its end reaches every node but its sender
+		if (medium.busy && (long)(micros() - medium.end) >= 0) {
+			medium.busy = false;
+			if (medium.lost) {
+				framesLost++;
+			} else if (medium.from == 0) {
+				for (int node = 1; node <= receiverCount; node++) {
+					Receiver &r = receivers[node];
+					if (!r.decoder.decode(medium.data, medium.length)) continue;
+					r.ledTime = micros() + holdTime;
+					if (r.decoder.buildEcho(r.echo, holdTime)) {
+						r.echoDue = true;
+						r.echoTime = r.ledTime;
+					}
+				}
+			} else if (probeWaiting && TallyFrameEncoder::isEcho(medium.data, medium.length, probeSequence)) {
+				unsigned long latency = TallyFrameEncoder::echoLatency(medium.data, probeAge, micros() - probeSent);
+				probeWaiting = false;
+				probeWaitStart = 0;
+				StageTimers.record(STAGE_TALLY_LATENCY, latency);
+
+				unsigned long truth = receivers[probeNode].echoTime - probeChangeTime;
+				estimated.push_back(latency);
+				actual.push_back(truth);
+				error.push_back(latency > truth ? latency - truth : truth - latency);
+			}
+		}
+
+		// Receivers send their echo once their LED is set, if the air is free; otherwise it is skipped, as in
+		// ATEM_Tally_Receiver.ino
+		for (int node = 1; node <= receiverCount; node++) {
+			Receiver &r = receivers[node];
+			if (r.echoDue && (long)(micros() - r.echoTime) >= 0) {
+				r.echoDue = false;
+				if (medium.canSend()) {
+					medium.send(node, r.echo, TALLY_ECHO_LENGTH, lossPercent);
+				} else {
+					echoesSkipped++;
+				}
+			}
+		}
+
+		// The transmitter, as task_radio()
+		if (!AtemSwitcher.isConnected() || !AtemSwitcher.hasInitialized()) continue;
+		for (uint8_t i = 1; i <= TALLY_FRAME_INPUTS; i++) {
+			tallyFrame.setTally(i,
+				(AtemSwitcher.getProgramTally(i) || AtemSwitcher.isOnAir(i) ? TALLY_PROGRAM : 0) |
+				(AtemSwitcher.getPreviewTally(i) ? TALLY_PREVIEW : 0));
+		}
+		if (tallyFrame.update()) {
+			deltaPending = true;
+			repeatsLeft = RADIO_REPEATS;
+			tallyChangeTime = AtemSwitcher.getLastChangeTime();
+		}
+		bool probeWaitOver = probeWaitStart == 0 || (unsigned long)millis() - probeWaitStart >= LATENCY_PROBE_WAIT;
+		if ((deltaPending || (probeWaitOver && (repeatsLeft > 0 || millis() - lastSend >= RADIO_HEARTBEAT))) && medium.canSend()) {
+			unsigned long age = micros() - tallyChangeTime;
+			if (deltaPending) {
+				deltaPending = false;
+				tallyFrame.stamp(age, probeNode);
+				if (probeNode != 0) {
+					if (probeWaiting) {
+						probesLost++;
+					}
+					probeWaiting = true;
+					probeSequence = tallyFrame.sequence();
+					probeSent = micros();
+					probeAge = age;
+					probeChangeTime = tallyChangeTime;
+					probeWaitStart = millis();
+				}
+			} else {
+				tallyFrame.buildFull();
+				tallyFrame.stamp(age, 0);
+				if (repeatsLeft > 0) {
+					repeatsLeft--;
+				}
+			}
+			medium.send(0, tallyFrame.frame, tallyFrame.length, lossPercent);
+			lastSend = millis();
+			framesSent++;
+		}
+	}
+
+	printf("\nATEM tally: %d cuts/s for %d s, %d receivers, echo from node %d, %d us hold, %d%% radio loss\n", rate, seconds,
+		receiverCount, probeNode, holdTime, lossPercent);
+	if (!AtemSwitcher.hasInitialized()) {
+		printf("never initialized\n");
+	}
+	printf("frames sent: %lu, lost: %lu, echoes skipped (air busy): %lu, probes lost: %u\n", framesSent, framesLost,
+		echoesSkipped, probesLost);
+	StageTimers.print(Serial);
+	printDistribution("echo estimate", estimated);
+	printDistribution("switcher packet to LED", actual);
+	printDistribution("estimate off by", error);
+
+	if (!AtemSwitcher.hasInitialized() || estimated.empty()) return 1;
+	return 0;
+}
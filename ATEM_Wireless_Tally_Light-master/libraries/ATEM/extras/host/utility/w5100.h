@@ -0,0 +1,15 @@
+/*
+	Host stand-in: there is no W5100, only its SPI transaction counter (which stays 0) for ATEM's statistics
+*/
+
+#ifndef	W5100_H_INCLUDED
+#define	W5100_H_INCLUDED
+
+class W5100Class {
+public:
+  unsigned long spiTransactions;
+};
+
+extern W5100Class W5100;
+
+#endif
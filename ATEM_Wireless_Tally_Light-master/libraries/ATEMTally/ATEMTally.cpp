@@ -1,8 +1,12 @@
 #include <Arduino.h>
 #include <Ethernet.h>
 #include <ATEMTally.h>
-#include <TextFinder.h>
 #include <EEPROM.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#if HTTP_GZIP_PAGE
+#include "setup_page.h"
+#endif
 
 // can be called to reset from code (directly to RESET PIN)
 int RESTART_PIN = 7;
@@ -15,11 +19,68 @@ int R_PIN = 3;
 int G_PIN = 5;
 int B_PIN = 6;
 
-//used to identify if valid data in EEPROM the "know" bit
+//used to identify if valid data in EEPROM the "know" bit; marks the record from before the slots below
 const byte ID = 0x92;
 
+// configuration record, see save_eeprom(): 0 version, 1 sequence number, 2-7 MAC, 8-11 IP,
+// 12-15 switcher IP, 16-17 switcher port, 18-19 CRC16 of bytes 0-17 (LSB first)
+#define CONFIG_ADDRESS	0x50	// after the RF12 configuration (0x20-0x4F)
+#define CONFIG_SLOTS	4
+#define CONFIG_VERSION	1
+
+// DHCP lease, see save_lease(): 0 version, 1-4 IP, 5-8 subnet mask, 9-12 gateway, 13-14 CRC16 of bytes 0-12 (LSB first)
+#define LEASE_ADDRESS	0xA0	// after the configuration slots
+#define LEASE_VERSION	1
+
+// setup page: states of serve_http()
+#define HTTP_IDLE		0
+#define HTTP_REQUEST	1	// reading the request line
+#define HTTP_RESPONSE	2	// writing the page
+#define HTTP_CLOSE		3	// waiting for the last of the page to go out
+
+// pages: the setup page, the values for the precompressed one and the status information
+#define HTTP_PAGE_SETUP		0
+#define HTTP_PAGE_CONFIG	1
+#define HTTP_PAGE_STATUS	2
+
+// request line parser: "GET /?SBM=1&DT1=DE&..."
+#define PARSE_METHOD	0
+#define PARSE_PATH		1
+#define PARSE_KEY		2
+#define PARSE_VALUE		3
+#define PARSE_DONE		4
+
+// bytes read / written per call of serve_http(), which keeps each call short
+#define HTTP_READ_CHUNK		64
+#define HTTP_WRITE_CHUNK	256
+
+// queued bytes sent with one SEND: a full TCP segment
+#define HTTP_SEND_SIZE		1460
+
+// free TX memory needed to write the status information and the values in one go; the
+// status is cut off beyond it. The transmitter's print_status() prints at most 1518 bytes
+// (every counter at its widest), plus 45 bytes of header on /status or 11 bytes of <pre>
+// on the page. The W5100 has 2048 bytes of TX memory per socket, so the page sends what it
+// has queued while it waits for this much: only then does the memory become free.
+#define HTTP_STATUS_SPACE	1600
+#define HTTP_CONFIG_SPACE	200
+
+// a client which doesn't make progress for this long (ms) is dropped
+#define HTTP_TIMEOUT		3000
+
+// page segments after the form
+#define HTTP_SEGMENT_STATUS		34
+#define HTTP_SEGMENT_RESTART	35
+#define HTTP_SEGMENT_END		36
+
+PROGMEM prog_char http_json[] = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n";
+PROGMEM prog_char http_text[] = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\n";
+
+#if HTTP_GZIP_PAGE
+PROGMEM prog_char http_gzip[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Encoding: gzip\r\n\r\n";
+#else
 // HTML for the setup page
-PROGMEM prog_char html0[] = "";
+PROGMEM prog_char html0[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n";
 PROGMEM prog_char html1[] = "<html><title>ATEM Tally Transmitter Setup</title></html>";
 PROGMEM prog_char html2[] = "<table bgcolor=\"#999999\" border";
 PROGMEM prog_char html3[] = "=\"0\" width=\"100%\" cellpadding=\"1\" style=\"font-family:Verdana;color:#fff";
@@ -42,7 +103,7 @@ PROGMEM prog_char html17[] = "\">.<input type=\"text\" size=\"3\" maxlength=\"3\
 PROGMEM prog_char html18[] = "\">.<input type=\"text\" size=\"3\" maxlength=\"3\" name=\"DT9\" value=\"";
 PROGMEM prog_char html19[] = "\">.<input type=\"text\" size=\"3\" maxlength=\"3\" name=\"DT10\" value=\"";
 
-PROGMEM prog_char html20[] = "\"></td></tr><tr><td>ATEM SWITCHER:</td><td><input type=\"text\" size=\"3\" maxlength=\"3\" name=\"DT11\" value=\"";
+PROGMEM prog_char html20[] = "\"> 0.0.0.0 = DHCP</td></tr><tr><td>ATEM SWITCHER:</td><td><input type=\"text\" size=\"3\" maxlength=\"3\" name=\"DT11\" value=\"";
 PROGMEM prog_char html21[] = "\">.<input type=\"text\" size=\"3\" maxlength=\"3\" name=\"DT12\" value=\"";
 PROGMEM prog_char html22[] = "\">.<input type=\"text\" size=\"3\" maxlength=\"3\" name=\"DT13\" value=\"";
 PROGMEM prog_char html23[] = "\">.<input type=\"text\" size=\"3\" maxlength=\"3\" name=\"DT14\" value=\"";
@@ -62,8 +123,55 @@ PROGMEM prog_char html34[] = "<br>Restarting...";
 PGM_P html[] PROGMEM = { html0, html1, html2, html3, html4, html5, html6, html7, html8, html9, html10, html11, html12,
 	html13, html14, html15, html16, html17, html18, html19, html20, html21, html22, html23, html24, html25, html26, html27, 
 	html28, html29, html30, html31, html32, html33, html34 };
+#endif
 
-ATEMTally::ATEMTally() {}
+/*
+	Collects what is printed and queues it on the client, up to a given number of bytes
+*/
+
+class HTTPWriter : public Print {
+  public:
+	HTTPWriter(EthernetClient& client, int space) : _client(client), _space(space), _length(0) {}
+
+	virtual size_t write(uint8_t b) {
+		if (_space == 0) return 0;
+		_buffer[_length++] = b;
+		_space--;
+		if (_length == sizeof(_buffer)) send_buffer();
+		return 1;
+	}
+
+	virtual size_t write(const uint8_t *buffer, size_t size) {
+		if (size > _space) size = _space;
+		send_buffer();
+		_space -= size;
+		return _client.queue(buffer, size);
+	}
+
+	size_t write_P(PGM_P buffer, size_t size) {
+		if (size > _space) size = _space;
+		send_buffer();
+		_space -= size;
+		return _client.queue_P(buffer, size);
+	}
+
+	int space() {
+		return _space;
+	}
+
+	void send_buffer() {
+		if (_length > 0) _client.queue(_buffer, _length);
+		_length = 0;
+	}
+
+  private:
+	EthernetClient& _client;
+	unsigned int _space;
+	uint8_t _buffer[32];
+	uint8_t _length;
+};
+
+ATEMTally::ATEMTally() : _http_state(HTTP_IDLE), _config_index(CONFIG_LENGTH+1), _dhcp(false), _lease_index(LEASE_LENGTH) {}
 
 /*
 	Initializes the ATEMTally - sets the pin modes
@@ -81,10 +189,13 @@ void ATEMTally::initialize() {
 */
 
 void ATEMTally::setup_ethernet(byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port) {
-	int idcheck = EEPROM.read(0);
-	
 	// if EEPROM contains saved data, use that data
-	if (idcheck == ID) {
+	if (ATEMTally::find_config(_config_record) >= 0) {
+		memcpy(mac, _config_record+2, 6);
+		memcpy(ip, _config_record+8, 4);
+		memcpy(switcher_ip, _config_record+12, 4);
+		switcher_port = _config_record[16] | (_config_record[17] << 8);
+	} else if (EEPROM.read(0) == ID) {
 		for (int i = 0; i < 6; i++){
 			mac[i] = EEPROM.read(i+1);
 		}
@@ -98,46 +209,338 @@ void ATEMTally::setup_ethernet(byte mac[6], byte ip[4], byte switcher_ip[4], int
 		switcher_port = ATEMTally::eeprom_read_int(15);
 	}
 	
-	Ethernet.begin(mac, ip);
+	// an IP of 0.0.0.0 asks for DHCP: the lease from the last boot is used right away, and
+	// maintain_ethernet() renews it (or gets a new one) in the background
+	_dhcp = !(ip[0] | ip[1] | ip[2] | ip[3]);
+	if (_dhcp) {
+		if (!ATEMTally::find_lease(_lease_record)) memset(_lease_record, 0, LEASE_LENGTH);
+		Ethernet.beginPolled(mac, IPAddress(_lease_record+1), IPAddress(_lease_record+9), IPAddress(_lease_record+5));
+	} else {
+		Ethernet.begin(mac, ip);
+	}
 }
 
 /*
-	Prints the HTML for the setup page
+	Keeps the DHCP lease, a step of the request at a time, and caches a new one in EEPROM
 */
 
-void ATEMTally::print_html(EthernetClient& client, byte mac[6], byte ip[4], byte switcher_ip[4], int switcher_port) {
-	if (client) {
-		TextFinder finder(client);
-		while (client.connected()) {      
-			if (client.available()) {
-				if (finder.find("GET /")) {
-					client.println("HTTP/1.1 200 OK");
-					client.println("Content-Type: text/html");
-					client.println();
-					
-					bool submitted = false;
-					if (finder.findUntil("SBM", "\n\r")) submitted = true;
-					
-					// if submit was pressed, save the EEPROM
-					if (submitted) ATEMTally::save_eeprom(finder, mac, ip, switcher_ip, switcher_port);
-
-					for (int i=1; i < 34; i++) {
-						ATEMTally::set_field_value(client, i, mac, ip, switcher_ip, switcher_port);
-						ATEMTally::print_buffer(client, &(html[i]), 0, false, false);
-					}
-					
-					// if submit was pressed, restart the device
-					if (submitted) {
-						ATEMTally::print_buffer(client, &(html[34]), 0, false, false);
-						ATEMTally::restart_device();
+void ATEMTally::maintain_ethernet() {
+	if (!_dhcp) return;
+	
+	int rc = Ethernet.maintain();
+	if (rc == DHCP_CHECK_RENEW_OK || rc == DHCP_CHECK_REBIND_OK) ATEMTally::save_lease();
+	ATEMTally::save_eeprom_step();
+}
+
+/*
+	Serves the setup page, a bounded piece of work per call so the switcher is never kept waiting;
+	print_status (if given) adds status information below the form, and serves it alone at /status. Returns true while a client is served.
+*/
+
+bool ATEMTally::serve_http(EthernetServer& server, byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port, void (*print_status)(Print&)) {
+	// a submitted configuration is written a byte at a time
+	bool saved = ATEMTally::save_eeprom_step();
+	
+	if (_http_state == HTTP_IDLE) {
+		_http_client = server.available();
+		if (!_http_client) return false;
+		
+		_http_state = HTTP_REQUEST;
+		_http_time = millis();
+		_http_parse = PARSE_METHOD;
+		_http_match = 0;
+		_http_key_length = 0;
+		_http_submitted = false;
+	}
+
+	if (_http_state == HTTP_REQUEST) {
+		ATEMTally::read_request(mac, ip, switcher_ip, switcher_port);
+	}
+	if (_http_state == HTTP_RESPONSE) {
+		ATEMTally::write_response(mac, ip, switcher_ip, switcher_port, print_status);
+	}
+	if (_http_state == HTTP_CLOSE && !_http_client.sending() && saved) {
+		// if submit was pressed, restart the device once the page is out
+		if (_http_submitted) ATEMTally::restart_device();
+		_http_client.stopNoWait();
+		_http_state = HTTP_IDLE;
+	}
+
+	// drop a client which is gone or stalled; submitted values are already in use, so restart either way
+	if (_http_state != HTTP_IDLE) {
+		if (!_http_client.connected() && _http_state != HTTP_CLOSE) {
+			if (_http_submitted) ATEMTally::restart_device();
+			_http_client.abort();
+			_http_state = HTTP_IDLE;
+		} else if (millis() - _http_time > HTTP_TIMEOUT) {
+			if (_http_submitted) ATEMTally::restart_device();
+			_http_client.abort();
+			_http_state = HTTP_IDLE;
+		}
+	}
+	return true;
+}
+
+/*
+	Reads the request line as far as it has arrived
+*/
+
+void ATEMTally::read_request(byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port) {
+	int available = _http_client.available();
+	if (available == 0) return;
+	
+	uint8_t buffer[HTTP_READ_CHUNK];
+	int len = _http_client.read(buffer, available < HTTP_READ_CHUNK ? available : HTTP_READ_CHUNK);
+	if (len <= 0) return;
+	_http_time = millis();
+
+	for (int i = 0; i < len && _http_parse != PARSE_DONE; i++) {
+		ATEMTally::parse_request(buffer[i], mac, ip, switcher_ip, switcher_port);
+	}
+
+	if (_http_parse == PARSE_DONE) {
+		// if submit was pressed, save the EEPROM
+		if (_http_submitted) ATEMTally::save_eeprom(mac, ip, switcher_ip, switcher_port);
+
+		// the rest of the request (headers) isn't needed
+		_http_state = HTTP_RESPONSE;
+		_http_segment = 0;
+		_http_offset = -1;
+	}
+}
+
+/*
+	Takes the next character of the request line. The form fields are "DT" followed by their number:
+	1-6 MAC, 7-10 IP, 11-14 switcher IP and 15 the switcher port. The MAC is sent both as typed (hex)
+	and converted to decimal by the page, only the decimal values are taken.
+*/
+
+void ATEMTally::parse_request(char c, byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port) {
+	static const char method[] = "GET /";
+	
+	switch(_http_parse) {
+		case PARSE_METHOD:
+			if (c == method[_http_match]) {
+				_http_match++;
+				if (method[_http_match] == 0) _http_parse = PARSE_PATH;
+			} else {
+				_http_match = c == method[0] ? 1 : 0;
+			}
+			break;
+		case PARSE_PATH:
+			if (c == '?' || c == ' ' || c == '\r' || c == '\n') {
+				_http_key[_http_key_length] = 0;
+				if (!strcmp(_http_key, "config")) {
+					_http_page = HTTP_PAGE_CONFIG;
+				} else if (!strcmp(_http_key, "status")) {
+					_http_page = HTTP_PAGE_STATUS;
+				} else {
+					_http_page = HTTP_PAGE_SETUP;
+				}
+				_http_parse = c == '?' ? PARSE_KEY : PARSE_DONE;
+				_http_key_length = 0;
+			} else if (_http_key_length < sizeof(_http_key)-1) {
+				_http_key[_http_key_length++] = c;
+			}
+			break;
+		case PARSE_KEY:
+			if (c == '=') {
+				_http_key[_http_key_length] = 0;
+				_http_parse = PARSE_VALUE;
+				_http_value = 0;
+				_http_digits = 0;
+			} else if (c == '&') {
+				_http_key_length = 0;
+			} else if (c == ' ' || c == '\r' || c == '\n') {
+				_http_parse = PARSE_DONE;
+			} else if (_http_key_length < sizeof(_http_key)-1) {
+				_http_key[_http_key_length++] = c;
+			}
+			break;
+		case PARSE_VALUE:
+			if (c == '&' || c == ' ' || c == '\r' || c == '\n') {
+				ATEMTally::set_request_value(mac, ip, switcher_ip, switcher_port);
+				_http_parse = c == '&' ? PARSE_KEY : PARSE_DONE;
+				_http_key_length = 0;
+			} else if (c >= '0' && c <= '9') {
+				if (_http_digits < 5) {
+					_http_value = _http_value * 10 + (c - '0');
+					_http_digits++;
+				}
+			} else {
+				// not a number, the value is ignored
+				_http_digits = 0xFF;
+			}
+			break;
+	}
+}
+
+/*
+	Applies a key/value pair of the request
+*/
+
+void ATEMTally::set_request_value(byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port) {
+	if (!strcmp(_http_key, "SBM")) {
+		_http_submitted = true;
+		return;
+	}
+	// values only count as part of a submitted form
+	if (!_http_submitted || _http_digits == 0 || _http_digits == 0xFF || _http_key[0] != 'D' || _http_key[1] != 'T') return;
+	
+	int val = atoi(_http_key+2);
+	// if val from "DT" is between 1 and 6 the according value must be a MAC value.
+	if(val >= 1 && val <= 6) {
+		mac[val - 1] = _http_value;
+	}
+	// if val from "DT" is between 7 and 10 the according value must be a IP value.
+	if(val >= 7 && val <= 10) {
+		ip[val - 7] = _http_value;
+	}
+	// if val from "DT" is between 11 and 14 the according value must be a Switcher value.
+	if(val >= 11 && val <= 14) {
+		switcher_ip[val - 11] = _http_value; 
+	}
+	// if val from "DT" is 15, set switcher port
+	if(val == 15) {
+		switcher_port = _http_value; 
+	}
+}
+
+/*
+	Writes the next piece of the response, as much as fits into the free TX memory (up to HTTP_WRITE_CHUNK).
+	Content from program memory goes straight into the TX memory, and it is sent with one SEND per full
+	TCP segment, so the page goes out in a few segments.
+*/
+
+void ATEMTally::write_response(byte mac[6], byte ip[4], byte switcher_ip[4], int switcher_port, void (*print_status)(Print&)) {
+	int space = _http_client.availableForWrite();
+	HTTPWriter out(_http_client, space < HTTP_WRITE_CHUNK ? space : HTTP_WRITE_CHUNK);
+	bool progress = false;
+	bool send_now = false;	// waiting for TX memory: what is queued must go out to free it
+	
+	if (_http_page == HTTP_PAGE_STATUS) {
+		// the status information by itself, for monitoring
+		if (space >= HTTP_STATUS_SPACE) {
+			HTTPWriter status(_http_client, space);
+			status.write_P(http_text, strlen_P(http_text));
+			if (print_status != NULL) print_status(status);
+			status.send_buffer();
+			_http_segment = HTTP_SEGMENT_END;
+			progress = true;
+		}
+	} else if (_http_page == HTTP_PAGE_CONFIG) {
+		// the values, for the precompressed page
+		if (space >= HTTP_CONFIG_SPACE) {
+			HTTPWriter config(_http_client, space);
+			config.write_P(http_json, strlen_P(http_json));
+			config.print("{\"mac\":[");
+			for (int i = 0; i < 6; i++) {
+				if (i > 0) config.print(',');
+				config.print(mac[i]);
+			}
+			config.print("],\"ip\":[");
+			for (int i = 0; i < 4; i++) {
+				if (i > 0) config.print(',');
+				config.print(ip[i]);
+			}
+			config.print("],\"switcher\":[");
+			for (int i = 0; i < 4; i++) {
+				if (i > 0) config.print(',');
+				config.print(switcher_ip[i]);
+			}
+			config.print("],\"port\":");
+			config.print((unsigned int)switcher_port);
+			config.print('}');
+			config.send_buffer();
+			_http_segment = HTTP_SEGMENT_END;
+			progress = true;
+		}
+	} else {
+#if HTTP_GZIP_PAGE
+		// the precompressed page: header and body, the page fetches its values from /config
+		int space_before = out.space();
+		if (_http_segment == 0 && ATEMTally::write_segment(out, http_gzip, strlen_P(http_gzip))) {
+			_http_segment++;
+		}
+		if (_http_segment == 1 && ATEMTally::write_segment(out, (PGM_P)setup_page_gz, sizeof(setup_page_gz))) {
+			_http_segment = HTTP_SEGMENT_END;
+		}
+		progress = out.space() < space_before;
+#else
+		while (_http_segment < HTTP_SEGMENT_END) {
+			if (_http_segment == HTTP_SEGMENT_STATUS) {
+				if (print_status != NULL) {
+					// the status is printed in one go, so its values belong together; it
+					// gets a call of its own, with all the free TX memory
+					if (progress || out.space() < HTTP_WRITE_CHUNK) break;
+					if (space < HTTP_STATUS_SPACE) {
+						send_now = true;
+						break;
 					}
-					
+					HTTPWriter status(_http_client, space);
+					status.print("<pre>");
+					print_status(status);
+					status.print("</pre>");
+					status.send_buffer();
+					_http_segment++;
+					progress = true;
 					break;
 				}
+				_http_segment++;
+				continue;
+			}
+			if (_http_segment == HTTP_SEGMENT_RESTART && !_http_submitted) {
+				_http_segment++;
+				continue;
 			}
+			
+			int i = _http_segment == HTTP_SEGMENT_RESTART ? 34 : _http_segment;
+			if (_http_offset < 0) {
+				// field values are written whole
+				if (out.space() < 6) break;
+				ATEMTally::set_field_value(out, i, mac, ip, switcher_ip, switcher_port);
+				_http_offset = 0;
+				progress = true;
+			}
+			
+			PGM_P html_segment = (PGM_P)pgm_read_word(&(html[i]));
+			int space_before = out.space();
+			bool done = ATEMTally::write_segment(out, html_segment, strlen_P(html_segment));
+			progress = progress || out.space() < space_before;
+			if (!done) break;
+			
+			_http_segment++;
 		}
-		client.stop();
+#endif
+	}
+	out.send_buffer();
+	
+	if (_http_client.queued() >= HTTP_SEND_SIZE || _http_segment == HTTP_SEGMENT_END || send_now) {
+		_http_client.sendQueued();
+	}
+	if (progress) {
+		_http_time = millis();
 	}
+	if (_http_segment == HTTP_SEGMENT_END && _http_client.queued() == 0) {
+		_http_state = HTTP_CLOSE;
+	}
+}
+
+/*
+	Writes a segment from program memory on from _http_offset, returns true once it is written completely
+*/
+
+bool ATEMTally::write_segment(HTTPWriter& out, PGM_P segment, int len) {
+	if (_http_offset < 0) _http_offset = 0;
+	
+	int n = len - _http_offset;
+	if (n > out.space()) n = out.space();
+	out.write_P(segment + _http_offset, n);
+	_http_offset += n;
+	
+	if (_http_offset < len) return false;
+	_http_offset = -1;
+	return true;
 }
 
 /*
@@ -161,115 +564,175 @@ void ATEMTally::change_LED_state(int state) {
 }
 
 /*
-	Helps with printing buffer
+	Helps with assigning values to input fields
+*/
+
+void ATEMTally::set_field_value(Print& out, int i, byte mac[6], byte ip[4], byte switcher_ip[4], int switcher_port) {
+	switch(i) {
+		case 8: out.print(mac[0], HEX); break;
+		case 9: out.print(mac[1], HEX); break;
+		case 10: out.print(mac[2], HEX); break;
+		case 11: out.print(mac[3], HEX); break;
+		case 12: out.print(mac[4], HEX); break;
+		case 13: out.print(mac[5], HEX); break;
+		case 17: out.print(ip[0], DEC); break;
+		case 18: out.print(ip[1], DEC); break;
+		case 19: out.print(ip[2], DEC); break;
+		case 20: out.print(ip[3], DEC); break;
+		case 21: out.print(switcher_ip[0], DEC); break;
+		case 22: out.print(switcher_ip[1], DEC); break;
+		case 23: out.print(switcher_ip[2], DEC); break;
+		case 24: out.print(switcher_ip[3], DEC); break;
+		case 25: out.print((unsigned int)switcher_port, DEC); break;
+	}
+}
+
+/*
+	Saves new values to EEPROM. The record goes into the slot after the current one, so the current one stays
+	valid until the new one is complete, and each slot takes a quarter of the writes. Bytes already holding their
+	value aren't written, and nothing is written if the values didn't change. The writing is done by
+	save_eeprom_step(), which doesn't wait for the EEPROM.
 */
 
-void ATEMTally::print_buffer(EthernetClient& client, const prog_char** s, int i, bool number, bool hex) {
-	int total = 0;
-	int start = 0;
-	char buffer[100];
+void ATEMTally::save_eeprom(byte mac[6], byte ip[4], byte switcher_ip[4], int switcher_port) {
+	int slot = ATEMTally::find_config(_config_record);
+	byte sequence = _config_record[1];
+	
+	byte values[16];
+	memcpy(values, mac, 6);
+	memcpy(values+6, ip, 4);
+	memcpy(values+10, switcher_ip, 4);
+	values[14] = switcher_port & 0xFF;
+	values[15] = (switcher_port >> 8) & 0xFF;
+	
+	if (slot >= 0) {
+		if (!memcmp(_config_record+2, values, 16)) {
+			_config_index = CONFIG_LENGTH;
+			return;
+		}
+		slot = (slot + 1) % CONFIG_SLOTS;
+		sequence++;
+	} else {
+		slot = 0;
+		sequence = 0;
+	}
 	
-	memset(buffer,0,100);
+	_config_record[0] = CONFIG_VERSION;
+	_config_record[1] = sequence;
+	memcpy(_config_record+2, values, 16);
+	uint16_t crc = ATEMTally::config_crc(_config_record, CONFIG_LENGTH);
+	_config_record[18] = crc & 0xFF;
+	_config_record[19] = crc >> 8;
+	
+	_config_address = CONFIG_ADDRESS + slot * CONFIG_LENGTH;
+	_config_index = 0;
+}
 
-	char* html_segment = (char*)pgm_read_word(s);
-    int len = strlen_P(html_segment);
+/*
+	Writes the next byte of the record from save_eeprom() that differs from the EEPROM, if the EEPROM is ready.
+	Once the record is complete, the record from before the slots is cleared, then the lease from save_lease()
+	is written the same way. Returns true when done.
+*/
 
-    while (total <= len) {
-      strncpy_P(buffer, html_segment+start, 100-1);
+bool ATEMTally::save_eeprom_step() {
+	while (_config_index <= CONFIG_LENGTH) {
+		if (!eeprom_is_ready()) return false;
+		
+		int address = 0;
+		byte value = 0;
+		if (_config_index < CONFIG_LENGTH) {
+			address = _config_address + _config_index;
+			value = _config_record[_config_index];
+		} else if (EEPROM.read(0) != ID) {
+			address = -1;
+		}
+		_config_index++;
+		
+		if (address >= 0 && EEPROM.read(address) != value) {
+			EEPROM.write(address, value);
+			return false;
+		}
+	}
+	while (_lease_index < LEASE_LENGTH) {
+		if (!eeprom_is_ready()) return false;
+		
+		int address = LEASE_ADDRESS + _lease_index;
+		byte value = _lease_record[_lease_index++];
+		if (EEPROM.read(address) != value) {
+			EEPROM.write(address, value);
+			return false;
+		}
+	}
+	return true;
+}
 
-	  if (number) {
-      	client.print(i, DEC);
-	  } else if (hex) {
-		client.print(i, HEX);
-	  } else {
-		client.print(buffer);
-	  }
+/*
+	Reads the cached DHCP lease into record; returns false if there is none
+*/
 
-      total = start + 100-1;
-      start = start + 100-1;
-    }
+bool ATEMTally::find_lease(byte record[LEASE_LENGTH]) {
+	for (int i = 0; i < LEASE_LENGTH; i++) {
+		record[i] = EEPROM.read(LEASE_ADDRESS + i);
+	}
+	return record[0] == LEASE_VERSION && ATEMTally::config_crc(record, LEASE_LENGTH) == (record[13] | (record[14] << 8));
 }
 
 /*
-	Helps with assigning values to input fields
+	Caches the lease just got in EEPROM, written by save_eeprom_step(); an unchanged lease writes nothing.
+	A lease cut short by a power loss fails its CRC, and the next boot asks for one from scratch.
 */
 
-void ATEMTally::set_field_value(EthernetClient& client, int i, byte mac[6], byte ip[4], byte switcher_ip[4], int switcher_port) {
-	switch(i) {
-		case 8: ATEMTally::print_buffer(client, &(html[0]), mac[0], false, true); break;
-		case 9: ATEMTally::print_buffer(client, &(html[0]), mac[1], false, true); break;
-		case 10: ATEMTally::print_buffer(client, &(html[0]), mac[2], false, true); break;
-		case 11: ATEMTally::print_buffer(client, &(html[0]), mac[3], false, true); break;
-		case 12: ATEMTally::print_buffer(client, &(html[0]), mac[4], false, true); break;
-		case 13: ATEMTally::print_buffer(client, &(html[0]), mac[5], false, true); break;
-		case 17: ATEMTally::print_buffer(client, &(html[0]), ip[0], true, false); break;
-		case 18: ATEMTally::print_buffer(client, &(html[0]), ip[1], true, false); break;
-		case 19: ATEMTally::print_buffer(client, &(html[0]), ip[2], true, false); break;
-		case 20: ATEMTally::print_buffer(client, &(html[0]), ip[3], true, false); break;
-		case 21: ATEMTally::print_buffer(client, &(html[0]), switcher_ip[0], true, false); break;
-		case 22: ATEMTally::print_buffer(client, &(html[0]), switcher_ip[1], true, false); break;
-		case 23: ATEMTally::print_buffer(client, &(html[0]), switcher_ip[2], true, false); break;
-		case 24: ATEMTally::print_buffer(client, &(html[0]), switcher_ip[3], true, false); break;
-		case 25: ATEMTally::print_buffer(client, &(html[0]), switcher_port, true, false); break;
+void ATEMTally::save_lease() {
+	IPAddress ip = Ethernet.localIP();
+	IPAddress subnet = Ethernet.subnetMask();
+	IPAddress gateway = Ethernet.gatewayIP();
+	
+	_lease_record[0] = LEASE_VERSION;
+	for (int i = 0; i < 4; i++) {
+		_lease_record[1+i] = ip[i];
+		_lease_record[5+i] = subnet[i];
+		_lease_record[9+i] = gateway[i];
 	}
+	uint16_t crc = ATEMTally::config_crc(_lease_record, LEASE_LENGTH);
+	_lease_record[13] = crc & 0xFF;
+	_lease_record[14] = crc >> 8;
+	_lease_index = 0;
 }
 
 /*
-	Saves new values to EEPROM
+	Finds the newest valid record and reads it into record; returns its slot, or -1 if there is none
 */
 
-void ATEMTally::save_eeprom(TextFinder& finder, byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port) {
-	byte SET = finder.getValue();
+int ATEMTally::find_config(byte record[CONFIG_LENGTH]) {
+	int newest = -1;
+	byte slot_record[CONFIG_LENGTH];
 	
-	// Now while you are looking for the letters "DT", you'll have to remember
-	// every number behind "DT" and put them in "val" and while doing so, check
-	// for the according values and put those in mac, ip, subnet and gateway.
-	while(finder.findUntil("DT", "\n\r")){
-		int val = finder.getValue();
-		// if val from "DT" is between 1 and 6 the according value must be a MAC value.
-		if(val >= 1 && val <= 6) {
-			mac[val - 1] = finder.getValue();
-		}
-		// if val from "DT" is between 7 and 10 the according value must be a IP value.
-		if(val >= 7 && val <= 10) {
-			ip[val - 7] = finder.getValue();
-		}
-		// if val from "DT" is between 11 and 14 the according value must be a Switcher value.
-		if(val >= 11 && val <= 14) {
-			switcher_ip[val - 11] = finder.getValue(); 
+	for (int slot = 0; slot < CONFIG_SLOTS; slot++) {
+		for (int i = 0; i < CONFIG_LENGTH; i++) {
+			slot_record[i] = EEPROM.read(CONFIG_ADDRESS + slot * CONFIG_LENGTH + i);
 		}
-		// if val from "DT" is 15, set switcher port
-		if(val == 15) {
-			switcher_port = finder.getValue(); 
+		if (slot_record[0] != CONFIG_VERSION) continue;
+		if (ATEMTally::config_crc(slot_record, CONFIG_LENGTH) != (slot_record[18] | (slot_record[19] << 8))) continue;
+		
+		// sequence numbers wrap around; the slots are never more than a few apart
+		if (newest < 0 || (int8_t)(slot_record[1] - record[1]) > 0) {
+			memcpy(record, slot_record, CONFIG_LENGTH);
+			newest = slot;
 		}
 	}
-	
-    // Now that we got all the data, we can save it to EEPROM
-    for (int i = 0 ; i < 6; i++){
-      EEPROM.write(i + 1, mac[i]);
-    }
-    for (int i = 0 ; i < 4; i++){
-      EEPROM.write(i + 7, ip[i]);
-    }
-    for (int i = 0 ; i < 4; i++){
-      EEPROM.write(i + 11, switcher_ip[i]); 
-    }
-    ATEMTally::eeprom_write_int(15, switcher_port); // write switcher port (2 bytes) to address 15 & 16
-
-    // set ID to the known bit, so when you reset the Arduino is will use the EEPROM values
-    EEPROM.write(0, ID);
+	return newest;
 }
 
 /*
-	Writes to EEPROM
+	CRC16 of a record, without its CRC bytes at the end
 */
 
-void ATEMTally::eeprom_write_int(int p_address, int p_value) {
-  	byte lowByte = ((p_value >> 0) & 0xFF);
-  	byte highByte = ((p_value >> 8) & 0xFF);
-
-  	EEPROM.write(p_address, lowByte);
-  	EEPROM.write(p_address + 1, highByte);
+uint16_t ATEMTally::config_crc(byte *record, int length) {
+	uint16_t crc = 0xFFFF;
+	for (int i = 0; i < length-2; i++) {
+		crc = _crc16_update(crc, record[i]);
+	}
+	return crc;
 }
 
 /*
@@ -284,12 +747,18 @@ unsigned int ATEMTally::eeprom_read_int(int p_address) {
 }
 
 /*
-	Resets EEPROM
+	Resets EEPROM: Clears the version of each record and of the lease, and the ID of the record from before the slots
 */
 
 void ATEMTally::reset_eeprom() {
-  	for (int i = 0; i < 512; i++)
-    	EEPROM.write(i, 0); 
+	_config_index = CONFIG_LENGTH+1;
+	_lease_index = LEASE_LENGTH;
+	if (EEPROM.read(LEASE_ADDRESS) != 0) EEPROM.write(LEASE_ADDRESS, 0);
+	for (int slot = 0; slot < CONFIG_SLOTS; slot++) {
+		int address = CONFIG_ADDRESS + slot * CONFIG_LENGTH;
+		if (EEPROM.read(address) != 0) EEPROM.write(address, 0);
+	}
+	if (EEPROM.read(0) != 0) EEPROM.write(0, 0);
 }
 
 /*
@@ -297,6 +766,8 @@ void ATEMTally::reset_eeprom() {
 */
 
 void ATEMTally::restart_device() {
+	// finish saving first
+	while (!ATEMTally::save_eeprom_step());
 	asm volatile("jmp 0x7800");
 }
 
@@ -3,23 +3,68 @@
 
 #include <Arduino.h>
 #include <Ethernet.h>
-#include <TextFinder.h>
 #include <EEPROM.h>
 
+	// Set to 1 to serve the setup page precompressed from setup_page.h: A third of the size, with the values
+	// fetched by the page from /config and the status information from /status.
+#define HTTP_GZIP_PAGE 0
+
+	// Bytes of the configuration record in EEPROM
+#define CONFIG_LENGTH 20
+
+	// Bytes of the DHCP lease cached in EEPROM
+#define LEASE_LENGTH 15
+
+class HTTPWriter;
+
 class ATEMTally
 {
   public:
 	ATEMTally();
 	void initialize();
 	void setup_ethernet(byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port);
-    void print_html(EthernetClient& client, byte mac[6], byte ip[4], byte switcher_ip[4], int switcher_port);
+	void maintain_ethernet();
+	bool serve_http(EthernetServer& server, byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port, void (*print_status)(Print&) = NULL);
 	void change_LED_state(int state);
 	void monitor_reset();
   private:
-	void print_buffer(EthernetClient& client, const prog_char** s, int i, bool number, bool hex);
-    void set_field_value(EthernetClient& client, int i, byte mac[6], byte ip[4], byte switcher_ip[4], int switcher_port);
-	void save_eeprom(TextFinder& finder, byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port);
-	void eeprom_write_int(int p_address, int p_value);
+	// Setup page, served a piece at a time by serve_http()
+	EthernetClient _http_client;
+	byte _http_state;
+	unsigned long _http_time;			// Last time (millis) the client made progress
+	byte _http_parse;					// Request line parser
+	byte _http_match;
+	char _http_key[8];					// Path or key
+	byte _http_key_length;
+	unsigned int _http_value;
+	byte _http_digits;					// Digits in the value, 0xFF if it isn't a number
+	bool _http_submitted;
+	byte _http_page;
+	byte _http_segment;					// Page position: Segment and offset, -1 before its field value
+	int _http_offset;
+
+	// Configuration record being saved, see save_eeprom()
+	byte _config_record[CONFIG_LENGTH];
+	int _config_address;
+	byte _config_index;					// Next byte to write, CONFIG_LENGTH+1 when done
+
+	// DHCP lease cached over a reboot, see save_lease()
+	bool _dhcp;
+	byte _lease_record[LEASE_LENGTH];
+	byte _lease_index;					// Next byte to write, LEASE_LENGTH when done
+
+	void read_request(byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port);
+	void parse_request(char c, byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port);
+	void set_request_value(byte mac[6], byte ip[4], byte switcher_ip[4], int& switcher_port);
+	void write_response(byte mac[6], byte ip[4], byte switcher_ip[4], int switcher_port, void (*print_status)(Print&));
+	bool write_segment(HTTPWriter& out, PGM_P segment, int len);
+    void set_field_value(Print& out, int i, byte mac[6], byte ip[4], byte switcher_ip[4], int switcher_port);
+	void save_eeprom(byte mac[6], byte ip[4], byte switcher_ip[4], int switcher_port);
+	bool save_eeprom_step();
+	int find_config(byte record[CONFIG_LENGTH]);
+	bool find_lease(byte record[LEASE_LENGTH]);
+	void save_lease();
+	uint16_t config_crc(byte *record, int length);
 	unsigned int eeprom_read_int(int p_address);
 	void reset_eeprom();
 	void restart_device();
@@ -0,0 +1,76 @@
+#ifndef setup_page_h
+#define setup_page_h
+
+/*
+ * setup_page.html, compressed with
+ *   gzip -9 -n -c setup_page.html | xxd -i
+ * Regenerate after changing the page. It fills in its fields from /config and shows /status.
+ */
+
+PROGMEM prog_uchar setup_page_gz[] = {
+	0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x85, 0x55, 0x6D, 0x93, 0xDA, 0x36,
+	0x10, 0xFE, 0x7C, 0xFC, 0x8A, 0x1D, 0x25, 0x2D, 0x66, 0x70, 0x0D, 0xA4, 0x0D, 0x9D, 0xF2, 0xE2,
+	0x4E, 0x8E, 0x5C, 0x0A, 0x9D, 0xD0, 0xBB, 0x39, 0x9C, 0xB6, 0x33, 0x99, 0x7C, 0x10, 0xF6, 0x1A,
+	0x34, 0x63, 0x64, 0x57, 0x92, 0x39, 0x68, 0x86, 0xFF, 0x9E, 0x95, 0x8C, 0x0F, 0xE8, 0x90, 0x94,
+	0x3B, 0x8C, 0xB4, 0xFB, 0x68, 0x5F, 0x9E, 0xDD, 0x95, 0x47, 0x6B, 0xB3, 0xC9, 0xC2, 0x91, 0x11,
+	0x26, 0xC3, 0xF0, 0x4D, 0x74, 0x37, 0x87, 0x88, 0x67, 0xD9, 0x1E, 0x22, 0xC5, 0xA5, 0xDE, 0x08,
+	0x63, 0x50, 0xC1, 0x02, 0x4D, 0x59, 0x8C, 0x3A, 0x15, 0xA6, 0x31, 0x32, 0x7C, 0x99, 0x21, 0x2C,
+	0x57, 0x71, 0x9E, 0xE5, 0x6A, 0xCC, 0x5E, 0xFC, 0xE2, 0x3E, 0x0C, 0x96, 0xB9, 0x4A, 0x90, 0x04,
+	0x5D, 0x06, 0x4F, 0x22, 0x31, 0xEB, 0x31, 0xEB, 0x75, 0xBB, 0xDF, 0x31, 0x88, 0x31, 0xCB, 0x0A,
+	0x9E, 0x24, 0x42, 0xAE, 0x48, 0xC4, 0x40, 0x9B, 0x7D, 0x86, 0x63, 0x96, 0xE6, 0xD2, 0xFC, 0x90,
+	0xF2, 0x8D, 0xC8, 0xF6, 0x83, 0x3F, 0x51, 0x25, 0x5C, 0xF2, 0xA1, 0x33, 0x39, 0x78, 0x91, 0xBA,
+	0xCF, 0xD0, 0x21, 0xB4, 0xF8, 0x17, 0x07, 0xBD, 0x57, 0xC5, 0x6E, 0xC8, 0x28, 0x4C, 0x45, 0xDF,
+	0x24, 0xFC, 0x5E, 0x2E, 0x75, 0x01, 0xFF, 0x13, 0x6D, 0x12, 0xD2, 0x43, 0xD9, 0x87, 0x8D, 0x37,
+	0x1C, 0x2D, 0x15, 0xC5, 0x9E, 0xE6, 0x6A, 0x03, 0xB9, 0xD4, 0xE5, 0x92, 0xD0, 0x63, 0xA6, 0x08,
+	0xAB, 0x24, 0xAC, 0x71, 0xE7, 0xB5, 0xC8, 0xBC, 0x90, 0x45, 0x69, 0xC0, 0xEC, 0x0B, 0x0A, 0x6F,
+	0x2D, 0x92, 0x04, 0x25, 0x03, 0xC9, 0x37, 0xB4, 0x5B, 0xDC, 0xCE, 0x19, 0x6C, 0x79, 0x56, 0xA2,
+	0x4D, 0x21, 0xAC, 0x38, 0xB0, 0x5C, 0x54, 0x01, 0xCD, 0xDF, 0x4C, 0x06, 0x95, 0x4B, 0x93, 0x80,
+	0x48, 0xC6, 0x6C, 0xC3, 0x63, 0x16, 0x9E, 0x82, 0x78, 0x06, 0xCE, 0x1E, 0x9E, 0x71, 0xE1, 0x48,
+	0x17, 0x5C, 0x3A, 0xB4, 0x28, 0x2C, 0xD8, 0x6E, 0x43, 0xE8, 0x06, 0xEE, 0x0F, 0xC6, 0xF0, 0x76,
+	0x3A, 0x79, 0xB8, 0x62, 0xC2, 0xA5, 0xBD, 0xF8, 0x6B, 0x16, 0x4D, 0xA6, 0x77, 0x8F, 0x97, 0x5E,
+	0xF5, 0x93, 0x30, 0xF1, 0x1A, 0xD5, 0x55, 0xD7, 0x96, 0x80, 0x6B, 0xE2, 0xF3, 0xA4, 0x2B, 0x5E,
+	0xEA, 0xA4, 0xEB, 0xDD, 0x31, 0xEF, 0xC5, 0x87, 0xDB, 0xF9, 0x2C, 0xAA, 0x6D, 0xD7, 0x89, 0xEA,
+	0xD5, 0xA5, 0xB7, 0x9A, 0xEE, 0x8E, 0xA5, 0x9A, 0xF6, 0x85, 0xC2, 0x2A, 0x36, 0xC3, 0x4D, 0xA9,
+	0x2D, 0x96, 0x24, 0x24, 0xD7, 0xB1, 0x12, 0x85, 0x09, 0x1B, 0x69, 0x29, 0x63, 0x23, 0x72, 0x09,
+	0x2F, 0x3D, 0x91, 0xB4, 0xE0, 0x33, 0x1C, 0x6B, 0x92, 0xE4, 0x71, 0xB9, 0x41, 0x69, 0x82, 0x15,
+	0x9A, 0xBB, 0x0C, 0xED, 0xF2, 0x76, 0x3F, 0x4B, 0x2C, 0x68, 0x08, 0x87, 0xD3, 0xB1, 0x54, 0x60,
+	0x96, 0x68, 0x12, 0xFB, 0xB4, 0x54, 0xDA, 0xF8, 0x20, 0x7D, 0xB0, 0x4D, 0xE3, 0xDB, 0xB2, 0x92,
+	0xC1, 0xC6, 0xCD, 0x96, 0x2B, 0xD0, 0x44, 0x28, 0x63, 0xC3, 0xC6, 0x0D, 0x85, 0x05, 0x9E, 0x95,
+	0x08, 0x92, 0x74, 0x87, 0xF4, 0x33, 0x02, 0x49, 0x3F, 0xED, 0xB6, 0xC3, 0xDE, 0x68, 0x68, 0x8F,
+	0xC1, 0x13, 0xF0, 0x2B, 0xB0, 0x80, 0xC1, 0x80, 0x0E, 0xB5, 0xA0, 0x0D, 0xCD, 0x0B, 0x9A, 0x0C,
+	0xEE, 0x88, 0x16, 0xEB, 0x64, 0xCC, 0x9A, 0xA4, 0xB5, 0x2B, 0x0B, 0x62, 0xB0, 0xE1, 0xBB, 0x0C,
+	0xE5, 0xCA, 0x36, 0xFF, 0xA5, 0xC2, 0x52, 0xF0, 0xCE, 0x8A, 0x3C, 0x17, 0x25, 0x2D, 0x84, 0xB3,
+	0xEB, 0x60, 0x1E, 0x45, 0x4A, 0x0E, 0x9B, 0xDF, 0xEA, 0xC0, 0xB7, 0xD1, 0xB5, 0xD3, 0xCE, 0xEE,
+	0xF4, 0x9A, 0x26, 0x6C, 0x52, 0xF0, 0xCD, 0x6F, 0x1E, 0x0E, 0x9B, 0x2D, 0x22, 0xE4, 0xD0, 0xB8,
+	0x71, 0xD4, 0x07, 0x42, 0x4A, 0x54, 0xD3, 0x68, 0xFE, 0x9E, 0x88, 0xD1, 0xC3, 0x06, 0x71, 0x5C,
+	0x51, 0xEB, 0x9A, 0xD9, 0x87, 0x9E, 0x0F, 0x7D, 0x1F, 0x5E, 0xF9, 0x60, 0x54, 0x89, 0x74, 0xB0,
+	0xD6, 0x52, 0xF3, 0xFA, 0xF0, 0xB3, 0x0F, 0x3F, 0xF9, 0xF0, 0x23, 0xD5, 0x80, 0x67, 0xFA, 0x5C,
+	0xFB, 0xDC, 0x92, 0x64, 0xA0, 0xF7, 0x5F, 0xD0, 0xCB, 0x33, 0xFD, 0xB9, 0x7F, 0xAA, 0x40, 0x13,
+	0x1E, 0xEE, 0x1F, 0xA3, 0xAF, 0xB2, 0xDE, 0xBF, 0xA0, 0xBA, 0x7F, 0x22, 0xA9, 0xF7, 0xFA, 0xC8,
+	0x35, 0x2D, 0xC2, 0xE6, 0xF0, 0xD4, 0x27, 0x6E, 0xC6, 0x6D, 0x85, 0x2F, 0x1A, 0xA0, 0xE7, 0x1A,
+	0x60, 0x0C, 0xFD, 0x63, 0x07, 0x50, 0x44, 0x53, 0xE6, 0x18, 0x0A, 0x5C, 0xD7, 0x13, 0xA4, 0xE0,
+	0x4A, 0xE3, 0x4C, 0x1A, 0x8F, 0x74, 0xEF, 0xCE, 0x75, 0x94, 0x51, 0xDF, 0x12, 0x78, 0x6C, 0x58,
+	0x4B, 0x8B, 0x65, 0x4D, 0xA4, 0xE0, 0x65, 0x79, 0xCC, 0xAD, 0xD7, 0x40, 0x23, 0x57, 0xF1, 0x9A,
+	0x52, 0x4B, 0x70, 0x77, 0x9F, 0x7A, 0xEE, 0x1E, 0x69, 0x41, 0x48, 0x9D, 0xE7, 0x62, 0x21, 0x93,
+	0x76, 0x80, 0x2E, 0xB9, 0x67, 0x8F, 0x48, 0xC3, 0xA2, 0x0C, 0xDD, 0x97, 0x41, 0x10, 0xD8, 0x9E,
+	0xD5, 0x68, 0x22, 0xB1, 0xC1, 0xBC, 0x34, 0x5E, 0x9D, 0x8F, 0xCD, 0x05, 0x9E, 0xDD, 0xAC, 0x15,
+	0xA6, 0xF6, 0x64, 0x87, 0xD1, 0x6C, 0xF8, 0xF0, 0xBA, 0xDB, 0xED, 0x52, 0x64, 0x07, 0x40, 0xE2,
+	0xB9, 0x9E, 0x80, 0x1D, 0x01, 0x24, 0x3E, 0xC1, 0xDF, 0xF3, 0xF7, 0x53, 0x63, 0x8A, 0x47, 0xFC,
+	0xA7, 0x24, 0x3F, 0x9E, 0xCD, 0x60, 0x17, 0xE4, 0x32, 0xCB, 0x79, 0x42, 0x88, 0x73, 0xFB, 0x34,
+	0x0D, 0xF6, 0x60, 0x4C, 0xE2, 0xDF, 0x17, 0xF7, 0x7F, 0x04, 0x8E, 0x09, 0x6F, 0x17, 0x28, 0xD4,
+	0x05, 0xDD, 0xA1, 0x18, 0x51, 0x41, 0x5A, 0x3E, 0x6C, 0x49, 0x1F, 0x07, 0xD4, 0x24, 0x41, 0x9C,
+	0x4B, 0x0A, 0xC8, 0x8B, 0x03, 0x51, 0xF8, 0x24, 0xAA, 0x6B, 0xEB, 0xC3, 0xC7, 0x38, 0x28, 0x72,
+	0x65, 0x3E, 0x59, 0x67, 0x57, 0x27, 0x70, 0x1B, 0x54, 0xB5, 0x3C, 0x95, 0xC1, 0x51, 0x4D, 0x73,
+	0xD8, 0x86, 0x5E, 0xEB, 0x54, 0x0C, 0x8B, 0xED, 0xD3, 0xA8, 0x6C, 0x3F, 0x8A, 0x4F, 0x81, 0xC9,
+	0x17, 0x46, 0x11, 0x4B, 0x1E, 0xD5, 0x81, 0x36, 0x1F, 0x8A, 0x02, 0xD5, 0x84, 0x53, 0x88, 0x2D,
+	0x6A, 0x7D, 0x8B, 0xB0, 0xDE, 0x3A, 0x1D, 0xBA, 0xEF, 0x91, 0x6E, 0x15, 0x97, 0x2E, 0xF0, 0xD4,
+	0xBE, 0x23, 0xCC, 0x1A, 0x21, 0xA7, 0x87, 0x1A, 0xB8, 0xA5, 0x39, 0x7B, 0x7D, 0x68, 0x54, 0x5B,
+	0xD4, 0xEE, 0x4C, 0x9C, 0x09, 0xBA, 0x75, 0x80, 0xD3, 0x3F, 0x18, 0xE2, 0xFF, 0xC8, 0xC7, 0xFE,
+	0xEB, 0x44, 0xDE, 0xEC, 0xAF, 0x33, 0x69, 0x13, 0x3A, 0x5E, 0x80, 0x14, 0x29, 0xD1, 0x36, 0xA1,
+	0x57, 0x9B, 0xB5, 0x3D, 0x86, 0xFD, 0x05, 0x9D, 0x54, 0xBE, 0xA3, 0x99, 0x02, 0xA5, 0xC7, 0x7E,
+	0xBB, 0x8B, 0x68, 0x70, 0x58, 0xA7, 0x3E, 0x5B, 0xE9, 0x34, 0xCA, 0xC4, 0xB9, 0x3B, 0x54, 0xB5,
+	0xBB, 0x80, 0x52, 0x0D, 0x52, 0xB1, 0x62, 0x55, 0x59, 0x6B, 0xE4, 0x81, 0xEE, 0xE5, 0xE3, 0x85,
+	0x3B, 0xEA, 0xB8, 0x37, 0x7E, 0xE3, 0x0B, 0x49, 0x76, 0x33, 0x2C, 0xF9, 0x07, 0x00, 0x00
+};
+
+#endif
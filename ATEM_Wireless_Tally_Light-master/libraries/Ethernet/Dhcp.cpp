@@ -24,9 +24,42 @@ int DhcpClass::beginWithDHCP(uint8_t *mac, unsigned long timeout, unsigned long
 
     memcpy((void*)_dhcpMacAddr, (void*)mac, 6);
     _dhcp_state = STATE_DHCP_START;
+    _dhcpRequest = DHCP_CHECK_NONE;
+    _startRequest = DHCP_CHECK_NONE;
     return request_DHCP_lease();
 }
 
+void DhcpClass::beginPolled(uint8_t *mac, uint8_t *cachedIp, unsigned long timeout, unsigned long responseTimeout)
+{
+    _dhcpLeaseTime=0;
+    _dhcpT1=0;
+    _dhcpT2=0;
+    _renewInSec=0;
+    _rebindInSec=0;
+    _lastCheck=0;
+    _timeout = timeout;
+    _responseTimeout = responseTimeout;
+    _dhcpRequest = DHCP_CHECK_NONE;
+
+    reset_DHCP_lease();
+    memcpy((void*)_dhcpMacAddr, (void*)mac, 6);
+
+    // The request opens its socket at the first checkLease(), so sockets the caller opens
+    // in the meantime come first. A cached address is requested again (INIT-REBOOT, no
+    // server identifier); if that fails, checkLease() starts over with a DISCOVER
+    if (cachedIp != NULL && (cachedIp[0] | cachedIp[1] | cachedIp[2] | cachedIp[3]) != 0)
+    {
+        memcpy(_dhcpLocalIp, cachedIp, 4);
+        _dhcp_state = STATE_DHCP_LEASED;
+        _startRequest = DHCP_CHECK_RENEW_FAIL;
+    }
+    else
+    {
+        _dhcp_state = STATE_DHCP_START;
+        _startRequest = DHCP_CHECK_REBIND_FAIL;
+    }
+}
+
 void DhcpClass::reset_DHCP_lease(){
     // zero out _dhcpSubnetMask, _dhcpGatewayIp, _dhcpLocalIp, _dhcpDhcpServerIp, _dhcpDnsServerIp
     memset(_dhcpLocalIp, 0, 20);
@@ -35,9 +68,21 @@ void DhcpClass::reset_DHCP_lease(){
 //return:0 on error, 1 if request is sent and response is received
 int DhcpClass::request_DHCP_lease(){
     
-    uint8_t messageType = 0;
-  
+    if (!start_DHCP_lease())
+    {
+      // Couldn't get a socket
+      return 0;
+    }
     
+    int result;
+    while((result = poll_DHCP_lease()) == 0)
+        ;
+
+    return result == 1;
+}
+
+//return:0 if no socket is free, 1 if the request can go on with poll_DHCP_lease()
+int DhcpClass::start_DHCP_lease(){
   
     // Pick an initial transaction ID
     _dhcpTransactionId = random(1UL, 2000UL);
@@ -45,88 +90,102 @@ int DhcpClass::request_DHCP_lease(){
 
     if (_dhcpUdpSocket.begin(DHCP_CLIENT_PORT) == 0)
     {
-      // Couldn't get a socket
       return 0;
     }
     
     presend_DHCP();
     
-    int result = 0;
+    _requestStartTime = millis();
+    return 1;
+}
+
+//one step of the request, doesn't wait for the server
+//return:0 while the request goes on, 1 once leased, -1 on timeout
+int DhcpClass::poll_DHCP_lease(){
     
-    unsigned long startTime = millis();
+    uint8_t messageType = 0;
+    int result = 0;
     
-    while(_dhcp_state != STATE_DHCP_LEASED)
+    if(_dhcp_state == STATE_DHCP_START)
+    {
+        _dhcpTransactionId++;
+        
+        send_DHCP_MESSAGE(DHCP_DISCOVER, ((millis() - _requestStartTime) / 1000));
+        _dhcp_state = STATE_DHCP_DISCOVER;
+    }
+    else if(_dhcp_state == STATE_DHCP_REREQUEST){
+        _dhcpTransactionId++;
+        send_DHCP_MESSAGE(DHCP_REQUEST, ((millis() - _requestStartTime)/1000));
+        _dhcp_state = STATE_DHCP_REQUEST;
+    }
+    else if(_dhcp_state == STATE_DHCP_DISCOVER)
     {
-        if(_dhcp_state == STATE_DHCP_START)
+        uint32_t respId;
+        messageType = parseDHCPResponse(_responseTimeout, respId);
+        if(messageType == DHCP_OFFER)
         {
-            _dhcpTransactionId++;
-            
-            send_DHCP_MESSAGE(DHCP_DISCOVER, ((millis() - startTime) / 1000));
-            _dhcp_state = STATE_DHCP_DISCOVER;
-        }
-        else if(_dhcp_state == STATE_DHCP_REREQUEST){
-            _dhcpTransactionId++;
-            send_DHCP_MESSAGE(DHCP_REQUEST, ((millis() - startTime)/1000));
+            // We'll use the transaction ID that the offer came with,
+            // rather than the one we were up to
+            _dhcpTransactionId = respId;
+            send_DHCP_MESSAGE(DHCP_REQUEST, ((millis() - _requestStartTime) / 1000));
             _dhcp_state = STATE_DHCP_REQUEST;
         }
-        else if(_dhcp_state == STATE_DHCP_DISCOVER)
+    }
+    else if(_dhcp_state == STATE_DHCP_REQUEST)
+    {
+        uint32_t respId;
+        messageType = parseDHCPResponse(_responseTimeout, respId);
+        if(messageType == DHCP_ACK)
         {
-            uint32_t respId;
-            messageType = parseDHCPResponse(_responseTimeout, respId);
-            if(messageType == DHCP_OFFER)
-            {
-                // We'll use the transaction ID that the offer came with,
-                // rather than the one we were up to
-                _dhcpTransactionId = respId;
-                send_DHCP_MESSAGE(DHCP_REQUEST, ((millis() - startTime) / 1000));
-                _dhcp_state = STATE_DHCP_REQUEST;
+            _dhcp_state = STATE_DHCP_LEASED;
+            result = 1;
+            //use default lease time if we didn't get it
+            if(_dhcpLeaseTime == 0){
+                _dhcpLeaseTime = DEFAULT_LEASE;
             }
-        }
-        else if(_dhcp_state == STATE_DHCP_REQUEST)
-        {
-            uint32_t respId;
-            messageType = parseDHCPResponse(_responseTimeout, respId);
-            if(messageType == DHCP_ACK)
-            {
-                _dhcp_state = STATE_DHCP_LEASED;
-                result = 1;
-                //use default lease time if we didn't get it
-                if(_dhcpLeaseTime == 0){
-                    _dhcpLeaseTime = DEFAULT_LEASE;
-                }
-                //calculate T1 & T2 if we didn't get it
-                if(_dhcpT1 == 0){
-                    //T1 should be 50% of _dhcpLeaseTime
-                    _dhcpT1 = _dhcpLeaseTime >> 1;
-                }
-                if(_dhcpT2 == 0){
-                    //T2 should be 87.5% (7/8ths) of _dhcpLeaseTime
-                    _dhcpT2 = _dhcpT1 << 1;
-                }
-                _renewInSec = _dhcpT1;
-                _rebindInSec = _dhcpT2;
+            //calculate T1 & T2 if we didn't get it
+            if(_dhcpT1 == 0){
+                //T1 should be 50% of _dhcpLeaseTime
+                _dhcpT1 = _dhcpLeaseTime >> 1;
+            }
+            if(_dhcpT2 == 0){
+                //T2 should be 87.5% (7/8ths) of _dhcpLeaseTime
+                _dhcpT2 = _dhcpT1 << 1;
             }
-            else if(messageType == DHCP_NAK)
-                _dhcp_state = STATE_DHCP_START;
+            _renewInSec = _dhcpT1;
+            _rebindInSec = _dhcpT2;
         }
-        
-        if(messageType == 255)
-        {
-            messageType = 0;
+        else if(messageType == DHCP_NAK)
             _dhcp_state = STATE_DHCP_START;
-        }
-        
-        if(result != 1 && ((millis() - startTime) > _timeout))
-            break;
     }
     
-    // We're done with the socket now
-    _dhcpUdpSocket.stop();
-    _dhcpTransactionId++;
+    if(messageType == 255)
+    {
+        messageType = 0;
+        _dhcp_state = STATE_DHCP_START;
+    }
+    
+    if(result != 1 && ((millis() - _requestStartTime) > _timeout))
+        result = -1;
+    
+    if(result != 0)
+    {
+        // We're done with the socket now
+        _dhcpUdpSocket.stop();
+        _dhcpTransactionId++;
+    }
 
     return result;
 }
 
+// Starts a request in the state given, which checkLease() carries on; if no socket is free, the next check tries again
+void DhcpClass::start_request(uint8_t state, uint8_t request){
+    if (!start_DHCP_lease())
+        return;
+    _dhcp_state = state;
+    _dhcpRequest = request;
+}
+
 void DhcpClass::presend_DHCP()
 {
 }
@@ -229,8 +288,8 @@ void DhcpClass::send_DHCP_MESSAGE(uint8_t messageType, uint16_t secondsElapsed)
         buffer[10] = _dhcpDhcpServerIp[2];
         buffer[11] = _dhcpDhcpServerIp[3];
 
-        //put data in W5100 transmit buffer
-        _dhcpUdpSocket.write(buffer, 12);
+        //put data in W5100 transmit buffer; no server identifier when asking for a cached address
+        _dhcpUdpSocket.write(buffer, *((uint32_t*)_dhcpDhcpServerIp) == 0 ? 6 : 12);
     }
     
     buffer[0] = dhcpParamRequest;
@@ -247,6 +306,7 @@ void DhcpClass::send_DHCP_MESSAGE(uint8_t messageType, uint16_t secondsElapsed)
     _dhcpUdpSocket.write(buffer, 9);
 
     _dhcpUdpSocket.endPacket();
+    _responseStartTime = millis();
 }
 
 uint8_t DhcpClass::parseDHCPResponse(unsigned long responseTimeout, uint32_t& transactionId)
@@ -254,15 +314,14 @@ uint8_t DhcpClass::parseDHCPResponse(unsigned long responseTimeout, uint32_t& tr
     uint8_t type = 0;
     uint8_t opt_len = 0;
      
-    unsigned long startTime = millis();
-
-    while(_dhcpUdpSocket.parsePacket() <= 0)
+    if(_dhcpUdpSocket.parsePacket() <= 0)
     {
-        if((millis() - startTime) > responseTimeout)
+        // Nothing yet: the timeout counts from the message sent last
+        if((millis() - _responseStartTime) > responseTimeout)
         {
             return 255;
         }
-        delay(50);
+        return 0;
     }
     // start reading in the packet
     RIP_MSG_FIXED fixedMsg;
@@ -281,11 +340,13 @@ uint8_t DhcpClass::parseDHCPResponse(unsigned long responseTimeout, uint32_t& tr
         memcpy(_dhcpLocalIp, fixedMsg.yiaddr, 4);
 
         // Skip to the option part
-        // Doing this a byte at a time so we don't have to put a big buffer
-        // on the stack (as we don't have lots of memory lying around)
-        for (int i =0; i < (240 - (int)sizeof(RIP_MSG_FIXED)); i++)
+        // Doing this in small pieces so we don't have to put a big buffer
+        // on the stack (as we don't have lots of memory lying around), nor
+        // read from the chip a byte at a time
+        uint8_t skip[16];
+        for (int i = 240 - (int)sizeof(RIP_MSG_FIXED); i > 0; i -= sizeof(skip))
         {
-            _dhcpUdpSocket.read(); // we don't care about the returned byte
+            _dhcpUdpSocket.read(skip, i < (int)sizeof(skip) ? i : sizeof(skip)); // we don't care about the returned bytes
         }
 
         while (_dhcpUdpSocket.available() > 0) 
@@ -420,24 +481,44 @@ int DhcpClass::checkLease(){
                 _rebindInSec -= factor;
         }
 
-        //if we have a lease but should renew, do it
-        if (_dhcp_state == STATE_DHCP_LEASED && _renewInSec <=0){
-            _dhcp_state = STATE_DHCP_REREQUEST;
-            rc = 1 + request_DHCP_lease();
-        }
+        if (_dhcpRequest == DHCP_CHECK_NONE){
+            //if we have a lease or is renewing but should bind, do it
+            if( (_dhcp_state == STATE_DHCP_LEASED || _dhcp_state == STATE_DHCP_START) && _rebindInSec <=0){
+                //this should basically restart completely
+                reset_DHCP_lease();
+                start_request(STATE_DHCP_START, DHCP_CHECK_REBIND_FAIL);
+            }
 
-        //if we have a lease or is renewing but should bind, do it
-        if( (_dhcp_state == STATE_DHCP_LEASED || _dhcp_state == STATE_DHCP_START) && _rebindInSec <=0){
-            //this should basically restart completely
-            _dhcp_state = STATE_DHCP_START;
-            reset_DHCP_lease();
-            rc = 3 + request_DHCP_lease();
+            //if we have a lease but should renew, do it
+            else if (_dhcp_state == STATE_DHCP_LEASED && _renewInSec <=0){
+                start_request(STATE_DHCP_REREQUEST, DHCP_CHECK_RENEW_FAIL);
+            }
         }
     }
     else{
         _secTimeout = snow + 1000;
     }
 
+    //the request of beginPolled() starts at the first check
+    if (_startRequest != DHCP_CHECK_NONE){
+        if (_dhcpRequest == DHCP_CHECK_NONE)
+            start_request(_startRequest == DHCP_CHECK_RENEW_FAIL ? STATE_DHCP_REREQUEST : STATE_DHCP_START, _startRequest);
+        if (_dhcpRequest != DHCP_CHECK_NONE)
+            _startRequest = DHCP_CHECK_NONE;
+    }
+
+    //a request goes on a step per check, so the caller is never kept waiting for the server
+    if (_dhcpRequest != DHCP_CHECK_NONE){
+        int result = poll_DHCP_lease();
+        if (result != 0){
+            rc = _dhcpRequest + (result == 1);
+            //a failed renewal keeps the lease until it is time to rebind
+            if (result < 0)
+                _dhcp_state = (rc == DHCP_CHECK_RENEW_FAIL) ? STATE_DHCP_LEASED : STATE_DHCP_START;
+            _dhcpRequest = DHCP_CHECK_NONE;
+        }
+    }
+
     _lastCheck = now;
     return rc;
 }
@@ -154,10 +154,17 @@ private:
   unsigned long _timeout;
   unsigned long _responseTimeout;
   unsigned long _secTimeout;
+  unsigned long _requestStartTime;
+  unsigned long _responseStartTime;
   uint8_t _dhcp_state;
+  uint8_t _dhcpRequest;     // Request carried on by checkLease(): DHCP_CHECK_RENEW_FAIL, DHCP_CHECK_REBIND_FAIL or DHCP_CHECK_NONE
+  uint8_t _startRequest;    // Request of beginPolled() which the first checkLease() starts, or DHCP_CHECK_NONE
   EthernetUDP _dhcpUdpSocket;
   
   int request_DHCP_lease();
+  int start_DHCP_lease();
+  int poll_DHCP_lease();
+  void start_request(uint8_t state, uint8_t request);
   void reset_DHCP_lease();
   void presend_DHCP();
   void send_DHCP_MESSAGE(uint8_t, uint16_t);
@@ -172,6 +179,10 @@ public:
   IPAddress getDnsServerIp();
   
   int beginWithDHCP(uint8_t *, unsigned long timeout = 60000, unsigned long responseTimeout = 4000);
+  // Like beginWithDHCP(), without waiting: checkLease() starts the request and carries it on, so
+  // no socket is open on return. With a lease from before (e.g. cached over a reboot), that
+  // address is requested again.
+  void beginPolled(uint8_t *, uint8_t *cachedIp = NULL, unsigned long timeout = 60000, unsigned long responseTimeout = 4000);
   int checkLease();
 };
 
@@ -67,6 +67,16 @@ void EthernetClass::begin(uint8_t *mac, IPAddress local_ip, IPAddress dns_server
   _dnsServerAddress = dns_server;
 }
 
+void EthernetClass::beginPolled(uint8_t *mac_address, IPAddress local_ip, IPAddress gateway, IPAddress subnet)
+{
+  // Assume the DNS server will be the gateway until the lease tells otherwise
+  begin(mac_address, local_ip, gateway, gateway, subnet);
+
+  if (_dhcp == NULL)
+    _dhcp = new DhcpClass();
+  _dhcp->beginPolled(mac_address, local_ip.raw_address());
+}
+
 int EthernetClass::maintain(){
   int rc = DHCP_CHECK_NONE;
   if(_dhcp != NULL){
@@ -25,6 +25,10 @@ public:
   void begin(uint8_t *mac_address, IPAddress local_ip, IPAddress dns_server);
   void begin(uint8_t *mac_address, IPAddress local_ip, IPAddress dns_server, IPAddress gateway);
   void begin(uint8_t *mac_address, IPAddress local_ip, IPAddress dns_server, IPAddress gateway, IPAddress subnet);
+  // Initialise the Ethernet shield with the lease given (if any, e.g. cached from the last boot) and
+  // request one through DHCP without waiting for it; maintain() starts the request, carries it on and renews
+  // the lease. No socket is open on return.
+  void beginPolled(uint8_t *mac_address, IPAddress local_ip, IPAddress gateway, IPAddress subnet);
   int maintain();
 
   IPAddress localIP();
@@ -14,10 +14,10 @@ extern "C" {
 
 uint16_t EthernetClient::_srcport = 1024;
 
-EthernetClient::EthernetClient() : _sock(MAX_SOCK_NUM) {
+EthernetClient::EthernetClient() : _sock(MAX_SOCK_NUM), _queued(0), _sendPending(false) {
 }
 
-EthernetClient::EthernetClient(uint8_t sock) : _sock(sock) {
+EthernetClient::EthernetClient(uint8_t sock) : _sock(sock), _queued(0), _sendPending(false) {
 }
 
 int EthernetClient::connect(const char* host, uint16_t port) {
@@ -86,6 +86,72 @@ size_t EthernetClient::write(const uint8_t *buf, size_t size) {
   return size;
 }
 
+int EthernetClient::availableForWrite() {
+  // The W5100 datasheet doesn't say what becomes of TX memory or TX_WR written
+  // while a SEND is in progress, so nothing is queued until it is done
+  if (sending())
+    return 0;
+  uint8_t s = status();
+  if (s != SnSR::ESTABLISHED && s != SnSR::CLOSE_WAIT)
+    return 0;
+  return W5100.getTXFreeSize(_sock);
+}
+
+size_t EthernetClient::queue(const uint8_t *buf, size_t size) {
+  uint16_t free = availableForWrite();
+  if (size > free)
+    size = free;
+  if (size == 0)
+    return 0;
+
+  W5100.send_data_processing(_sock, buf, size);
+  _queued += size;
+  return size;
+}
+
+size_t EthernetClient::queue_P(PGM_P buf, size_t size) {
+  uint16_t free = availableForWrite();
+  if (size > free)
+    size = free;
+  if (size == 0)
+    return 0;
+
+  W5100.send_data_processing_P(_sock, buf, size);
+  _queued += size;
+  return size;
+}
+
+uint16_t EthernetClient::queued() {
+  return _queued;
+}
+
+bool EthernetClient::sendQueued() {
+  if (sending())
+    return false;
+  if (_queued > 0) {
+    W5100.execCmdSn(_sock, Sock_SEND);
+    _queued = 0;
+    _sendPending = true;
+  }
+  return true;
+}
+
+bool EthernetClient::sending() {
+  if (!_sendPending)
+    return false;
+
+  // Only one SEND may be in progress; it is done once SEND_OK is set, or
+  // the connection is gone
+  uint8_t ir = W5100.readSnIR(_sock);
+  if (ir & (SnIR::SEND_OK | SnIR::TIMEOUT)) {
+    W5100.writeSnIR(_sock, ir & (SnIR::SEND_OK | SnIR::TIMEOUT));
+  } else if (status() != SnSR::CLOSED) {
+    return true;
+  }
+  _sendPending = false;
+  return false;
+}
+
 int EthernetClient::available() {
   if (_sock != MAX_SOCK_NUM)
     return W5100.getRXReceivedSize(_sock);
@@ -144,6 +210,32 @@ void EthernetClient::stop() {
   _sock = MAX_SOCK_NUM;
 }
 
+void EthernetClient::stopNoWait() {
+  if (_sock == MAX_SOCK_NUM)
+    return;
+
+  // The chip closes the socket when the FIN is acknowledged, or after its
+  // retransmissions have timed out
+  disconnect(_sock);
+
+  EthernetClass::_server_port[_sock] = 0;
+  _sock = MAX_SOCK_NUM;
+  _queued = 0;
+  _sendPending = false;
+}
+
+void EthernetClient::abort() {
+  if (_sock == MAX_SOCK_NUM)
+    return;
+
+  close(_sock);
+
+  EthernetClass::_server_port[_sock] = 0;
+  _sock = MAX_SOCK_NUM;
+  _queued = 0;
+  _sendPending = false;
+}
+
 uint8_t EthernetClient::connected() {
   if (_sock == MAX_SOCK_NUM) return 0;
   
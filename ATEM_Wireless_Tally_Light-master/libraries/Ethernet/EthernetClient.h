@@ -25,6 +25,23 @@ public:
   virtual uint8_t connected();
   virtual operator bool();
 
+  // Non-blocking writing: queue() copies what fits into the TX memory and
+  // returns the bytes taken, sendQueued() starts sending all queued bytes
+  // with a single SEND. While that SEND is in progress, availableForWrite()
+  // is 0 and queue() takes nothing. Don't mix with write(), which waits until
+  // its data has gone out.
+  int availableForWrite();
+  size_t queue(const uint8_t *buf, size_t size);
+  size_t queue_P(PGM_P buf, size_t size);
+  uint16_t queued();
+  bool sendQueued();
+  bool sending();
+
+  // Closing without waiting: stopNoWait() sends the FIN and leaves the rest
+  // of the close to the chip, abort() drops the connection at once.
+  void stopNoWait();
+  void abort();
+
   friend class EthernetServer;
   
   using Print::write;
@@ -32,6 +49,8 @@ public:
 private:
   static uint16_t _srcport;
   uint8_t _sock;
+  uint16_t _queued;
+  bool _sendPending;
 };
 
 #endif
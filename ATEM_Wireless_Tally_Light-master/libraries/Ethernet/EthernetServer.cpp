@@ -38,7 +38,9 @@ void EthernetServer::accept()
         listening = 1;
       } 
       else if (client.status() == SnSR::CLOSE_WAIT && !client.available()) {
-        client.stop();
+        // The other side has closed already; stop() would wait for the
+        // close to complete
+        client.stopNoWait();
       }
     } 
   }
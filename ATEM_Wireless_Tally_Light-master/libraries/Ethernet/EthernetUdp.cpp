@@ -33,7 +33,7 @@
 #include "Dns.h"
 
 /* Constructor */
-EthernetUDP::EthernetUDP() : _sock(MAX_SOCK_NUM) {}
+EthernetUDP::EthernetUDP() : _sock(MAX_SOCK_NUM), _sendPort(0), _sendPending(false), _sendFailed(false) {}
 
 /* Start EthernetUDP socket, listening at local port PORT */
 uint8_t EthernetUDP::begin(uint16_t port) {
@@ -53,6 +53,9 @@ uint8_t EthernetUDP::begin(uint16_t port) {
 
   _port = port;
   _remaining = 0;
+  _sendPort = 0;
+  _sendPending = false;
+  _sendFailed = false;
   socket(_sock, SnMR::UDP, _port, 0);
 
   return 1;
@@ -70,12 +73,46 @@ void EthernetUDP::stop()
   if (_sock == MAX_SOCK_NUM)
     return;
 
+  finishSend();
   close(_sock);
 
   EthernetClass::_server_port[_sock] = 0;
   _sock = MAX_SOCK_NUM;
 }
 
+uint8_t EthernetUDP::enlargeRXBuffer()
+{
+  if (_sock == MAX_SOCK_NUM)
+    return 0;
+
+  // Repartitioning moves the RX memory of every socket, so it is only done while no other
+  // socket is open
+  for (int i = 0; i < MAX_SOCK_NUM; i++) {
+    if (i != _sock && W5100.readSnSR(i) != SnSR::CLOSED)
+      return 0;
+  }
+
+  // 4 KB for this socket, 2 KB for the first other socket (the next one opened, typically a
+  // listening EthernetServer) and 1 KB for the remaining two.
+  uint8_t rmsr = 0x02 << (2 * _sock);
+  for (int i = 0; i < MAX_SOCK_NUM; i++) {
+    if (i != _sock) {
+      rmsr |= 0x01 << (2 * i);
+      break;
+    }
+  }
+  if (W5100.readRMSR() == rmsr)
+    return 1;
+
+  finishSend();
+  W5100.setRXMemorySize(rmsr);
+
+  _remaining = 0;
+  _sendPort = 0;
+  socket(_sock, SnMR::UDP, _port, 0);
+  return 1;
+}
+
 int EthernetUDP::beginPacket(const char *host, uint16_t port)
 {
   // Look up the host first
@@ -95,12 +132,54 @@ int EthernetUDP::beginPacket(const char *host, uint16_t port)
 int EthernetUDP::beginPacket(IPAddress ip, uint16_t port)
 {
   _offset = 0;
-  return startUDP(_sock, rawIPAddress(ip), port);
+
+  // The W5100 datasheet doesn't say what becomes of TX memory or TX_WR written
+  // while a SEND is in progress, so the previous packet has to be out before
+  // the next one is written. It normally is by now: one register read.
+  finishSend();
+
+  // Replying to the same host again and again is the common case, and the
+  // destination registers still hold it: saves 6 SPI transactions.
+  if (_sendPort != 0 && port == _sendPort && ip == _sendIP)
+    return 1;
+
+  if (!startUDP(_sock, rawIPAddress(ip), port)) {
+    _sendPort = 0;
+    return 0;
+  }
+  _sendIP = ip;
+  _sendPort = port;
+  return 1;
 }
 
 int EthernetUDP::endPacket()
 {
-  return sendUDP(_sock);
+  // SEND_OK is not waited for here but in the next beginPacket(), so the
+  // caller goes on while the chip sends.
+  finishSend();
+  W5100.execCmdSn(_sock, Sock_SEND);
+  _sendPending = true;
+  int ret = !_sendFailed;
+  _sendFailed = false;
+  return ret;
+}
+
+int EthernetUDP::finishSend()
+{
+  if (!_sendPending)
+    return 1;
+  _sendPending = false;
+
+  uint8_t ir;
+  while (((ir = W5100.readSnIR(_sock)) & SnIR::SEND_OK) != SnIR::SEND_OK) {
+    if (ir & SnIR::TIMEOUT) {
+      W5100.writeSnIR(_sock, (SnIR::SEND_OK|SnIR::TIMEOUT));
+      _sendFailed = true;
+      return 0;
+    }
+  }
+  W5100.writeSnIR(_sock, SnIR::SEND_OK);
+  return 1;
 }
 
 size_t EthernetUDP::write(uint8_t byte)
@@ -122,36 +201,52 @@ int EthernetUDP::parsePacket()
 
   if (W5100.getRXReceivedSize(_sock) > 0)
   {
-    //HACK - hand-parse the UDP packet using TCP recv method
+    // The datagram is read in place from the RX ring: _rxOffset walks through it
+    // and the RX memory is only released (RX_RD update + one RECV command) when the
+    // whole packet has been consumed, instead of a recv() with its own RECV command
+    // for every read() call.
     uint8_t tmpBuf[8];
-    int ret =0; 
+    _rxOffset = W5100.readSnRX_RD(_sock);
     //read 8 header bytes and get IP and port from it
-    ret = recv(_sock,tmpBuf,8);
-    if (ret > 0)
+    W5100.read_data(_sock, (uint8_t *)_rxOffset, tmpBuf, 8);
+    _rxOffset += 8;
+
+    _remoteIP = tmpBuf;
+    _remotePort = tmpBuf[4];
+    _remotePort = (_remotePort << 8) + tmpBuf[5];
+    _remaining = tmpBuf[6];
+    _remaining = (_remaining << 8) + tmpBuf[7];
+
+    if (_remaining == 0)
     {
-      _remoteIP = tmpBuf;
-      _remotePort = tmpBuf[4];
-      _remotePort = (_remotePort << 8) + tmpBuf[5];
-      _remaining = tmpBuf[6];
-      _remaining = (_remaining << 8) + tmpBuf[7];
-
-      // When we get here, any remaining bytes are the data
-      ret = _remaining;
+      // Empty datagram, nothing will ever read it
+      releasePacket();
     }
-    return ret;
+
+    // When we get here, any remaining bytes are the data
+    return _remaining;
   }
   // There aren't any packets available
   return 0;
 }
 
+bool EthernetUDP::received()
+{
+  if (W5100.readSnIR(_sock) & SnIR::RECV) {
+    // Cleared before the caller reads, so a packet landing meanwhile sets it again
+    W5100.writeSnIR(_sock, SnIR::RECV);
+    return true;
+  }
+  return false;
+}
+
 int EthernetUDP::read()
 {
   uint8_t byte;
 
-  if ((_remaining > 0) && (recv(_sock, &byte, 1) > 0))
+  if (read(&byte, 1) > 0)
   {
     // We read things without any problems
-    _remaining--;
     return byte;
   }
 
@@ -165,33 +260,55 @@ int EthernetUDP::read(unsigned char* buffer, size_t len)
   if (_remaining > 0)
   {
 
-    int got;
+    uint16_t got;
 
     if (_remaining <= len)
     {
       // data should fit in the buffer
-      got = recv(_sock, buffer, _remaining);
+      got = _remaining;
     }
     else
     {
       // too much data for the buffer, 
       // grab as much as will fit
-      got = recv(_sock, buffer, len);
+      got = len;
     }
 
-    if (got > 0)
+    W5100.read_data(_sock, (uint8_t *)_rxOffset, buffer, got);
+    _rxOffset += got;
+    _remaining -= got;
+
+    if (_remaining == 0)
     {
-      _remaining -= got;
-      return got;
+      releasePacket();
     }
+    return got;
 
   }
 
-  // If we get here, there's no data available or recv failed
+  // If we get here, there's no data available
   return -1;
 
 }
 
+int EthernetUDP::skip(size_t len)
+{
+  if (_remaining == 0)
+    return 0;
+
+  if (len > _remaining)
+    len = _remaining;
+
+  _rxOffset += len;
+  _remaining -= len;
+
+  if (_remaining == 0)
+  {
+    releasePacket();
+  }
+  return len;
+}
+
 int EthernetUDP::peek()
 {
   uint8_t b;
@@ -200,19 +317,20 @@ int EthernetUDP::peek()
   // may get the UDP header
   if (!_remaining)
     return -1;
-  ::peek(_sock, &b);
+  W5100.read_data(_sock, (uint8_t *)_rxOffset, &b, 1);
   return b;
 }
 
 void EthernetUDP::flush()
 {
-  // could this fail (loop endlessly) if _remaining > 0 and recv in read fails?
-  // should only occur if recv fails after telling us the data is there, lets
-  // hope the w5100 always behaves :)
+  // The unread rest of the packet is simply stepped over in the RX ring,
+  // there is no need to clock it out over SPI.
+  skip(_remaining);
+}
 
-  while (_remaining)
-  {
-    read();
-  }
+void EthernetUDP::releasePacket()
+{
+  W5100.writeSnRX_RD(_sock, _rxOffset);
+  W5100.execCmdSn(_sock, Sock_RECV);
 }
 
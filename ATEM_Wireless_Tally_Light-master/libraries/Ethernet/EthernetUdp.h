@@ -49,11 +49,23 @@ private:
   uint16_t _remotePort; // remote port for the incoming packet whilst it's being processed
   uint16_t _offset; // offset into the packet being sent
   uint16_t _remaining; // remaining bytes of incoming packet yet to be processed
+  uint16_t _rxOffset; // W5100 RX ring pointer of the next unread byte of the incoming packet
+  IPAddress _sendIP; // destination held in the socket registers, so beginPacket() can skip rewriting them
+  uint16_t _sendPort; // 0 if the socket registers are unknown
+  bool _sendPending; // SEND issued, SEND_OK not collected yet
+  bool _sendFailed; // a SEND timed out, reported by the next endPacket()
+
+  void releasePacket(); // hand the RX memory of the fully consumed packet back to the W5100
+  int finishSend(); // wait for the pending SEND, returns 0 if it timed out
 
 public:
   EthernetUDP();  // Constructor
   virtual uint8_t begin(uint16_t);	// initialize, start listening on specified port. Returns 1 if successful, 0 if there are no sockets available to use
   virtual void stop();  // Finish with the UDP socket
+  // Give this socket 4 KB of the W5100 RX memory (the default is 2 KB per socket) so it can
+  // take bursts of large datagrams. Reopens the socket, so call it before traffic is expected.
+  // Only works while no other socket is open: returns 0 and leaves the memory alone otherwise.
+  uint8_t enlargeRXBuffer();
 
   // Sending UDP packets
   
@@ -64,7 +76,8 @@ public:
   // Returns 1 if successful, 0 if there was a problem resolving the hostname or port
   virtual int beginPacket(const char *host, uint16_t port);
   // Finish off this packet and send it
-  // Returns 1 if the packet was sent successfully, 0 if there was an error
+  // The W5100 sends it while we go on; the next beginPacket() waits for it to complete
+  // before writing to the TX memory. Returns 0 if the previous packet could not be sent, otherwise 1
   virtual int endPacket();
   // Write a single byte into the packet
   virtual size_t write(uint8_t);
@@ -76,6 +89,9 @@ public:
   // Start processing the next available incoming packet
   // Returns the size of the packet in bytes, or 0 if no packets are available
   virtual int parsePacket();
+  // Returns true (once) if a packet has arrived since the last call. Costs a single SPI transaction
+  // when nothing has arrived. The caller should then read until parsePacket() returns 0.
+  bool received();
   // Number of bytes remaining in the current packet
   virtual int available();
   // Read a single byte from the current packet
@@ -89,6 +105,9 @@ public:
   // Return the next byte from the current packet without moving on to the next byte
   virtual int peek();
   virtual void flush();	// Finish reading the current packet
+  // Skip up to len bytes of the current packet without transferring them over SPI
+  // Returns the number of bytes skipped
+  int skip(size_t len);
 
   // Return the IP address of the host who sent the current incoming packet
   virtual IPAddress remoteIP() { return _remoteIP; };
@@ -16,6 +16,8 @@
 // W5100 controller instance
 W5100Class W5100;
 
+unsigned long W5100Class::spiTransactions = 0;
+
 #define TX_RX_MAX_BUF_SIZE 2048
 #define TX_BUF 0x1100
 #define RX_BUF (TX_BUF + TX_RX_MAX_BUF_SIZE)
@@ -25,18 +27,33 @@ W5100Class W5100;
 
 void W5100Class::init(void)
 {
-  delay(300);
+  // The chip needs 300 ms from power-up; whatever ran since reset counts towards it
+  unsigned long uptime = millis();
+  if (uptime < W5100_POWER_UP_TIME)
+    delay(W5100_POWER_UP_TIME - uptime);
 
   SPI.begin();
   initSS();
   
   writeMR(1<<RST);
   writeTMSR(0x55);
-  writeRMSR(0x55);
+  setRXMemorySize(0x55);
 
   for (int i=0; i<MAX_SOCK_NUM; i++) {
     SBASE[i] = TXBUF_BASE + SSIZE * i;
-    RBASE[i] = RXBUF_BASE + RSIZE * i;
+  }
+}
+
+void W5100Class::setRXMemorySize(uint8_t rmsr)
+{
+  writeRMSR(rmsr);
+
+  // The W5100 lays the socket buffers out back to back in socket order
+  uint16_t base = RXBUF_BASE;
+  for (int i=0; i<MAX_SOCK_NUM; i++) {
+    RSIZE[i] = 1024 << ((rmsr >> (2 * i)) & 0x03);
+    RBASE[i] = base;
+    base += RSIZE[i];
   }
 }
 
@@ -93,6 +110,27 @@ void W5100Class::send_data_processing_offset(SOCKET s, uint16_t data_offset, con
   writeSnTX_WR(s, ptr);
 }
 
+void W5100Class::send_data_processing_P(SOCKET s, PGM_P data, uint16_t len)
+{
+  uint16_t ptr = readSnTX_WR(s);
+  uint16_t offset = ptr & SMASK;
+  uint16_t dstAddr = offset + SBASE[s];
+
+  if (offset + len > SSIZE) 
+  {
+    // Wrap around circular buffer
+    uint16_t size = SSIZE - offset;
+    write_P(dstAddr, data, size);
+    write_P(SBASE[s], data + size, len - size);
+  } 
+  else {
+    write_P(dstAddr, data, len);
+  }
+
+  ptr += len;
+  writeSnTX_WR(s, ptr);
+}
+
 
 void W5100Class::recv_data_processing(SOCKET s, uint8_t *data, uint16_t len, uint8_t peek)
 {
@@ -112,12 +150,12 @@ void W5100Class::read_data(SOCKET s, volatile uint8_t *src, volatile uint8_t *ds
   uint16_t src_mask;
   uint16_t src_ptr;
 
-  src_mask = (uint16_t)src & RMASK;
+  src_mask = (uint16_t)src & (RSIZE[s] - 1);
   src_ptr = RBASE[s] + src_mask;
 
-  if( (src_mask + len) > RSIZE ) 
+  if( (src_mask + len) > RSIZE[s] ) 
   {
-    size = RSIZE - src_mask;
+    size = RSIZE[s] - src_mask;
     read(src_ptr, (uint8_t *)dst, size);
     dst += size;
     read(RBASE[s], (uint8_t *) dst, len - size);
@@ -129,6 +167,7 @@ void W5100Class::read_data(SOCKET s, volatile uint8_t *src, volatile uint8_t *ds
 
 uint8_t W5100Class::write(uint16_t _addr, uint8_t _data)
 {
+  spiTransactions++;
   setSS();  
   SPI.transfer(0xF0);
   SPI.transfer(_addr >> 8);
@@ -140,6 +179,7 @@ uint8_t W5100Class::write(uint16_t _addr, uint8_t _data)
 
 uint16_t W5100Class::write(uint16_t _addr, const uint8_t *_buf, uint16_t _len)
 {
+  spiTransactions += _len;
   for (uint16_t i=0; i<_len; i++)
   {
     setSS();    
@@ -153,8 +193,25 @@ uint16_t W5100Class::write(uint16_t _addr, const uint8_t *_buf, uint16_t _len)
   return _len;
 }
 
+uint16_t W5100Class::write_P(uint16_t _addr, PGM_P _buf, uint16_t _len)
+{
+  spiTransactions += _len;
+  for (uint16_t i=0; i<_len; i++)
+  {
+    setSS();    
+    SPI.transfer(0xF0);
+    SPI.transfer(_addr >> 8);
+    SPI.transfer(_addr & 0xFF);
+    _addr++;
+    SPI.transfer(pgm_read_byte(_buf + i));
+    resetSS();
+  }
+  return _len;
+}
+
 uint8_t W5100Class::read(uint16_t _addr)
 {
+  spiTransactions++;
   setSS();  
   SPI.transfer(0x0F);
   SPI.transfer(_addr >> 8);
@@ -166,6 +223,7 @@ uint8_t W5100Class::read(uint16_t _addr)
 
 uint16_t W5100Class::read(uint16_t _addr, uint8_t *_buf, uint16_t _len)
 {
+  spiTransactions += _len;
   for (uint16_t i=0; i<_len; i++)
   {
     setSS();
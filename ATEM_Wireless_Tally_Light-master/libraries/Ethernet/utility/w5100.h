@@ -15,6 +15,9 @@
 
 #define MAX_SOCK_NUM 4
 
+// Time (ms) the chip needs after power-up before it can be reset and set up
+#define W5100_POWER_UP_TIME 300
+
 typedef uint8_t SOCKET;
 
 #define IDM_OR  0x8000
@@ -159,6 +162,10 @@ public:
    */
 // FIXME Update documentation
   void send_data_processing_offset(SOCKET s, uint16_t data_offset, const uint8_t *data, uint16_t len);
+  /**
+   * @brief	Like send_data_processing(), with the data taken straight from program memory
+   */
+  void send_data_processing_P(SOCKET s, PGM_P data, uint16_t len);
 
   /**
    * @brief	This function is being called by recv() also.
@@ -184,17 +191,35 @@ public:
   inline void setRetransmissionTime(uint16_t timeout);
   inline void setRetransmissionCount(uint8_t _retry);
 
+  /**
+   * @brief	Re-partitions the 8 KB RX memory between the sockets.
+   * 
+   * rmsr holds 2 bits per socket, socket 0 in the lowest bits: 0 = 1 KB, 1 = 2 KB, 2 = 4 KB, 3 = 8 KB.
+   * The sizes must not add up to more than 8 KB. Sockets whose RX memory moves lose what they
+   * have buffered, so they should be (re)opened afterwards.
+   */
+  void setRXMemorySize(uint8_t rmsr);
+
   void execCmdSn(SOCKET s, SockCMD _cmd);
   
   uint16_t getTXFreeSize(SOCKET s);
   uint16_t getRXReceivedSize(SOCKET s);
   
+  /**
+   * @brief	Number of SPI register accesses since power on.
+   * 
+   * Every access is one SS-framed 4 byte transfer (opcode, address, data), so this
+   * is the figure to watch when tuning how a protocol uses the chip.
+   */
+  static unsigned long spiTransactions;
+
 
   // W5100 Registers
   // ---------------
 private:
   static uint8_t write(uint16_t _addr, uint8_t _data);
   static uint16_t write(uint16_t addr, const uint8_t *buf, uint16_t len);
+  static uint16_t write_P(uint16_t addr, PGM_P buf, uint16_t len);
   static uint8_t read(uint16_t addr);
   static uint16_t read(uint16_t addr, uint8_t *buf, uint16_t len);
   
@@ -314,11 +339,10 @@ private:
 
   static const int SOCKETS = 4;
   static const uint16_t SMASK = 0x07FF; // Tx buffer MASK
-  static const uint16_t RMASK = 0x07FF; // Rx buffer MASK
 public:
   static const uint16_t SSIZE = 2048; // Max Tx buffer size
 private:
-  static const uint16_t RSIZE = 2048; // Max Rx buffer size
+  uint16_t RSIZE[SOCKETS]; // Rx buffer size, see setRXMemorySize()
   uint16_t SBASE[SOCKETS]; // Tx buffer base address
   uint16_t RBASE[SOCKETS]; // Rx buffer base address
 
@@ -123,6 +123,8 @@ enum {
 
 static uint8_t nodeid;              // address of this node
 static uint8_t group;               // network group
+static uint8_t initBand;            // frequency band, until RF12Mod_initDone()
+static uint8_t initPending;         // RF12Mod_initStart() waits for the power-up reset
 static volatile uint8_t rxfill;     // number of data bytes in RF12Mod_buf
 static volatile int8_t rxstate;     // current transceiver state
 
@@ -138,6 +140,8 @@ static long ezNextSend[2];          // when was last retry [0] or data [1] sent
 volatile uint16_t RF12Mod_crc;         // running crc value
 volatile uint8_t RF12Mod_buf[RF_MAX];  // recv/xmit buf, including hdr & crc bytes
 long RF12Mod_seq;                      // seq number of encrypted packet (or -1)
+uint16_t RF12Mod_busyCount;            // canSend() refused: radio busy
+uint16_t RF12Mod_backoffCount;         // canSend() refused: channel in use
 
 static uint32_t seqNum;             // encrypted send sequence number
 static uint32_t cryptKey[4];        // encryption key to use
@@ -328,16 +332,20 @@ uint8_t RF12Mod_recvDone () {
 uint8_t RF12Mod_canSend () {
     // no need to test with interrupts disabled: state TXRECV is only reached
     // outside of ISR and we don't care if rxfill jumps from 0 to 1 here
-    if (rxstate == TXRECV && rxfill == 0 &&
-            (RF12Mod_byte(0x00) & (RF_RSSI_BIT >> 8)) == 0) {
-        RF12Mod_xfer(RF_IDLE_MODE); // stop receiver
-        //XXX just in case, don't know whether these RF12Mod reads are needed!
-        // RF12Mod_xfer(0x0000); // status register
-        // RF12Mod_xfer(RF_RX_FIFO_READ); // fifo read
-        rxstate = TXIDLE;
-        return 1;
+    if (rxstate != TXRECV || rxfill != 0) {
+        ++RF12Mod_busyCount;
+        return 0;
     }
-    return 0;
+    if ((RF12Mod_byte(0x00) & (RF_RSSI_BIT >> 8)) != 0) {
+        ++RF12Mod_backoffCount;
+        return 0;
+    }
+    RF12Mod_xfer(RF_IDLE_MODE); // stop receiver
+    //XXX just in case, don't know whether these RF12Mod reads are needed!
+    // RF12Mod_xfer(0x0000); // status register
+    // RF12Mod_xfer(RF_RX_FIFO_READ); // fifo read
+    rxstate = TXIDLE;
+    return 1;
 }
 
 void RF12Mod_sendStart (uint8_t hdr) {
@@ -384,12 +392,15 @@ void RF12Mod_sendWait (uint8_t mode) {
 }
 
 /*!
-  Call this once with the node ID (0-31), frequency band (0-3), and
+  Starts initializing with the node ID (0-31), frequency band (0-3), and
   optional group (0-255 for RF12ModB, only 212 allowed for RF12Mod).
+  The RFM12B may still be in power-up reset, call RF12Mod_initDone()
+  until it returns true before using the radio.
 */
-uint8_t RF12Mod_initialize (uint8_t id, uint8_t band, uint8_t g) {
+void RF12Mod_initStart (uint8_t id, uint8_t band, uint8_t g) {
     nodeid = id;
     group = g;
+    initBand = band;
     
     RF12Mod_spiInit();
 
@@ -397,10 +408,24 @@ uint8_t RF12Mod_initialize (uint8_t id, uint8_t band, uint8_t g) {
 
     RF12Mod_xfer(RF_SLEEP_MODE); // DC (disable clk pin), enable lbd
     
-    // wait until RFM12B is out of power-up reset, this takes several *seconds*
+    // the RFM12B takes a while to get out of power-up reset, see RF12Mod_initDone()
     RF12Mod_xfer(RF_TXREG_WRITE); // in case we're still in OOK mode
-    while (digitalRead(RFM_IRQ) == 0)
+    initPending = 1;
+}
+
+/*!
+  Call this frequently after RF12Mod_initStart(), returns true once the
+  RFM12B is out of power-up reset and has been configured.
+*/
+uint8_t RF12Mod_initDone () {
+    if (!initPending)
+        return 1;
+    if (digitalRead(RFM_IRQ) == 0) {
         RF12Mod_xfer(0x0000);
+        return 0;
+    }
+    initPending = 0;
+    uint8_t band = initBand;
         
     RF12Mod_xfer(0x80C7 | (band << 4)); // EL (ena TX), EF (ena RX FIFO), 12.0pF 
     RF12Mod_xfer(0xA640); // 868MHz 
@@ -455,6 +480,18 @@ uint8_t RF12Mod_initialize (uint8_t id, uint8_t band, uint8_t g) {
         detachInterrupt(0);
 #endif
     
+    return 1;
+}
+
+/*!
+  Call this once with the node ID (0-31), frequency band (0-3), and
+  optional group (0-255 for RF12ModB, only 212 allowed for RF12Mod).
+  Waits until the RFM12B is out of power-up reset, this takes several *seconds*.
+*/
+uint8_t RF12Mod_initialize (uint8_t id, uint8_t band, uint8_t g) {
+    RF12Mod_initStart(id, band, g);
+    while (!RF12Mod_initDone())
+        ;
     return nodeid;
 }
 
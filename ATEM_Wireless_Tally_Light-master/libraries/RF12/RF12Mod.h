@@ -57,6 +57,10 @@ extern volatile uint16_t RF12Mod_crc;
 extern volatile uint8_t RF12Mod_buf[];
 /// Seq number of encrypted packet (or -1).
 extern long RF12Mod_seq;
+/// Statistics: Calls of RF12Mod_canSend() refused because the radio was busy receiving
+/// or sending, or because another transmitter was heard on the channel.
+extern uint16_t RF12Mod_busyCount;
+extern uint16_t RF12Mod_backoffCount;
 
 /// Only needed if you want to init the SPI bus before RF12Mod_initialize does it.
 void RF12Mod_spiInit(void);
@@ -64,6 +68,11 @@ void RF12Mod_spiInit(void);
 /// Call this once with the node ID, frequency band, and optional group.
 uint8_t RF12Mod_initialize(uint8_t id, uint8_t band, uint8_t group=0xD4);
 
+/// Same as RF12Mod_initialize(), without waiting for the power-up reset of the RFM12B.
+void RF12Mod_initStart(uint8_t id, uint8_t band, uint8_t group=0xD4);
+/// Call this frequently after RF12Mod_initStart(), returns true once the radio is ready.
+uint8_t RF12Mod_initDone(void);
+
 /// Initialize the RF12Mod module from settings stored in EEPROM by "RF12Moddemo"
 /// don't call RF12Mod_initialize() if you init the hardware with RF12Mod_config().
 /// @return the node ID as 1..31 value (1..26 correspond to nodes 'A'..'Z').
@@ -0,0 +1,224 @@
+#ifndef TallyFrame_h
+#define TallyFrame_h
+
+#include <Arduino.h>
+
+/*
+ * Radio frame with the program/preview tally of all inputs, 2 bits per input:
+ *
+ *   byte 0    'T', tells the frame from the old payload of two ints
+ *   byte 1    version (high nibble) and flags (low nibble)
+ *   byte 2    sequence number, counts up with every change of the tally
+ *   byte 3    age: time since the switcher packet with the change arrived, in 100 us (255 = that or more)
+ *   byte 4    echo node: the receiver which should echo the frame back, 0 = none
+ *   byte 5    index of the first tally byte in the frame
+ *   byte 6-   tally bytes: input 1 in bits 0-1 of tally byte 0, input 2 in bits 2-3 and so on
+ *
+ * A full frame carries all tally bytes. A delta frame only carries the range of tally bytes that changed since
+ * the previous sequence number, and may only be applied on top of that.
+ * Receivers are numbered 1-15 by their DIP switches, so 16 inputs are covered.
+ *
+ * The echo is sent to the transmitter once the receiver has applied the frame, so the transmitter can measure
+ * the latency from the switcher packet to the LED:
+ *
+ *   byte 0    'E'
+ *   byte 1    sequence number of the frame echoed
+ *   byte 2-3  time (us, LSB first) from receiving the frame to sending the echo
+ */
+
+#define TALLY_FRAME_MAGIC		'T'
+#define TALLY_FRAME_VERSION		2
+#define TALLY_FRAME_DELTA		0x01	// Flag: delta frame
+
+#define TALLY_FRAME_INPUTS		16
+#define TALLY_FRAME_TALLY_BYTES	(TALLY_FRAME_INPUTS/4)
+#define TALLY_FRAME_HEADER		6
+#define TALLY_FRAME_MAX_LENGTH	(TALLY_FRAME_HEADER + TALLY_FRAME_TALLY_BYTES)
+
+#define TALLY_ECHO_MAGIC		'E'
+#define TALLY_TRANSMITTER_NODE	20		// RF12 node ID of the transmitter, where echoes are sent
+#define TALLY_ECHO_LENGTH		4
+
+#define TALLY_PROGRAM			0x01
+#define TALLY_PREVIEW			0x02
+
+/**
+ * Transmitter side: Collects the tally and builds frames
+ */
+class TallyFrameEncoder
+{
+  public:
+	uint8_t frame[TALLY_FRAME_MAX_LENGTH];	// The frame built by update() or buildFull()
+	uint8_t length;
+
+	TallyFrameEncoder() : length(0), _sequence(0) {
+		memset(_tally, 0, TALLY_FRAME_TALLY_BYTES);
+		memset(_sent, 0, TALLY_FRAME_TALLY_BYTES);
+	}
+
+	/**
+	 * Sets the TALLY_PROGRAM / TALLY_PREVIEW flags of an input (1-TALLY_FRAME_INPUTS)
+	 */
+	void setTally(uint8_t input, uint8_t flags) {
+		if (input < 1 || input > TALLY_FRAME_INPUTS)	return;
+		uint8_t shift = ((input-1) & 3) * 2;
+		uint8_t &b = _tally[(input-1) >> 2];
+		b = (b & ~(3 << shift)) | ((flags & 3) << shift);
+	}
+
+	/**
+	 * If the tally changed since the last call: Counts up the sequence number, builds a delta frame and returns true
+	 */
+	bool update() {
+		uint8_t first = TALLY_FRAME_TALLY_BYTES;
+		uint8_t last = 0;
+		for (uint8_t i = 0; i < TALLY_FRAME_TALLY_BYTES; i++) {
+			if (_tally[i] != _sent[i]) {
+				if (first == TALLY_FRAME_TALLY_BYTES)	first = i;
+				last = i;
+			}
+		}
+		if (first == TALLY_FRAME_TALLY_BYTES)	return false;
+
+		memcpy(_sent, _tally, TALLY_FRAME_TALLY_BYTES);
+		_sequence++;
+		_build(TALLY_FRAME_DELTA, first, last - first + 1);
+		return true;
+	}
+
+	/**
+	 * Builds a full frame of the current sequence number
+	 */
+	void buildFull() {
+		_build(0, 0, TALLY_FRAME_TALLY_BYTES);
+	}
+
+	/**
+	 * Sets the age (us) and echo node of the frame built, right before it is sent
+	 */
+	void stamp(unsigned long age, uint8_t echoNode) {
+		frame[3] = age >= 25500 ? 255 : age / 100;
+		frame[4] = echoNode;
+	}
+
+	uint8_t sequence() {
+		return _sequence;
+	}
+
+	/**
+	 * Returns true if data is the echo of the frame with this sequence number
+	 */
+	static bool isEcho(const volatile uint8_t *data, uint8_t len, uint8_t sequence) {
+		return len >= TALLY_ECHO_LENGTH && data[0] == TALLY_ECHO_MAGIC && data[1] == sequence;
+	}
+
+	/**
+	 * Latency (us) from the switcher packet to the LED: The age of the frame when sent, plus half the round trip
+	 * over the radio (roundTrip, us from sending the frame to the echo, less the receiver's time in the echo)
+	 * plus the receiver's own time
+	 */
+	static unsigned long echoLatency(const volatile uint8_t *echo, unsigned long age, unsigned long roundTrip) {
+		unsigned int holdTime = echo[2] | (echo[3] << 8);
+		if (roundTrip > holdTime) {
+			roundTrip -= holdTime;
+		}
+		return age + roundTrip / 2 + holdTime;
+	}
+
+  private:
+	uint8_t _tally[TALLY_FRAME_TALLY_BYTES];	// Set by setTally()
+	uint8_t _sent[TALLY_FRAME_TALLY_BYTES];		// Tally of the current sequence number
+	uint8_t _sequence;
+
+	void _build(uint8_t flags, uint8_t first, uint8_t count) {
+		frame[0] = TALLY_FRAME_MAGIC;
+		frame[1] = (TALLY_FRAME_VERSION << 4) | flags;
+		frame[2] = _sequence;
+		frame[3] = 0;
+		frame[4] = 0;
+		frame[5] = first;
+		memcpy(frame + TALLY_FRAME_HEADER, _sent + first, count);
+		length = TALLY_FRAME_HEADER + count;
+	}
+};
+
+/**
+ * Receiver side: Keeps the tally of one input, read straight from its bits in each frame
+ */
+class TallyFrameDecoder
+{
+  public:
+	TallyFrameDecoder() : _input(0), _tally(0), _sequence(0), _age(0), _synced(false), _echo(false) {}
+
+	void begin(uint8_t input) {
+		_input = input;
+		_tally = 0;
+		_synced = false;
+		_echo = false;
+	}
+
+	/**
+	 * Returns true if data is a tally frame. A delta frame is only applied on top of the frame before it,
+	 * otherwise the tally stays as it is until the next full frame.
+	 */
+	bool decode(const volatile uint8_t *data, uint8_t len) {
+		if (len < TALLY_FRAME_HEADER || data[0] != TALLY_FRAME_MAGIC || (data[1] >> 4) != TALLY_FRAME_VERSION)	return false;
+
+		uint8_t sequence = data[2];
+		bool delta = data[1] & TALLY_FRAME_DELTA;
+		_echo = false;
+		if (delta && !(_synced && sequence == (uint8_t)(_sequence + 1)))	return true;
+
+		_age = data[3];
+		_echo = _input != 0 && data[4] == _input;
+		uint8_t index = ((_input-1) >> 2) - data[5];	// Tally byte of our input within the frame
+		if (_input >= 1 && _input <= TALLY_FRAME_INPUTS && index < len - TALLY_FRAME_HEADER) {
+			_tally = (data[TALLY_FRAME_HEADER + index] >> (((_input-1) & 3) * 2)) & 3;
+		} else if (!delta) {
+			_tally = 0;
+		}
+		_sequence = sequence;
+		_synced = true;
+		return true;
+	}
+
+	/**
+	 * TALLY_PROGRAM / TALLY_PREVIEW flags of the input
+	 */
+	uint8_t tally() {
+		return _tally;
+	}
+
+	uint8_t sequence() {
+		return _sequence;
+	}
+
+	/**
+	 * Age (100 us) of the last frame applied, see the frame layout
+	 */
+	uint8_t age() {
+		return _age;
+	}
+
+	/**
+	 * If the last frame applied asks this receiver for an echo, builds it in echo[] and returns true
+	 */
+	bool buildEcho(uint8_t echo[TALLY_ECHO_LENGTH], unsigned int holdTime) {
+		if (!_echo)	return false;
+		echo[0] = TALLY_ECHO_MAGIC;
+		echo[1] = _sequence;
+		echo[2] = holdTime & 0xFF;
+		echo[3] = holdTime >> 8;
+		return true;
+	}
+
+  private:
+	uint8_t _input;
+	uint8_t _tally;
+	uint8_t _sequence;
+	uint8_t _age;
+	bool _synced;
+	bool _echo;
+};
+
+#endif
@@ -0,0 +1,8 @@
+// Just enough of the Arduino core to build TallyFrame.h on a PC
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <string.h>
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * Host test of TallyFrame.h: encoding and decoding, delta frames and resync on a full frame, echoes and the latency
+ * computed from them. The Arduino IDE does not compile the extras folder. Build and run it on a PC, from this folder:
+ *
+ *   g++ -Wall -I. -I../.. -o TallyFrameTest TallyFrameTest.cpp && ./TallyFrameTest
+ *
+ * Prints the checks that fail and exits with 1 if there are any.
+ */
+#include <stdio.h>
+#include "TallyFrame.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+			failures++; \
+		} \
+	} while (0)
+
+// A receiver for each input, fed every frame:
+static TallyFrameDecoder receivers[TALLY_FRAME_INPUTS + 1];
+
+static void deliver(const uint8_t *frame, uint8_t length) {
+	for (uint8_t input = 1; input <= TALLY_FRAME_INPUTS; input++) {
+		CHECK(receivers[input].decode(frame, length));
+	}
+}
+
+static void beginReceivers() {
+	for (uint8_t input = 1; input <= TALLY_FRAME_INPUTS; input++) {
+		receivers[input].begin(input);
+	}
+}
+
+static void testFullFrame() {
+	TallyFrameEncoder encoder;
+	encoder.setTally(1, TALLY_PROGRAM);
+	encoder.setTally(6, TALLY_PREVIEW);
+	encoder.setTally(16, TALLY_PROGRAM | TALLY_PREVIEW);
+	encoder.setTally(0, TALLY_PROGRAM);		// Out of range, ignored
+	encoder.setTally(17, TALLY_PROGRAM);
+	CHECK(encoder.update());
+	encoder.buildFull();
+
+	CHECK(encoder.length == TALLY_FRAME_MAX_LENGTH);
+	CHECK(encoder.frame[0] == TALLY_FRAME_MAGIC);
+	CHECK(encoder.frame[1] == TALLY_FRAME_VERSION << 4);
+	CHECK(encoder.frame[2] == 1);
+	CHECK(encoder.frame[5] == 0);
+	CHECK(encoder.frame[TALLY_FRAME_HEADER] == 0x01);		// Input 1 in bits 0-1
+	CHECK(encoder.frame[TALLY_FRAME_HEADER + 1] == 0x08);	// Input 6 in bits 2-3
+	CHECK(encoder.frame[TALLY_FRAME_HEADER + 3] == 0xC0);	// Input 16 in bits 6-7
+
+	beginReceivers();
+	deliver(encoder.frame, encoder.length);
+	for (uint8_t input = 1; input <= TALLY_FRAME_INPUTS; input++) {
+		uint8_t expected = input == 1 ? TALLY_PROGRAM : input == 6 ? TALLY_PREVIEW : input == 16 ? TALLY_PROGRAM | TALLY_PREVIEW : 0;
+		CHECK(receivers[input].tally() == expected);
+		CHECK(receivers[input].sequence() == 1);
+	}
+}
+
+static void testNotAFrame() {
+	TallyFrameDecoder decoder;
+	decoder.begin(1);
+	const uint8_t oldPayload[] = { 1, 0, 2, 0 };		// Two ints, as sent before the frame format
+	CHECK(!decoder.decode(oldPayload, sizeof oldPayload));
+	const uint8_t otherVersion[] = { TALLY_FRAME_MAGIC, (TALLY_FRAME_VERSION + 1) << 4, 1, 0, 0, 0, 0x01 };
+	CHECK(!decoder.decode(otherVersion, sizeof otherVersion));
+	const uint8_t tooShort[] = { TALLY_FRAME_MAGIC, TALLY_FRAME_VERSION << 4, 1, 0, 0 };
+	CHECK(!decoder.decode(tooShort, sizeof tooShort));
+	CHECK(decoder.tally() == 0);
+}
+
+static void testDelta() {
+	TallyFrameEncoder encoder;
+	CHECK(!encoder.update());		// Nothing changed yet
+	encoder.setTally(1, TALLY_PROGRAM);
+	encoder.setTally(2, TALLY_PREVIEW);
+	CHECK(encoder.update());
+	beginReceivers();
+	encoder.buildFull();
+	deliver(encoder.frame, encoder.length);
+
+	// Cut: 2 to program, 9 to preview. Only tally bytes 0-2 are sent.
+	encoder.setTally(1, 0);
+	encoder.setTally(2, TALLY_PROGRAM);
+	encoder.setTally(9, TALLY_PREVIEW);
+	CHECK(encoder.update());
+	CHECK(encoder.frame[1] == ((TALLY_FRAME_VERSION << 4) | TALLY_FRAME_DELTA));
+	CHECK(encoder.frame[2] == 2);
+	CHECK(encoder.frame[5] == 0);
+	CHECK(encoder.length == TALLY_FRAME_HEADER + 3);
+	CHECK(!encoder.update());		// Sent already
+	deliver(encoder.frame, encoder.length);
+	CHECK(receivers[1].tally() == 0);
+	CHECK(receivers[2].tally() == TALLY_PROGRAM);
+	CHECK(receivers[9].tally() == TALLY_PREVIEW);
+	CHECK(receivers[16].sequence() == 2);	// Outside the range sent, keeps its tally and follows the sequence
+
+	// A delta frame which starts further in: 13 to preview, tally byte 3 only
+	encoder.setTally(13, TALLY_PREVIEW);
+	CHECK(encoder.update());
+	CHECK(encoder.frame[5] == 3);
+	CHECK(encoder.length == TALLY_FRAME_HEADER + 1);
+	deliver(encoder.frame, encoder.length);
+	CHECK(receivers[13].tally() == TALLY_PREVIEW);
+	CHECK(receivers[2].tally() == TALLY_PROGRAM);
+	CHECK(receivers[9].tally() == TALLY_PREVIEW);
+}
+
+static void testResync() {
+	TallyFrameEncoder encoder;
+	encoder.setTally(3, TALLY_PROGRAM);
+	CHECK(encoder.update());
+	beginReceivers();
+	encoder.buildFull();
+	deliver(encoder.frame, encoder.length);
+	CHECK(receivers[3].tally() == TALLY_PROGRAM);
+
+	// Sequence 2 is lost on the radio
+	encoder.setTally(3, 0);
+	encoder.setTally(4, TALLY_PROGRAM);
+	CHECK(encoder.update());
+
+	// Sequence 3 is a delta on top of 2: Not applied, the tally stays
+	encoder.setTally(4, TALLY_PROGRAM | TALLY_PREVIEW);
+	CHECK(encoder.update());
+	deliver(encoder.frame, encoder.length);
+	CHECK(receivers[3].tally() == TALLY_PROGRAM);
+	CHECK(receivers[4].tally() == 0);
+	CHECK(receivers[4].sequence() == 1);
+
+	// The next full frame (a repeat or heartbeat) brings them back in sync
+	encoder.buildFull();
+	deliver(encoder.frame, encoder.length);
+	CHECK(receivers[3].tally() == 0);
+	CHECK(receivers[4].tally() == (TALLY_PROGRAM | TALLY_PREVIEW));
+	CHECK(receivers[4].sequence() == 3);
+
+	// Deltas apply again from there
+	encoder.setTally(4, TALLY_PROGRAM);
+	CHECK(encoder.update());
+	deliver(encoder.frame, encoder.length);
+	CHECK(receivers[4].tally() == TALLY_PROGRAM);
+
+	// A receiver started late ignores deltas until its first full frame
+	TallyFrameDecoder late;
+	late.begin(4);
+	encoder.setTally(5, TALLY_PREVIEW);
+	CHECK(encoder.update());
+	CHECK(late.decode(encoder.frame, encoder.length));
+	CHECK(late.tally() == 0);
+	encoder.buildFull();
+	CHECK(late.decode(encoder.frame, encoder.length));
+	CHECK(late.tally() == TALLY_PROGRAM);
+}
+
+static void testSequenceWrap() {
+	TallyFrameEncoder encoder;
+	beginReceivers();
+	for (int i = 0; i < 300; i++) {
+		encoder.setTally(1, i & 1 ? TALLY_PROGRAM : TALLY_PREVIEW);
+		CHECK(encoder.update());
+		if (i == 0) {
+			encoder.buildFull();
+		}
+		deliver(encoder.frame, encoder.length);
+		CHECK(receivers[1].tally() == (i & 1 ? TALLY_PROGRAM : TALLY_PREVIEW));
+	}
+	CHECK(encoder.sequence() == 300 % 256);
+}
+
+static void testEcho() {
+	TallyFrameEncoder encoder;
+	encoder.setTally(7, TALLY_PROGRAM);
+	CHECK(encoder.update());
+	encoder.stamp(1234, 7);
+	CHECK(encoder.frame[3] == 12);		// 100 us units
+	CHECK(encoder.frame[4] == 7);
+	encoder.stamp(30000, 0);
+	CHECK(encoder.frame[3] == 255);
+	CHECK(encoder.frame[4] == 0);
+
+	// Only the receiver named in the frame echoes it
+	beginReceivers();
+	encoder.buildFull();
+	encoder.stamp(1234, 7);
+	deliver(encoder.frame, encoder.length);
+	uint8_t echo[TALLY_ECHO_LENGTH];
+	CHECK(!receivers[6].buildEcho(echo, 100));
+	CHECK(receivers[7].age() == 12);
+	CHECK(receivers[7].buildEcho(echo, 700));
+	CHECK(echo[0] == TALLY_ECHO_MAGIC);
+	CHECK(echo[1] == encoder.sequence());
+	CHECK((echo[2] | (echo[3] << 8)) == 700);
+
+	CHECK(TallyFrameEncoder::isEcho(echo, sizeof echo, encoder.sequence()));
+	CHECK(!TallyFrameEncoder::isEcho(echo, sizeof echo, encoder.sequence() + 1));
+	CHECK(!TallyFrameEncoder::isEcho(echo, TALLY_ECHO_LENGTH - 1, encoder.sequence()));
+	CHECK(!TallyFrameEncoder::isEcho(encoder.frame, encoder.length, encoder.sequence()));
+
+	// Age 1234 us, 2700 us from sending to the echo of which the receiver held it 700 us:
+	// 1000 us each way over the radio, so 1234 + 1000 + 700
+	CHECK(TallyFrameEncoder::echoLatency(echo, 1234, 2700) == 2934);
+	// A round trip shorter than the hold time (the clocks don't agree) is taken as it is
+	CHECK(TallyFrameEncoder::echoLatency(echo, 0, 600) == 300 + 700);
+
+	// The echo request is not repeated by later frames without one
+	encoder.buildFull();
+	encoder.stamp(0, 0);
+	deliver(encoder.frame, encoder.length);
+	CHECK(!receivers[7].buildEcho(echo, 700));
+
+	// Nor by a delta that could not be applied, as the one before it was lost: Neither its own request
+	// nor the one of the frame applied before
+	encoder.stamp(0, 7);
+	deliver(encoder.frame, encoder.length);
+	CHECK(receivers[7].buildEcho(echo, 700));
+	encoder.setTally(7, 0);
+	CHECK(encoder.update());
+	encoder.setTally(7, TALLY_PREVIEW);
+	CHECK(encoder.update());
+	encoder.stamp(0, 0);
+	deliver(encoder.frame, encoder.length);
+	CHECK(!receivers[7].buildEcho(echo, 700));
+	encoder.stamp(0, 7);
+	deliver(encoder.frame, encoder.length);
+	CHECK(!receivers[7].buildEcho(echo, 700));
+}
+
+int main() {
+	testFullFrame();
+	testNotAFrame();
+	testDelta();
+	testResync();
+	testSequenceWrap();
+	testEcho();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}